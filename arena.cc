@@ -0,0 +1,76 @@
+#include "arena.h"
+#include "stats.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+namespace arena {
+thread_local Arena *current = nullptr;
+
+char *Arena::new_block(u64 size) {
+  char *block = static_cast<char *>(std::malloc(size));
+  if (!block) {
+    std::abort();
+  }
+
+  blocks_.push_back(block);
+  reserved_ += size;
+  if (stats::tracking)
+    stats::note_bytes(size);
+  return block;
+}
+
+void *Arena::allocate(u64 size, u64 align) {
+  ++count_;
+  allocated_ += size;
+
+  auto p = reinterpret_cast<std::uintptr_t>(ptr_);
+  auto aligned = (p + align - 1) & ~(std::uintptr_t)(align - 1);
+  if (ptr_ && aligned + size <= reinterpret_cast<std::uintptr_t>(end_)) {
+    ptr_ = reinterpret_cast<char *>(aligned + size);
+    return reinterpret_cast<char *>(aligned);
+  }
+
+  // big objects get a block of their own so that they don't waste the rest of
+  // the current one.
+  if (size + align > kBlockSize / 4) {
+    char *block = new_block(size + align);
+    aligned = (reinterpret_cast<std::uintptr_t>(block) + align - 1) &
+              ~(std::uintptr_t)(align - 1);
+    return reinterpret_cast<char *>(aligned);
+  }
+
+  ptr_ = new_block(kBlockSize);
+  end_ = ptr_ + kBlockSize;
+  aligned = (reinterpret_cast<std::uintptr_t>(ptr_) + align - 1) &
+            ~(std::uintptr_t)(align - 1);
+  ptr_ = reinterpret_cast<char *>(aligned + size);
+  return reinterpret_cast<char *>(aligned);
+}
+
+char *Arena::strndup(const char *str, u64 len) {
+  char *res = static_cast<char *>(allocate(len + 1, 1));
+  std::memcpy(res, str, len);
+  res[len] = '\0';
+  return res;
+}
+
+void Arena::release() {
+  // destroy in reverse order of construction like the stack would.
+  for (auto it = destructors_.rbegin(); it != destructors_.rend(); ++it) {
+    it->destroy_(it->obj_);
+  }
+  destructors_.clear();
+
+  for (char *block : blocks_) {
+    std::free(block);
+  }
+  blocks_.clear();
+  if (stats::tracking)
+    stats::note_bytes(-static_cast<i64>(reserved_));
+
+  ptr_ = end_ = nullptr;
+  allocated_ = reserved_ = count_ = 0;
+}
+} // namespace arena
@@ -0,0 +1,71 @@
+#ifndef _ASMLAI_ARENA_H
+#define _ASMLAI_ARENA_H
+
+#include "types.h"
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace arena {
+
+constexpr u64 kBlockSize = 64 * 1024;
+
+// Arena is a bump allocator that owns everything the parser creates for one
+// compilation: nodes, types, struct members and scopes. Nothing is freed on
+// its own; the whole arena is released in one go when compilation ends.
+class Arena {
+public:
+  Arena() = default;
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+  ~Arena() { release(); }
+
+  void *allocate(u64 size, u64 align);
+  char *strndup(const char *str, u64 len);
+  void release();
+
+  template <typename T, typename... Args> T *make(Args &&...args) {
+    T *obj =
+        new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    // objects holding vectors or shared pointers still need their destructor
+    // to run on release, trivial ones are just dropped with the block.
+    if constexpr (!std::is_trivially_destructible_v<T>) {
+      destructors_.push_back({obj, [](void *p) { static_cast<T *>(p)->~T(); }});
+    }
+    return obj;
+  }
+
+  u64 bytes_allocated() const { return allocated_; }
+  u64 bytes_reserved() const { return reserved_; }
+  u64 allocation_count() const { return count_; }
+
+private:
+  struct Destructor {
+    void *obj_;
+    void (*destroy_)(void *);
+  };
+
+  char *new_block(u64 size);
+
+  std::vector<char *> blocks_;
+  std::vector<Destructor> destructors_;
+  char *ptr_ = nullptr;
+  char *end_ = nullptr;
+
+  u64 allocated_ = 0;
+  u64 reserved_ = 0;
+  u64 count_ = 0;
+};
+
+// the arena of the compilation in progress on this thread, set up by the
+// driver.
+extern thread_local Arena *current;
+
+template <typename T, typename... Args> T *make(Args &&...args) {
+  return current->make<T>(std::forward<Args>(args)...);
+}
+
+} // namespace arena
+
+#endif
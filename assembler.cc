@@ -0,0 +1,670 @@
+#include "assembler.h"
+#include "diag.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <unordered_map>
+
+namespace assembler {
+
+struct Reg {
+  u8 num_;  // 0 is rax, 15 is r15.
+  u8 size_; // in bytes.
+};
+
+struct Operand {
+  enum Kind { Register, Immediate, Memory, Label } kind_;
+  Reg reg_{};
+  i64 imm_ = 0;
+  // memory operands: disp(%base), or sym(%rip) when rip_ is set.
+  u8 base_ = 0;
+  bool rip_ = false;
+  i64 disp_ = 0;
+  std::string_view sym_;
+};
+
+enum class Op : u8 {
+  Mov,
+  Movsbl,
+  Movswl,
+  Movsxd,
+  Movzx,
+  Lea,
+  Add,
+  Or,
+  And,
+  Sub,
+  Xor,
+  Cmp,
+  Imul,
+  Neg,
+  Idiv,
+  Shl,
+  Sar,
+  Sete,
+  Setne,
+  Setl,
+  Setle,
+  Push,
+  Pop,
+  Jmp,
+  Je,
+  Jne,
+  Call,
+  Ret,
+  Cqo,
+  Cdq,
+};
+
+static const std::unordered_map<std::string_view, Op> kMnemonics = {
+    {"mov", Op::Mov},     {"movsbl", Op::Movsbl}, {"movswl", Op::Movswl},
+    {"movsxd", Op::Movsxd}, {"movzx", Op::Movzx},  {"movzb", Op::Movzx},
+    {"lea", Op::Lea},     {"add", Op::Add},       {"or", Op::Or},
+    {"and", Op::And},     {"sub", Op::Sub},       {"xor", Op::Xor},
+    {"cmp", Op::Cmp},     {"imul", Op::Imul},     {"neg", Op::Neg},
+    {"idiv", Op::Idiv},   {"shl", Op::Shl},       {"sar", Op::Sar},
+    {"sete", Op::Sete},   {"setne", Op::Setne},   {"setl", Op::Setl},
+    {"setle", Op::Setle}, {"push", Op::Push},     {"pop", Op::Pop},
+    {"jmp", Op::Jmp},     {"je", Op::Je},         {"jne", Op::Jne},
+    {"call", Op::Call},   {"ret", Op::Ret},       {"cqo", Op::Cqo},
+    {"cdq", Op::Cdq},
+};
+
+static const std::unordered_map<std::string_view, Reg> kRegisters = [] {
+  static const char *const names[4][16] = {
+      {"al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil", "r8b", "r9b",
+       "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"},
+      {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di", "r8w", "r9w", "r10w",
+       "r11w", "r12w", "r13w", "r14w", "r15w"},
+      {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi", "r8d", "r9d",
+       "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"},
+      {"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi", "r8", "r9",
+       "r10", "r11", "r12", "r13", "r14", "r15"},
+  };
+  std::unordered_map<std::string_view, Reg> regs;
+  for (u8 size = 0; size < 4; ++size) {
+    for (u8 num = 0; num < 16; ++num)
+      regs[names[size][num]] = Reg{num, static_cast<u8>(1 << size)};
+  }
+  return regs;
+}();
+
+// a rel32 field waiting for its target.
+struct Fixup {
+  SectionId section_;
+  u64 offset_;
+  // end of the instruction, the displacement is relative to it.
+  u64 next_;
+  u32 symbol_;
+  RelocationKind kind_;
+};
+
+class Assembler {
+public:
+  explicit Assembler(std::string_view text) : text_(text) {
+    obj_.sections_[static_cast<u64>(SectionId::Text)].align_ = 16;
+    obj_.sections_[static_cast<u64>(SectionId::Data)].align_ = 8;
+    obj_.sections_[static_cast<u64>(SectionId::Rodata)].align_ = 8;
+    obj_.sections_[static_cast<u64>(SectionId::Bss)].align_ = 8;
+  }
+
+  Object run();
+
+private:
+  template <typename... Args>
+  [[noreturn]] void error(const char *format_string, Args... args);
+
+  Section &section() { return obj_.sections_[static_cast<u64>(section_)]; }
+  u64 offset() { return section().size_; }
+  void byte(u8 b) {
+    section().bytes_.push_back(b);
+    ++section().size_;
+  }
+  void bytes(u64 value, u64 count) {
+    for (u64 i = 0; i < count; ++i)
+      byte(static_cast<u8>(value >> (8 * i)));
+  }
+
+  u32 symbol(std::string_view name);
+  void define(std::string_view name);
+
+  void line(std::string_view s);
+  void directive(std::string_view name, std::string_view args);
+  void instruction(std::string_view mnemonic, std::string_view args);
+  Operand operand(std::string_view s);
+  Reg reg(std::string_view s);
+  i64 number(std::string_view s);
+
+  void rex(bool w, u8 reg, const Operand &rm, bool byte_regs);
+  void modrm(u8 reg, const Operand &rm, u64 imm_size);
+  void op_rm(u64 size, std::initializer_list<u8> opcode, u8 reg,
+             const Operand &rm, bool byte_reg = false, u64 imm_size = 0);
+  void rel32(std::string_view target, RelocationKind kind);
+  void resolve();
+
+  void alu(u8 digit, u8 opcode, const Operand &src, const Operand &dst);
+
+  std::string_view text_;
+  u64 line_number_ = 0;
+  SectionId section_ = SectionId::Text;
+  Object obj_;
+  std::unordered_map<std::string, u32> symbols_;
+  std::vector<Fixup> fixups_;
+};
+
+template <typename... Args>
+void Assembler::error(const char *format_string, Args... args) {
+  throw diag::CompileError(diag::format("assembler: line %lu: ", line_number_) +
+                           diag::format(format_string, args...));
+}
+
+static std::string_view trim(std::string_view s) {
+  while (!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+    s.remove_prefix(1);
+  while (!s.empty() && (s.back() == ' ' || s.back() == '\t'))
+    s.remove_suffix(1);
+  return s;
+}
+
+static bool fits_i8(i64 v) { return -128 <= v && v <= 127; }
+static bool fits_i32(i64 v) { return INT32_MIN <= v && v <= INT32_MAX; }
+
+u32 Assembler::symbol(std::string_view name) {
+  auto [it, inserted] =
+      symbols_.try_emplace(std::string(name), obj_.symbols_.size());
+  if (inserted) {
+    Symbol sym;
+    sym.name_ = it->first;
+    obj_.symbols_.push_back(std::move(sym));
+  }
+  return it->second;
+}
+
+void Assembler::define(std::string_view name) {
+  Symbol &sym = obj_.symbols_[symbol(name)];
+  if (sym.section_ != SectionId::Undefined)
+    error("symbol %.*s is already defined", (int)name.size(), name.data());
+  sym.section_ = section_;
+  sym.value_ = offset();
+}
+
+i64 Assembler::number(std::string_view s) {
+  std::string str(s);
+  char *end;
+  i64 v = std::strtoll(str.c_str(), &end, 0);
+  if (str.empty() || *end)
+    error("bad number '%s'", str.c_str());
+  return v;
+}
+
+Reg Assembler::reg(std::string_view s) {
+  if (s.empty() || s[0] != '%')
+    error("expected a register");
+  auto it = kRegisters.find(s.substr(1));
+  if (it == kRegisters.end())
+    error("unknown register %.*s", (int)s.size(), s.data());
+  return it->second;
+}
+
+Operand Assembler::operand(std::string_view s) {
+  s = trim(s);
+  Operand op{};
+  if (s.empty())
+    error("missing operand");
+
+  if (s[0] == '%') {
+    op.kind_ = Operand::Register;
+    op.reg_ = reg(s);
+    return op;
+  }
+
+  if (s[0] == '$') {
+    op.kind_ = Operand::Immediate;
+    op.imm_ = number(s.substr(1));
+    return op;
+  }
+
+  u64 paren = s.find('(');
+  if (paren == std::string_view::npos) {
+    op.kind_ = Operand::Label;
+    op.sym_ = s;
+    return op;
+  }
+
+  op.kind_ = Operand::Memory;
+  std::string_view disp = s.substr(0, paren);
+  std::string_view base = s.substr(paren + 1, s.size() - paren - 2);
+  if (base == "%rip") {
+    op.rip_ = true;
+    op.sym_ = disp;
+    return op;
+  }
+
+  Reg r = reg(base);
+  if (r.size_ != 8)
+    error("base register must be 64-bit");
+  op.base_ = r.num_;
+  op.disp_ = disp.empty() ? 0 : number(disp);
+  if (!fits_i32(op.disp_))
+    error("displacement out of range");
+  return op;
+}
+
+// REX prefix for a reg field and an r/m operand. Byte registers spl, bpl, sil
+// and dil can only be named with some REX prefix present.
+void Assembler::rex(bool w, u8 reg, const Operand &rm, bool byte_regs) {
+  u8 b = 0;
+  bool force = byte_regs && 4 <= reg && reg <= 7;
+  if (rm.kind_ == Operand::Register) {
+    b = rm.reg_.num_ >> 3;
+    force |= rm.reg_.size_ == 1 && 4 <= rm.reg_.num_ && rm.reg_.num_ <= 7;
+  } else if (rm.kind_ == Operand::Memory && !rm.rip_) {
+    b = rm.base_ >> 3;
+  }
+
+  u8 prefix = 0x40 | (w << 3) | ((reg >> 3) << 2) | b;
+  if (prefix != 0x40 || force)
+    byte(prefix);
+}
+
+// ModRM, SIB and displacement. imm_size is the size of an immediate that
+// follows, rip relative displacements are measured from its end.
+void Assembler::modrm(u8 reg, const Operand &rm, u64 imm_size) {
+  reg = (reg & 7) << 3;
+  if (rm.kind_ == Operand::Register) {
+    byte(0xc0 | reg | (rm.reg_.num_ & 7));
+    return;
+  }
+
+  if (rm.rip_) {
+    byte(0x05 | reg);
+    u64 at = offset();
+    bytes(0, 4);
+    fixups_.push_back(Fixup{section_, at, at + 4 + imm_size, symbol(rm.sym_),
+                            RelocationKind::PC32});
+    return;
+  }
+
+  u8 base = rm.base_ & 7;
+  // rbp and r13 have no form without a displacement.
+  if (rm.disp_ == 0 && base != 5) {
+    byte(0x00 | reg | base);
+    if (base == 4)
+      byte(0x24);
+  } else if (fits_i8(rm.disp_)) {
+    byte(0x40 | reg | base);
+    if (base == 4)
+      byte(0x24);
+    bytes(rm.disp_, 1);
+  } else {
+    byte(0x80 | reg | base);
+    if (base == 4)
+      byte(0x24);
+    bytes(rm.disp_, 4);
+  }
+}
+
+void Assembler::op_rm(u64 size, std::initializer_list<u8> opcode, u8 reg,
+                      const Operand &rm, bool byte_reg, u64 imm_size) {
+  if (size == 2)
+    byte(0x66);
+  rex(size == 8, reg, rm, byte_reg);
+  for (u8 b : opcode)
+    byte(b);
+  modrm(reg, rm, imm_size);
+}
+
+void Assembler::rel32(std::string_view target, RelocationKind kind) {
+  u64 at = offset();
+  bytes(0, 4);
+  fixups_.push_back(Fixup{section_, at, at + 4, symbol(target), kind});
+}
+
+// add, or, and, sub, xor and cmp share their encodings, digit is the /digit of
+// the immediate forms and opcode the register to r/m form.
+void Assembler::alu(u8 digit, u8 opcode, const Operand &src,
+                    const Operand &dst) {
+  if (dst.kind_ != Operand::Register)
+    error("unsupported operands");
+  u64 size = dst.reg_.size_;
+
+  if (src.kind_ == Operand::Register) {
+    if (src.reg_.size_ != size)
+      error("operand size mismatch");
+    op_rm(size, {static_cast<u8>(size == 1 ? opcode - 1 : opcode)},
+          src.reg_.num_, dst, size == 1);
+    return;
+  }
+
+  if (src.kind_ != Operand::Immediate)
+    error("unsupported operands");
+  if (fits_i8(src.imm_)) {
+    op_rm(size, {0x83}, digit, dst, false, 1);
+    bytes(src.imm_, 1);
+  } else if (fits_i32(src.imm_)) {
+    op_rm(size, {0x81}, digit, dst, false, 4);
+    bytes(src.imm_, 4);
+  } else {
+    error("immediate out of range");
+  }
+}
+
+void Assembler::instruction(std::string_view mnemonic, std::string_view args) {
+  auto it = kMnemonics.find(mnemonic);
+  if (it == kMnemonics.end())
+    error("unknown instruction %.*s", (int)mnemonic.size(), mnemonic.data());
+
+  Operand ops[2];
+  u64 count = 0;
+  args = trim(args);
+  while (!args.empty()) {
+    if (count == 2)
+      error("too many operands");
+    // commas inside parentheses don't separate operands.
+    u64 depth = 0, end = 0;
+    for (; end < args.size(); ++end) {
+      if (args[end] == '(')
+        ++depth;
+      else if (args[end] == ')')
+        --depth;
+      else if (args[end] == ',' && depth == 0)
+        break;
+    }
+    ops[count++] = operand(args.substr(0, end));
+    args = end < args.size() ? args.substr(end + 1) : std::string_view();
+  }
+
+  const Operand &src = ops[0];
+  const Operand &dst = ops[1];
+  auto want = [&](u64 n) {
+    if (count != n)
+      error("expected %lu operands", n);
+  };
+
+  switch (it->second) {
+  case Op::Mov: {
+    want(2);
+    if (src.kind_ == Operand::Immediate && dst.kind_ == Operand::Register) {
+      u8 r = dst.reg_.num_;
+      if (dst.reg_.size_ == 8 && fits_i32(src.imm_)) {
+        op_rm(8, {0xc7}, 0, dst, false, 4);
+        bytes(src.imm_, 4);
+      } else if (dst.reg_.size_ == 8) {
+        byte(0x48 | (r >> 3));
+        byte(0xb8 | (r & 7));
+        bytes(src.imm_, 8);
+      } else if (dst.reg_.size_ == 4) {
+        if (r >> 3)
+          byte(0x41);
+        byte(0xb8 | (r & 7));
+        bytes(src.imm_, 4);
+      } else {
+        error("unsupported operands");
+      }
+    } else if (src.kind_ == Operand::Register &&
+               dst.kind_ != Operand::Immediate &&
+               dst.kind_ != Operand::Label) {
+      u64 size = src.reg_.size_;
+      if (dst.kind_ == Operand::Register && dst.reg_.size_ != size)
+        error("operand size mismatch");
+      op_rm(size, {static_cast<u8>(size == 1 ? 0x88 : 0x89)}, src.reg_.num_,
+            dst, size == 1);
+    } else if (src.kind_ == Operand::Memory &&
+               dst.kind_ == Operand::Register) {
+      u64 size = dst.reg_.size_;
+      op_rm(size, {static_cast<u8>(size == 1 ? 0x8a : 0x8b)}, dst.reg_.num_,
+            src, size == 1);
+    } else {
+      error("unsupported operands");
+    }
+    return;
+  }
+  case Op::Movsbl:
+  case Op::Movswl:
+  case Op::Movzx: {
+    want(2);
+    if (dst.kind_ != Operand::Register || dst.reg_.size_ < 4 ||
+        src.kind_ == Operand::Immediate || src.kind_ == Operand::Label)
+      error("unsupported operands");
+    u8 op = it->second == Op::Movsbl   ? 0xbe
+            : it->second == Op::Movswl ? 0xbf
+                                       : 0xb6;
+    op_rm(dst.reg_.size_, {0x0f, op}, dst.reg_.num_, src);
+    return;
+  }
+  case Op::Movsxd: {
+    want(2);
+    if (dst.kind_ != Operand::Register || dst.reg_.size_ != 8 ||
+        src.kind_ == Operand::Immediate || src.kind_ == Operand::Label)
+      error("unsupported operands");
+    op_rm(8, {0x63}, dst.reg_.num_, src);
+    return;
+  }
+  case Op::Lea: {
+    want(2);
+    if (src.kind_ != Operand::Memory || dst.kind_ != Operand::Register ||
+        dst.reg_.size_ != 8)
+      error("unsupported operands");
+    op_rm(8, {0x8d}, dst.reg_.num_, src);
+    return;
+  }
+  case Op::Add:
+    want(2);
+    return alu(0, 0x01, src, dst);
+  case Op::Or:
+    want(2);
+    return alu(1, 0x09, src, dst);
+  case Op::And:
+    want(2);
+    return alu(4, 0x21, src, dst);
+  case Op::Sub:
+    want(2);
+    return alu(5, 0x29, src, dst);
+  case Op::Xor:
+    want(2);
+    return alu(6, 0x31, src, dst);
+  case Op::Cmp:
+    want(2);
+    return alu(7, 0x39, src, dst);
+  case Op::Imul: {
+    want(2);
+    if (src.kind_ != Operand::Register || dst.kind_ != Operand::Register ||
+        src.reg_.size_ != dst.reg_.size_ || dst.reg_.size_ < 2)
+      error("unsupported operands");
+    op_rm(dst.reg_.size_, {0x0f, 0xaf}, dst.reg_.num_, src);
+    return;
+  }
+  case Op::Neg:
+  case Op::Idiv: {
+    want(1);
+    if (src.kind_ != Operand::Register)
+      error("unsupported operands");
+    u64 size = src.reg_.size_;
+    op_rm(size, {static_cast<u8>(size == 1 ? 0xf6 : 0xf7)},
+          it->second == Op::Neg ? 3 : 7, src);
+    return;
+  }
+  case Op::Shl:
+  case Op::Sar: {
+    want(2);
+    if (src.kind_ != Operand::Register || src.reg_.num_ != 1 ||
+        src.reg_.size_ != 1 || dst.kind_ != Operand::Register)
+      error("only shifts by %%cl are supported");
+    u64 size = dst.reg_.size_;
+    op_rm(size, {static_cast<u8>(size == 1 ? 0xd2 : 0xd3)},
+          it->second == Op::Shl ? 4 : 7, dst);
+    return;
+  }
+  case Op::Sete:
+  case Op::Setne:
+  case Op::Setl:
+  case Op::Setle: {
+    want(1);
+    if (src.kind_ != Operand::Register || src.reg_.size_ != 1)
+      error("unsupported operands");
+    u8 cc = it->second == Op::Sete    ? 0x94
+            : it->second == Op::Setne ? 0x95
+            : it->second == Op::Setl  ? 0x9c
+                                      : 0x9e;
+    op_rm(4, {0x0f, cc}, 0, src);
+    return;
+  }
+  case Op::Push:
+  case Op::Pop: {
+    want(1);
+    if (src.kind_ != Operand::Register || src.reg_.size_ != 8)
+      error("unsupported operands");
+    if (src.reg_.num_ >> 3)
+      byte(0x41);
+    byte((it->second == Op::Push ? 0x50 : 0x58) | (src.reg_.num_ & 7));
+    return;
+  }
+  case Op::Jmp:
+  case Op::Je:
+  case Op::Jne:
+  case Op::Call: {
+    want(1);
+    if (src.kind_ != Operand::Label)
+      error("expected a label");
+    if (it->second == Op::Jmp) {
+      byte(0xe9);
+    } else if (it->second == Op::Call) {
+      byte(0xe8);
+    } else {
+      byte(0x0f);
+      byte(it->second == Op::Je ? 0x84 : 0x85);
+    }
+    rel32(src.sym_, it->second == Op::Call ? RelocationKind::PLT32
+                                           : RelocationKind::PC32);
+    return;
+  }
+  case Op::Ret:
+    want(0);
+    byte(0xc3);
+    return;
+  case Op::Cqo:
+    want(0);
+    byte(0x48);
+    byte(0x99);
+    return;
+  case Op::Cdq:
+    want(0);
+    byte(0x99);
+    return;
+  }
+}
+
+void Assembler::directive(std::string_view name, std::string_view args) {
+  args = trim(args);
+  if (name == ".file") {
+    return;
+  }
+  if (name == ".text") {
+    section_ = SectionId::Text;
+  } else if (name == ".data") {
+    section_ = SectionId::Data;
+  } else if (name == ".bss") {
+    section_ = SectionId::Bss;
+  } else if (name == ".section") {
+    std::string_view sec = args.substr(0, args.find(','));
+    if (sec == ".rodata")
+      section_ = SectionId::Rodata;
+    else if (sec == ".text" || sec == ".data" || sec == ".bss")
+      directive(sec, "");
+    else
+      error("unknown section %.*s", (int)sec.size(), sec.data());
+  } else if (name == ".globl") {
+    obj_.symbols_[symbol(args)].global_ = true;
+  } else if (name == ".zero") {
+    i64 n = number(args);
+    if (section_ == SectionId::Bss)
+      section().size_ += n;
+    else
+      bytes(0, n);
+  } else if (name == ".byte") {
+    if (section_ == SectionId::Bss)
+      error(".byte in .bss");
+    bytes(number(args), 1);
+  } else {
+    error("unknown directive %.*s", (int)name.size(), name.data());
+  }
+}
+
+void Assembler::line(std::string_view s) {
+  for (;;) {
+    s = trim(s);
+    if (s.empty())
+      return;
+
+    u64 end = 0;
+    while (end < s.size() && s[end] != ' ' && s[end] != '\t' && s[end] != ':')
+      ++end;
+
+    // a label, a statement may follow it on the same line.
+    if (end < s.size() && s[end] == ':') {
+      define(s.substr(0, end));
+      s.remove_prefix(end + 1);
+      continue;
+    }
+
+    std::string_view word = s.substr(0, end);
+    std::string_view rest = s.substr(end);
+    if (word[0] == '.')
+      directive(word, rest);
+    else
+      instruction(word, rest);
+    return;
+  }
+}
+
+// patches branches to labels of the same section, everything else becomes a
+// relocation.
+void Assembler::resolve() {
+  for (const Fixup &fix : fixups_) {
+    const Symbol &sym = obj_.symbols_[fix.symbol_];
+    Section &sec = obj_.sections_[static_cast<u64>(fix.section_)];
+    if (!sym.global_ && sym.section_ == fix.section_) {
+      i64 rel = sym.value_ - fix.next_;
+      for (u64 i = 0; i < 4; ++i)
+        sec.bytes_[fix.offset_ + i] = static_cast<u8>(rel >> (8 * i));
+      continue;
+    }
+
+    i64 addend = static_cast<i64>(fix.offset_) - static_cast<i64>(fix.next_);
+    obj_.relocations_.push_back(
+        Relocation{fix.section_, fix.offset_, fix.symbol_, fix.kind_, addend});
+  }
+}
+
+Object Assembler::run() {
+  while (!text_.empty()) {
+    ++line_number_;
+    u64 end = text_.find('\n');
+    if (end == std::string_view::npos)
+      end = text_.size();
+    line(text_.substr(0, end));
+    text_.remove_prefix(end < text_.size() ? end + 1 : end);
+  }
+
+  resolve();
+  return std::move(obj_);
+}
+
+Object assemble(std::string_view text) { return Assembler(text).run(); }
+
+const char *section_name(SectionId id) {
+  switch (id) {
+  case SectionId::Text:
+    return ".text";
+  case SectionId::Data:
+    return ".data";
+  case SectionId::Rodata:
+    return ".rodata";
+  case SectionId::Bss:
+    return ".bss";
+  default:
+    return "";
+  }
+}
+
+} // namespace assembler
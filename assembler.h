@@ -0,0 +1,67 @@
+#ifndef _ASMLAI_ASSEMBLER_H
+#define _ASMLAI_ASSEMBLER_H
+
+#include "types.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Integrated assembler for the AT&T text codegen produces. It knows exactly
+// the instructions, operand forms and directives codegen uses, encodes them
+// into sections and leaves references it can't resolve itself as
+// relocations. The result is turned into an ELF object or loaded in process.
+namespace assembler {
+
+enum class SectionId : u8 {
+  Text,
+  Data,
+  Rodata,
+  Bss,
+  Undefined,
+};
+
+constexpr u64 kSectionCount = static_cast<u64>(SectionId::Undefined);
+
+struct Section {
+  // empty for .bss, only its size counts.
+  std::vector<u8> bytes_;
+  u64 size_ = 0;
+  u64 align_ = 1;
+};
+
+struct Symbol {
+  std::string name_;
+  SectionId section_ = SectionId::Undefined;
+  u64 value_ = 0;
+  bool global_ = false;
+};
+
+enum class RelocationKind : u8 {
+  // 32-bit pc relative data reference, R_X86_64_PC32.
+  PC32,
+  // 32-bit pc relative call, R_X86_64_PLT32.
+  PLT32,
+};
+
+struct Relocation {
+  SectionId section_;
+  u64 offset_;
+  u32 symbol_;
+  RelocationKind kind_;
+  i64 addend_;
+};
+
+struct Object {
+  Section sections_[kSectionCount];
+  std::vector<Symbol> symbols_;
+  std::vector<Relocation> relocations_;
+};
+
+// assembles text, exits with a diagnostic on anything it doesn't understand.
+Object assemble(std::string_view text);
+
+const char *section_name(SectionId id);
+
+} // namespace assembler
+
+#endif
@@ -0,0 +1,321 @@
+// gen writes large C inputs for measuring compiler throughput. The output only
+// depends on the arguments, so the same input can be made again on another
+// commit or machine and timings stay comparable.
+//
+//   gen <kind> [scale] [seed]
+//
+// kind is one of functions, expressions, structs, constants, strings, scopes
+// or mixed, which has all of them. scale multiplies the size, 1 gives some
+// tens of thousands of lines per kind.
+#include "../types.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace {
+
+// xorshift64, the standard library's distributions differ between
+// implementations.
+class Random {
+public:
+  explicit Random(u64 seed) : state_(seed ? seed : 1) {}
+
+  u64 next() {
+    state_ ^= state_ << 13;
+    state_ ^= state_ >> 7;
+    state_ ^= state_ << 17;
+    return state_;
+  }
+
+  // in [0, n).
+  u64 below(u64 n) { return next() % n; }
+
+private:
+  u64 state_;
+};
+
+class Generator {
+public:
+  Generator(u64 scale, u64 seed) : scale_(scale), rand_(seed) {}
+
+  void functions();
+  void expressions();
+  void structs();
+  void constants();
+  void strings();
+  void scopes();
+  void main_function();
+
+private:
+  template <typename... Args> void line(const char *fmt, Args... args) {
+    std::printf(fmt, args...);
+    std::putchar('\n');
+  }
+
+  std::string leaf(const char *const *names, u64 count);
+  std::string chain(u64 depth, const char *const *names, u64 count);
+  std::string balanced(u64 depth, const char *const *names, u64 count);
+  const char *op();
+
+  u64 scale_;
+  Random rand_;
+  // how many of each were written, main calls the last ones.
+  u64 functions_ = 0;
+  u64 expressions_ = 0;
+  u64 structs_ = 0;
+  u64 constants_ = 0;
+  u64 strings_ = 0;
+  u64 scopes_ = 0;
+};
+
+const char *Generator::op() {
+  static const char *const ops[] = {"+", "-", "*", "+", "-", "<",
+                                    "==", "!=", ">=", "&&", "||"};
+  return ops[rand_.below(sizeof(ops) / sizeof(ops[0]))];
+}
+
+std::string Generator::leaf(const char *const *names, u64 count) {
+  if (rand_.below(3) == 0)
+    return std::to_string(1 + rand_.below(1000));
+  return names[rand_.below(count)];
+}
+
+// nests to the left depth times, like a long sum.
+std::string Generator::chain(u64 depth, const char *const *names, u64 count) {
+  std::string expr = leaf(names, count);
+  for (u64 i = 0; i < depth; ++i) {
+    if (rand_.below(8) == 0)
+      expr = "-" + expr;
+    expr = "(" + expr + " " + op() + " " + leaf(names, count) + ")";
+  }
+  return expr;
+}
+
+std::string Generator::balanced(u64 depth, const char *const *names,
+                                u64 count) {
+  if (depth == 0)
+    return leaf(names, count);
+  std::string lhs = balanced(depth - 1, names, count);
+  std::string rhs = balanced(depth - 1, names, count);
+  return "(" + lhs + " " + op() + " " + rhs + ")";
+}
+
+// many small functions, each calling the one before.
+void Generator::functions() {
+  u64 count = 2000 * scale_;
+  for (u64 i = 0; i < count; ++i) {
+    line("int fn_%lu(int a, int b, int c) {", i);
+    line("  int x;");
+    line("  int y;");
+    line("  x = a * %lu + b;", 1 + rand_.below(100));
+    line("  y = c - %lu;", rand_.below(100));
+    line("  if (x > y) {");
+    line("    x = x - y;");
+    line("  } else {");
+    line("    y = y + x / %lu;", 1 + rand_.below(9));
+    line("  }");
+    line("  while (x > %lu) {", 100 + rand_.below(1000));
+    line("    x = x / 2;");
+    line("  }");
+    if (i > 0)
+      line("  return fn_%lu(x, y, a) + %lu;", rand_.below(i), rand_.below(10));
+    else
+      line("  return x + y;");
+    line("}");
+    line("");
+  }
+  functions_ = count;
+}
+
+// long and deep expressions over a function's parameters.
+void Generator::expressions() {
+  static const char *const names[] = {"a", "b", "c", "d", "e", "f"};
+  u64 count = 300 * scale_;
+  for (u64 i = 0; i < count; ++i) {
+    line("int expr_%lu(int a, int b, int c, int d, int e, int f) {", i);
+    line("  int r;");
+    line("  r = %s;", chain(40 + rand_.below(60), names, 6).c_str());
+    line("  r = r + %s;", balanced(6, names, 6).c_str());
+    line("  return r;");
+    line("}");
+    line("");
+  }
+  expressions_ = count;
+}
+
+// struct types nesting the ones before them, and functions reaching through
+// their members.
+void Generator::structs() {
+  u64 count = 1000 * scale_;
+  for (u64 i = 0; i < count; ++i) {
+    line("struct st_%lu {", i);
+    line("  int id;");
+    line("  char tag[%lu];", 1 + rand_.below(16));
+    line("  long wide;");
+    if (i > 0)
+      line("  struct st_%lu inner;", rand_.below(i));
+    line("  int values[%lu];", 1 + rand_.below(8));
+    line("};");
+    line("");
+    line("int struct_fn_%lu(int n) {", i);
+    line("  struct st_%lu s;", i);
+    line("  struct st_%lu *p;", i);
+    line("  p = &s;");
+    line("  s.id = n;");
+    line("  s.wide = n * %lu;", 1 + rand_.below(50));
+    line("  s.values[0] = (*p).id + %lu;", rand_.below(10));
+    if (i > 0)
+      line("  s.inner.id = s.values[0];");
+    line("  return (*p).id + s.values[0] + sizeof(s);");
+    line("}");
+    line("");
+  }
+  structs_ = count;
+}
+
+// named constants and the macros computing with them. These stand in for
+// enums, which the parser doesn't take yet.
+void Generator::constants() {
+  u64 count = 4000 * scale_;
+  for (u64 i = 0; i < count; ++i)
+    line("#define CONST_%lu %lu", i, rand_.below(1u << 20));
+  line("#define MIX(x, y) (((x) * 31) + (y))");
+  line("");
+  u64 functions = count / 16;
+  for (u64 i = 0; i < functions; ++i) {
+    line("int const_fn_%lu(int n) {", i);
+    line("  int r;");
+    line("  r = n;");
+    for (u64 j = 0; j < 8; ++j) {
+      line("  r = MIX(r, CONST_%lu) - CONST_%lu;", rand_.below(count),
+           rand_.below(count));
+    }
+    line("  return r;");
+    line("}");
+    line("");
+  }
+  constants_ = functions;
+}
+
+// long string literals with escapes mixed in.
+void Generator::strings() {
+  static const char *const pieces[] = {
+      "lorem ", "ipsum ", "dolor ", "sit ", "amet ", "\\n", "\\t", "\\\"",
+      "\\\\",   "0123456789 ",       "consectetur ", "adipiscing "};
+  u64 count = 500 * scale_;
+  for (u64 i = 0; i < count; ++i) {
+    line("char *str_%lu() {", i);
+    line("  char *s;");
+    for (u64 j = 0; j < 4; ++j) {
+      std::string text;
+      u64 length = 200 + rand_.below(1800);
+      while (text.size() < length)
+        text += pieces[rand_.below(sizeof(pieces) / sizeof(pieces[0]))];
+      line("  s = \"%s\";", text.c_str());
+    }
+    line("  return s;");
+    line("}");
+    line("");
+  }
+  strings_ = count;
+}
+
+// functions with many locals and nested blocks that shadow them, so lookups
+// go through long scope chains.
+void Generator::scopes() {
+  u64 count = 100 * scale_;
+  const u64 locals = 150;
+  for (u64 i = 0; i < count; ++i) {
+    line("int scope_fn_%lu(int n) {", i);
+    for (u64 j = 0; j < locals; ++j)
+      line("  int v_%lu = n + %lu;", j, j);
+    std::string indent = "  ";
+    u64 depth = 8 + rand_.below(8);
+    for (u64 d = 0; d < depth; ++d) {
+      line("%s{", indent.c_str());
+      indent += "  ";
+      for (u64 j = 0; j < 4; ++j) {
+        u64 v = rand_.below(locals);
+        line("%sint v_%lu = v_%lu + v_%lu;", indent.c_str(), v, v,
+             rand_.below(locals));
+      }
+      line("%sn = n + v_%lu;", indent.c_str(), rand_.below(locals));
+    }
+    for (u64 d = 0; d < depth; ++d) {
+      indent.resize(indent.size() - 2);
+      line("%s}", indent.c_str());
+    }
+    line("  return n + v_%lu;", rand_.below(locals));
+    line("}");
+    line("");
+  }
+  scopes_ = count;
+}
+
+void Generator::main_function() {
+  line("int main() {");
+  line("  int r;");
+  line("  char *s;");
+  line("  r = 0;");
+  if (functions_)
+    line("  r = r + fn_%lu(1, 2, 3);", functions_ - 1);
+  if (expressions_)
+    line("  r = r + expr_%lu(1, 2, 3, 4, 5, 6);", expressions_ - 1);
+  if (structs_)
+    line("  r = r + struct_fn_%lu(7);", structs_ - 1);
+  if (constants_)
+    line("  r = r + const_fn_%lu(7);", constants_ - 1);
+  if (strings_) {
+    line("  s = str_%lu();", strings_ - 1);
+    line("  r = r + s[0];");
+  }
+  if (scopes_)
+    line("  r = r + scope_fn_%lu(7);", scopes_ - 1);
+  line("  return r != 0;");
+  line("}");
+}
+
+void usage() {
+  std::fprintf(stderr, "gen <functions | expressions | structs | constants | "
+                       "strings | scopes | mixed> [scale] [seed]\n");
+  std::exit(1);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  static const char *const kinds[] = {"functions", "expressions", "structs",
+                                      "constants", "strings",     "scopes",
+                                      "mixed"};
+  if (argc < 2 || argc > 4)
+    usage();
+  const char *kind = argv[1];
+  bool known = false;
+  for (const char *name : kinds)
+    known = known || !std::strcmp(kind, name);
+  u64 scale = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1;
+  u64 seed = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 1;
+  if (!known || scale == 0)
+    usage();
+
+  // mixed writes every kind, one after the other.
+  Generator gen(scale, seed);
+  auto want = [&](const char *name) {
+    return !std::strcmp(kind, "mixed") || !std::strcmp(kind, name);
+  };
+  if (want("constants"))
+    gen.constants();
+  if (want("structs"))
+    gen.structs();
+  if (want("functions"))
+    gen.functions();
+  if (want("expressions"))
+    gen.expressions();
+  if (want("strings"))
+    gen.strings();
+  if (want("scopes"))
+    gen.scopes();
+  gen.main_function();
+  return 0;
+}
@@ -0,0 +1,348 @@
+// micro times single parts of the compiler by calling them directly, away from
+// file IO and the phases around them.
+//
+//   micro [ --filter <text> ] [ --warmup <runs> ] [ --samples <runs> ]
+//         [ --json ]
+//
+// Every benchmark prepares a run, which isn't timed, and times the run. A few
+// warmup runs go first, then every timed run is a sample, and the samples are
+// summed up as percentiles. --json prints them as one JSON object.
+#include "arena.h"
+#include "codegen.h"
+#include "intern.h"
+#include "output.h"
+#include "parser.h"
+#include "preprocess.h"
+#include "token.h"
+#include "typesystem.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// the same definitions main.cc makes for the compiler.
+parser::Type *parser::default_int = typesystem::int_type();
+parser::Type *parser::default_empty = typesystem::empty_type();
+parser::Type *parser::default_void = typesystem::void_type();
+parser::Type *parser::default_long = typesystem::long_type();
+thread_local parser::Scope *parser::scopes = nullptr;
+
+namespace {
+
+// what a run works in: a fresh arena and type table, released afterwards
+// like at the end of a compilation.
+struct Compilation {
+  Compilation() { arena::current = &arena_; }
+  ~Compilation() {
+    typesystem::reset_types();
+    arena::current = nullptr;
+  }
+  Compilation(const Compilation &) = delete;
+  Compilation &operator=(const Compilation &) = delete;
+
+  arena::Arena arena_;
+};
+
+using Run = std::function<void()>;
+
+struct Benchmark {
+  const char *name_;
+  // what one run does, results are also given per item.
+  const char *item_;
+  u64 items_;
+  // sets up a run and hands it back, only the run itself is timed.
+  std::function<Run()> prepare_;
+};
+
+struct Result {
+  const char *name_;
+  const char *item_;
+  u64 items_;
+  // nanoseconds per run, sorted.
+  std::vector<double> samples_;
+
+  double percentile(double p) const {
+    u64 i = static_cast<u64>(p / 100 * (samples_.size() - 1) + 0.5);
+    return samples_[i];
+  }
+  double mean() const {
+    double sum = 0;
+    for (double sample : samples_)
+      sum += sample;
+    return sum / samples_.size();
+  }
+};
+
+// C source with that many functions of loops, calls, expressions and strings.
+std::string program(u64 functions) {
+  std::string text = "#define SCALE(x) ((x) * 3 + 1)\nint printf();\n";
+  for (u64 i = 0; i < functions; ++i) {
+    std::string n = std::to_string(i);
+    text += "int fn_" + n + "(int a, int b) {\n";
+    text += "  int x;\n  int i;\n  char *s;\n";
+    text += "  x = a * " + n + " + SCALE(b) - (a + b) * (a - b) / 7;\n";
+    text += "  for (i = 0; i < 10; i = i + 1) {\n";
+    text += "    if (x > i && x != 3) x = x - i; else x = x + a % 5;\n";
+    text += "  }\n";
+    text += "  s = \"function number " + n + " says hello\\n\";\n";
+    if (i > 0)
+      text += "  x = x + fn_" + std::to_string(i - 1) + "(x, s[0]);\n";
+    text += "  return x;\n}\n\n";
+  }
+  return text;
+}
+
+// pulls every token of source through the preprocessor into the token ring.
+u64 tokenize_all(std::string &source) {
+  static char name[] = "micro.c";
+  preprocess::Options options;
+  auto tokens = token::tokenize_input(name, source.data(), options);
+  u64 pos = 0;
+  while (tokens[pos].kind_ != token::TokenKind::Eof) {
+    tokens.discard_before(pos);
+    ++pos;
+  }
+  return pos;
+}
+
+Benchmark tokenize_benchmark() {
+  auto source = std::make_shared<std::string>(program(2000));
+  // known up front so the count can be given per token.
+  Compilation count_tokens;
+  u64 tokens = tokenize_all(*source);
+  return {"tokenize_input", "token", tokens, [source] {
+            auto state = std::make_shared<Compilation>();
+            return [source, state] { tokenize_all(*source); };
+          }};
+}
+
+// kDepth nested scopes, each binding every name again plus one of its own,
+// and lookups of all the names many times over.
+struct Scopes {
+  static constexpr u64 kDepth = 1000;
+  static constexpr u64 kNames = 64;
+
+  Scopes() {
+    for (u64 i = 0; i < kNames; ++i) {
+      std::string name = "name_" + std::to_string(i);
+      token::Token tok{token::TokenKind::Identifier};
+      tok.sym_ = intern::intern(name.data(), name.size());
+      tokens_.push_back(tok);
+    }
+    parser::scopes = arena::make<parser::Scope>();
+    for (u64 d = 0; d < kDepth; ++d) {
+      parser::enter_scope();
+      for (const auto &tok : tokens_)
+        parser::push_scope(tok.sym_, nullptr);
+      std::string own = "own_" + std::to_string(d);
+      parser::push_scope(intern::intern(own.data(), own.size()), nullptr);
+    }
+  }
+  // the bindings are left before the arena they are in goes.
+  ~Scopes() {
+    for (u64 d = 0; d < kDepth; ++d)
+      parser::leave_scope();
+  }
+
+  Compilation compilation_;
+  std::vector<token::Token> tokens_;
+};
+
+Benchmark find_var_benchmark() {
+  constexpr u64 kLookups = 1000000;
+  return {"find_var", "lookup", kLookups, [] {
+            auto state = std::make_shared<Scopes>();
+            return [state] {
+              u64 found = 0;
+              for (u64 i = 0; i < kLookups; ++i) {
+                const auto &tok = state->tokens_[i % Scopes::kNames];
+                found += parser::find_var(tok) != nullptr;
+              }
+              if (found != kLookups)
+                std::abort();
+            };
+          }};
+}
+
+parser::Node *number(i64 value) {
+  auto node = arena::make<parser::Node>();
+  node->type_ = parser::NodeType::Num;
+  node->data_ = value;
+  return node;
+}
+
+parser::Node *binary(parser::NodeType type, parser::Node *lhs,
+                     parser::Node *rhs) {
+  auto node = arena::make<parser::Node>();
+  node->type_ = type;
+  node->lhs_ = lhs;
+  node->rhs_ = rhs;
+  return node;
+}
+
+// a balanced tree of depth levels, arithmetic inside and comparisons at the
+// bottom.
+parser::Node *tree(u64 depth, u64 &leaves) {
+  static const parser::NodeType types[] = {
+      parser::NodeType::Add, parser::NodeType::Mul, parser::NodeType::Sub,
+      parser::NodeType::Div};
+  if (depth == 0)
+    return number(++leaves);
+  if (depth == 1) {
+    parser::Node *lhs = number(++leaves);
+    return binary(parser::NodeType::LT, lhs, number(++leaves));
+  }
+  parser::Node *lhs = tree(depth - 1, leaves);
+  parser::Node *rhs = tree(depth - 1, leaves);
+  return binary(types[depth % 4], lhs, rhs);
+}
+
+Benchmark add_type_benchmark() {
+  constexpr u64 kDepth = 16;
+  // 2^depth leaves and one fewer inner nodes.
+  constexpr u64 kNodes = (2ul << kDepth) - 1;
+  return {"add_type", "node", kNodes, [] {
+            auto state = std::make_shared<Compilation>();
+            u64 leaves = 0;
+            parser::Node *root = tree(kDepth, leaves);
+            return [state, root] { typesystem::add_type(*root); };
+          }};
+}
+
+// a parsed program with its stack frames laid out, ready for gen_code.
+// Members go in reverse, the arena last.
+struct Parsed {
+  explicit Parsed(std::string &source) {
+    static char name[] = "micro.c";
+    preprocess::Options options;
+    // the stream can't be moved, it's made in place.
+    tokens_.reset(new token::TokenStream(
+        token::tokenize_input(name, source.data(), options)));
+    parser::scopes = arena::make<parser::Scope>();
+    functions_ = parser::parse_tokens(*tokens_);
+    codegen::assign_lvar_offsets(functions_);
+  }
+
+  Compilation compilation_;
+  std::unique_ptr<token::TokenStream> tokens_;
+  parser::ObjectList functions_;
+};
+
+Benchmark gen_code_benchmark() {
+  constexpr u64 kFunctions = 2000;
+  auto source = std::make_shared<std::string>(program(kFunctions));
+  return {"gen_code", "function", kFunctions, [source] {
+            auto state = std::make_shared<Parsed>(*source);
+            return [state] {
+              // the output goes nowhere, only generating it is timed.
+              int fd = open("/dev/null", O_WRONLY);
+              {
+                output::Writer out(fd);
+                codegen::gen_code(std::move(state->functions_), out,
+                                  std::thread::hardware_concurrency());
+              }
+              close(fd);
+            };
+          }};
+}
+
+Result measure(const Benchmark &bench, u64 warmup, u64 samples) {
+  for (u64 i = 0; i < warmup; ++i)
+    bench.prepare_()();
+
+  Result result{bench.name_, bench.item_, bench.items_, {}};
+  for (u64 i = 0; i < samples; ++i) {
+    Run run = bench.prepare_();
+    auto start = std::chrono::steady_clock::now();
+    run();
+    std::chrono::duration<double, std::nano> took =
+        std::chrono::steady_clock::now() - start;
+    result.samples_.push_back(took.count());
+    // the run's state goes with it, outside the timing.
+    run = nullptr;
+  }
+  std::sort(result.samples_.begin(), result.samples_.end());
+  return result;
+}
+
+void print_table(const std::vector<Result> &results) {
+  std::printf("%-16s %12s %12s %12s %12s %12s %14s\n", "benchmark", "min ms",
+              "p50 ms", "p90 ms", "p99 ms", "mean ms", "ns per item");
+  for (const auto &result : results) {
+    std::printf("%-16s %12.3f %12.3f %12.3f %12.3f %12.3f %8.2f/%s\n",
+                result.name_, result.samples_.front() / 1e6,
+                result.percentile(50) / 1e6, result.percentile(90) / 1e6,
+                result.percentile(99) / 1e6, result.mean() / 1e6,
+                result.percentile(50) / result.items_, result.item_);
+  }
+}
+
+void print_json(const std::vector<Result> &results) {
+  std::printf("{\"benchmarks\":[");
+  for (u64 i = 0; i < results.size(); ++i) {
+    const Result &result = results[i];
+    std::printf("%s{\"name\":\"%s\",\"item\":\"%s\",\"items\":%lu,"
+                "\"samples\":%lu,\"min_ns\":%.0f,\"p50_ns\":%.0f,"
+                "\"p90_ns\":%.0f,\"p99_ns\":%.0f,\"max_ns\":%.0f,"
+                "\"mean_ns\":%.0f}",
+                i > 0 ? "," : "", result.name_, result.item_, result.items_,
+                result.samples_.size(), result.samples_.front(),
+                result.percentile(50), result.percentile(90),
+                result.percentile(99), result.samples_.back(),
+                result.mean());
+  }
+  std::printf("]}\n");
+}
+
+[[noreturn]] void usage() {
+  std::fprintf(stderr, "micro [ --filter <text> ] [ --warmup <runs> ] "
+                       "[ --samples <runs> ] [ --json ]\n");
+  std::exit(1);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const char *filter = "";
+  u64 warmup = 3;
+  u64 samples = 20;
+  bool json = false;
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--json")) {
+      json = true;
+    } else if (!std::strcmp(argv[i], "--filter") && argv[i + 1]) {
+      filter = argv[++i];
+    } else if (!std::strcmp(argv[i], "--warmup") && argv[i + 1]) {
+      warmup = std::strtoull(argv[++i], nullptr, 10);
+    } else if (!std::strcmp(argv[i], "--samples") && argv[i + 1]) {
+      samples = std::strtoull(argv[++i], nullptr, 10);
+    } else {
+      usage();
+    }
+  }
+  if (samples == 0)
+    usage();
+
+  std::vector<Benchmark> benchmarks = {
+      tokenize_benchmark(), find_var_benchmark(), add_type_benchmark(),
+      gen_code_benchmark()};
+  std::vector<Result> results;
+  for (const auto &bench : benchmarks) {
+    if (std::strstr(bench.name_, filter))
+      results.push_back(measure(bench, warmup, samples));
+  }
+
+  if (json)
+    print_json(results);
+  else
+    print_table(results);
+  return 0;
+}
@@ -0,0 +1,94 @@
+#!/bin/bash
+# Measures how fast asmlai compiles large generated inputs. Every kind bench/gen
+# knows is compiled a few times and the fastest run is kept, which is the most
+# repeatable. The results can be saved and later compared against, e.g. on
+# another commit:
+#
+#   bench/run.sh -o base.txt
+#   (change things, make asmlai)
+#   bench/run.sh -c base.txt
+#
+# Options: -s scale of the inputs, -n runs per input, -o file to save the
+# results to, -c saved results to compare with.
+cd "$(dirname "$0")/.."
+
+scale=4
+runs=5
+save=
+compare=
+while getopts s:n:o:c: opt; do
+    case $opt in
+        s) scale=$OPTARG ;;
+        n) runs=$OPTARG ;;
+        o) save=$OPTARG ;;
+        c) compare=$OPTARG ;;
+        *) exit 1 ;;
+    esac
+done
+
+make -s asmlai bench/gen || exit 1
+
+tmp=`mktemp -d /tmp/asmlai-bench-XXXXXX`
+trap 'rm -rf $tmp' INT TERM HUP EXIT
+
+kinds="functions expressions structs constants strings scopes mixed"
+results=$tmp/results
+echo "kind lines tokens wall_ms tokens/s lines/s peak_rss_kb" \
+     "load_ms parse_ms offsets_ms codegen_ms" > $results
+
+# the value of "key":... in a report, the first one when there are several.
+field() {
+    grep -o "\"$2\":[0-9.]*" <<< "$1" | head -1 | cut -d: -f2
+}
+
+# wall time of a phase in a report.
+phase() {
+    grep -o "\"name\":\"$2\",\"wall_ms\":[0-9.]*" <<< "$1" | cut -d: -f3
+}
+
+for kind in $kinds; do
+    bench/gen $kind $scale > $tmp/$kind.c
+    lines=$(wc -l < $tmp/$kind.c)
+    best=
+    for i in $(seq $runs); do
+        report=$(./asmlai -fmem-report -ftime-report=json -o /dev/null \
+                 $tmp/$kind.c 2>&1) || { echo "$kind: $report"; exit 1; }
+        json=$(grep '^{' <<< "$report")
+        total=$(grep -o '"total":{[^}]*}' <<< "$json")
+        wall=$(field "$total" wall_ms)
+        if [ -z "$best" ] || awk "BEGIN { exit !($wall < $best_wall) }"; then
+            best=$report
+            best_wall=$wall
+        fi
+    done
+
+    json=$(grep '^{' <<< "$best")
+    tokens=$(sed -n 's/^tokens: \([0-9]*\),.*/\1/p' <<< "$best")
+    rss=$(field "$json" peak_rss_kb)
+    awk -v kind=$kind -v lines=$lines -v tokens=$tokens -v wall=$best_wall \
+        -v rss=$rss -v load=$(phase "$json" load) \
+        -v parse=$(phase "$json" parse) -v offsets=$(phase "$json" offsets) \
+        -v codegen=$(phase "$json" codegen) 'BEGIN {
+        printf "%s %d %d %.3f %.0f %.0f %d %.3f %.3f %.3f %.3f\n", kind, lines,
+               tokens, wall, tokens / wall * 1000, lines / wall * 1000, rss,
+               load, parse, offsets, codegen
+    }' >> $results
+done
+
+awk '{ printf "%-12s", $1; for (i = 2; i <= NF; ++i) printf " %11s", $i
+       print "" }' $results
+[ -n "$save" ] && cp $results "$save"
+
+if [ -n "$compare" ]; then
+    echo
+    echo "against $compare:"
+    # joined on the kind, a negative change is faster.
+    awk 'NR == FNR { if (FNR > 1) base[$1] = $0; next }
+         FNR > 1 && $1 in base {
+             split(base[$1], b)
+             printf "%-12s wall %9.3f -> %9.3f ms %+7.1f%%   " \
+                    "rss %8d -> %8d KB %+7.1f%%\n", $1, b[4], $4,
+                    ($4 - b[4]) / b[4] * 100, b[7], $7,
+                    ($7 - b[7]) / b[7] * 100
+         }' "$compare" $results
+fi
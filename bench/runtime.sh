@@ -0,0 +1,112 @@
+#!/bin/bash
+# Measures how fast the code asmlai generates runs. Every program in
+# bench/runtime is compiled with asmlai and with gcc -O0, both are run a few
+# times and the fastest run of each is kept. Their output has to agree.
+# Instructions and cycles are counted with perf when it's installed.
+#
+#   bench/runtime.sh -o base.txt
+#   (change codegen, make asmlai)
+#   bench/runtime.sh -c base.txt
+#
+# Options: -n runs per program, -o file to save the results to, -c saved
+# results to compare with.
+cd "$(dirname "$0")/.."
+
+runs=3
+save=
+compare=
+while getopts n:o:c: opt; do
+    case $opt in
+        n) runs=$OPTARG ;;
+        o) save=$OPTARG ;;
+        c) compare=$OPTARG ;;
+        *) exit 1 ;;
+    esac
+done
+
+make -s asmlai || exit 1
+
+tmp=`mktemp -d /tmp/asmlai-runtime-XXXXXX`
+trap 'rm -rf $tmp' INT TERM HUP EXIT
+
+perf=
+if command -v perf > /dev/null &&
+        perf stat -e instructions true > /dev/null 2>&1; then
+    perf=perf
+fi
+
+results=$tmp/results
+echo "program asmlai_ms gcc_ms ratio asmlai_insns gcc_insns" \
+     "asmlai_cycles gcc_cycles" > $results
+
+# the fastest of $runs runs of a program, in milliseconds.
+wall() {
+    local best=
+    for i in $(seq $runs); do
+        local start=$EPOCHREALTIME
+        $1 > /dev/null
+        local ms=$(awk -v start=$start -v end=$EPOCHREALTIME \
+                   'BEGIN { printf "%.3f", (end - start) * 1000 }')
+        if [ -z "$best" ] || awk "BEGIN { exit !($ms < $best) }"; then
+            best=$ms
+        fi
+    done
+    echo $best
+}
+
+# instructions and cycles of one run of a program, "- -" without perf.
+counters() {
+    if [ -z "$perf" ]; then
+        echo "- -"
+        return
+    fi
+    perf stat -x, -e instructions,cycles -o $tmp/perf $1 > /dev/null
+    # counters the machine lacks read "<not supported>".
+    awk -F, 'BEGIN { insns = cycles = "-" }
+             $1 !~ /^[0-9]+$/ { next }
+             $3 ~ /^instructions/ { insns = $1 }
+             $3 ~ /^cycles/ { cycles = $1 }
+             END { print insns, cycles }' $tmp/perf
+}
+
+for program in bench/runtime/*.c; do
+    name=$(basename $program .c)
+    ./asmlai -o $tmp/$name.s $program || exit 1
+    # asmlai emits no .note.GNU-stack, the stack needn't be executable.
+    cc -Wl,-z,noexecstack -o $tmp/$name.asmlai $tmp/$name.s || exit 1
+    gcc -O0 -w -std=gnu11 -o $tmp/$name.gcc $program || exit 1
+
+    if [ "$($tmp/$name.asmlai)" != "$($tmp/$name.gcc)" ]; then
+        echo "$name: asmlai and gcc disagree"
+        exit 1
+    fi
+
+    ours=$(wall $tmp/$name.asmlai)
+    theirs=$(wall $tmp/$name.gcc)
+    read ours_insns ours_cycles <<< "$(counters $tmp/$name.asmlai)"
+    read their_insns their_cycles <<< "$(counters $tmp/$name.gcc)"
+    awk -v name=$name -v ours=$ours -v theirs=$theirs 'BEGIN {
+        printf "%s %.3f %.3f %.2f ", name, ours, theirs, ours / theirs
+    }' >> $results
+    echo $ours_insns $their_insns $ours_cycles $their_cycles >> $results
+done
+
+awk '{ printf "%-10s", $1; for (i = 2; i <= NF; ++i) printf " %13s", $i
+       print "" }' $results
+[ -z "$perf" ] && echo "(perf isn't available, no instruction or cycle counts)"
+[ -n "$save" ] && cp $results "$save"
+
+if [ -n "$compare" ]; then
+    echo
+    echo "against $compare:"
+    # joined on the program, a negative change is faster.
+    awk 'NR == FNR { if (FNR > 1) base[$1] = $0; next }
+         FNR > 1 && $1 in base {
+             split(base[$1], b)
+             printf "%-10s wall %10.3f -> %10.3f ms %+7.1f%%", $1, b[2], $2,
+                    ($2 - b[2]) / b[2] * 100
+             if (b[5] != "-" && $5 != "-")
+                 printf "   instructions %+7.1f%%", ($5 - b[5]) / b[5] * 100
+             print ""
+         }' "$compare" $results
+fi
@@ -0,0 +1,46 @@
+// bit tricks: population counts, parity and Gray codes from and, or and
+// xor, over a run of pseudo random words.
+int printf();
+
+int popcount(long x) {
+  int n;
+  n = 0;
+  while (x) {
+    x = x & (x - 1);
+    n = n + 1;
+  }
+  return n;
+}
+
+int parity(long x) {
+  int p;
+  p = 0;
+  while (x) {
+    p = p ^ (x & 1);
+    x = x / 2;
+  }
+  return p;
+}
+
+long gray(long x) { return x ^ (x / 2); }
+
+int main() {
+  long x;
+  long i;
+  long ones;
+  long odd;
+  long mixed;
+
+  x = 12345;
+  ones = 0;
+  odd = 0;
+  mixed = 0;
+  for (i = 0; i < 2000000; i = i + 1) {
+    x = (x * 1103515245 + 12345) % 2147483648;
+    ones = ones + popcount(x);
+    odd = odd + parity(gray(x));
+    mixed = (mixed ^ (x | i)) & 1073741823;
+  }
+  printf("%ld %ld %ld\n", ones, odd, mixed);
+  return 0;
+}
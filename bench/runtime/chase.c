@@ -0,0 +1,44 @@
+// pointer chasing: slots point at each other in one big random cycle, so
+// every load depends on the one before and caches don't help much.
+int printf();
+
+void *slots[1000000];
+int order[1000000];
+
+long next_random(long x) { return (x * 1103515245 + 12345) % 2147483648; }
+
+int main() {
+  int n;
+  int i;
+  int j;
+  int t;
+  long seed;
+  void **p;
+  long steps;
+  long sum;
+
+  n = 1000000;
+  for (i = 0; i < n; i = i + 1)
+    order[i] = i;
+  // a random permutation, its order is the cycle.
+  seed = 42;
+  for (i = n - 1; i > 0; i = i - 1) {
+    seed = next_random(seed);
+    j = seed % (i + 1);
+    t = order[i];
+    order[i] = order[j];
+    order[j] = t;
+  }
+  for (i = 0; i < n - 1; i = i + 1)
+    slots[order[i]] = &slots[order[i + 1]];
+  slots[order[n - 1]] = &slots[order[0]];
+
+  p = &slots[order[0]];
+  sum = 0;
+  for (steps = 0; steps < 5000000; steps = steps + 1) {
+    p = *p;
+    sum = sum + (p - slots);
+  }
+  printf("%ld\n", sum);
+  return 0;
+}
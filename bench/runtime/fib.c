@@ -0,0 +1,15 @@
+// recursion: the naive Fibonacci of examples/fib.c, deep enough to time.
+int printf();
+
+int fib(int n) {
+  if (n <= 1) {
+    return n;
+  }
+
+  return fib(n - 1) + fib(n - 2);
+}
+
+int main() {
+  printf("%d\n", fib(35));
+  return 0;
+}
@@ -0,0 +1,30 @@
+// array loops: the sieve of Eratosthenes, run a few times over.
+int printf();
+
+char composite[4000000];
+
+int sieve(int n) {
+  int i;
+  int j;
+  int count;
+  for (i = 0; i < n; i = i + 1)
+    composite[i] = 0;
+  count = 0;
+  for (i = 2; i < n; i = i + 1) {
+    if (composite[i] == 0) {
+      count = count + 1;
+      for (j = i + i; j < n; j = j + i)
+        composite[j] = 1;
+    }
+  }
+  return count;
+}
+
+int main() {
+  int round;
+  int primes;
+  for (round = 0; round < 4; round = round + 1)
+    primes = sieve(4000000);
+  printf("%d\n", primes);
+  return 0;
+}
@@ -0,0 +1,73 @@
+// string processing: a text is copied, measured, reversed, searched and
+// hashed, one character at a time.
+int printf();
+
+char text[65536];
+char copy[65536];
+
+int length(char *s) {
+  int n;
+  n = 0;
+  while (s[n])
+    n = n + 1;
+  return n;
+}
+
+void reverse(char *s, int n) {
+  int i;
+  char c;
+  for (i = 0; i < n / 2; i = i + 1) {
+    c = s[i];
+    s[i] = s[n - 1 - i];
+    s[n - 1 - i] = c;
+  }
+}
+
+int count(char *s, char *word) {
+  int found;
+  int i;
+  int j;
+  found = 0;
+  for (i = 0; s[i]; i = i + 1) {
+    j = 0;
+    while (word[j] && s[i + j] == word[j])
+      j = j + 1;
+    if (word[j] == 0)
+      found = found + 1;
+  }
+  return found;
+}
+
+long hash(char *s) {
+  long h;
+  int i;
+  h = 5381;
+  for (i = 0; s[i]; i = i + 1)
+    h = (h * 33 + s[i]) % 4294967296;
+  return h;
+}
+
+int main() {
+  char *words;
+  int n;
+  int i;
+  int round;
+  long total;
+
+  words = "the quick brown fox jumps over the lazy dog ";
+  n = length(words);
+  for (i = 0; i < 60000; i = i + 1)
+    text[i] = words[i % n];
+  text[60000] = 0;
+
+  total = 0;
+  for (round = 0; round < 60; round = round + 1) {
+    for (i = 0; text[i]; i = i + 1)
+      copy[i] = text[i];
+    copy[i] = 0;
+    reverse(copy, length(copy));
+    total = total + count(text, "the") + count(copy, "eht") + hash(copy);
+  }
+  printf("%ld\n", total);
+  return 0;
+}
@@ -0,0 +1,60 @@
+// struct copies: whole structs are assigned around in a loop and read back
+// through pointers.
+int printf();
+
+struct point {
+  long x;
+  long y;
+  long z;
+};
+
+struct particle {
+  struct point position;
+  struct point velocity;
+  int id;
+  char name[12];
+};
+
+struct particle particles[256];
+struct particle scratch;
+
+void step(struct particle *p) {
+  (*p).position.x = (*p).position.x + (*p).velocity.x;
+  (*p).position.y = (*p).position.y + (*p).velocity.y;
+  (*p).position.z = (*p).position.z + (*p).velocity.z;
+}
+
+int main() {
+  int i;
+  int round;
+  long sum;
+  struct particle a;
+
+  for (i = 0; i < 256; i = i + 1) {
+    particles[i].id = i;
+    particles[i].position.x = i;
+    particles[i].position.y = i * 2;
+    particles[i].position.z = i * 3;
+    particles[i].velocity.x = 1;
+    particles[i].velocity.y = i % 7;
+    particles[i].velocity.z = 3 - i % 5;
+  }
+
+  for (round = 0; round < 20000; round = round + 1) {
+    for (i = 0; i < 256; i = i + 1) {
+      a = particles[i];
+      step(&a);
+      scratch = a;
+      particles[(i + 1) % 256].velocity = scratch.position;
+      particles[i] = a;
+      particles[i].velocity.x = 1;
+    }
+  }
+
+  sum = 0;
+  for (i = 0; i < 256; i = i + 1)
+    sum = (sum + particles[i].position.x + particles[i].position.z) %
+          1000000007;
+  printf("%ld\n", sum);
+  return 0;
+}
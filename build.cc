@@ -0,0 +1,25 @@
+#include "build.h"
+
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace build {
+
+static std::string make_id() {
+  struct stat st;
+  if (stat("/proc/self/exe", &st) != 0)
+    return "asmlai pid " + std::to_string(getpid());
+  return "asmlai " + std::to_string(st.st_dev) + ":" +
+         std::to_string(st.st_ino) + " " + std::to_string(st.st_size) + " " +
+         std::to_string(st.st_mtim.tv_sec) + "." +
+         std::to_string(st.st_mtim.tv_nsec);
+}
+
+std::string_view id() {
+  // read once, the binary a process runs doesn't change under it.
+  static const std::string id = make_id();
+  return id;
+}
+
+} // namespace build
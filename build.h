@@ -0,0 +1,18 @@
+#ifndef _ASMLAI_BUILD_H
+#define _ASMLAI_BUILD_H
+
+#include <string_view>
+
+// Identity of the running compiler binary, for what's kept on disk and read
+// back by a later run: cache entries and precompiled headers. Relinking
+// asmlai after any change to any of its objects gives a new identity.
+namespace build {
+
+// device, inode, size and modification time of /proc/self/exe. When that
+// can't be read the process id stands in, so nothing another run wrote is
+// ever taken for this build's.
+std::string_view id();
+
+} // namespace build
+
+#endif
@@ -0,0 +1,122 @@
+#include "cache.h"
+#include "build.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+namespace cache {
+
+// two 64-bit FNV-1a style hashes with different seeds and multipliers, mixed
+// at the end. Not cryptographic, but 128 bits make accidental collisions
+// between inputs out of the question.
+namespace {
+class Hasher {
+public:
+  void add(std::string_view data) {
+    for (char c : data) {
+      hi_ = (hi_ ^ static_cast<u8>(c)) * 0x100000001b3;
+      lo_ = (lo_ ^ static_cast<u8>(c)) * 0x9e3779b97f4a7c15;
+    }
+    // keep "ab" + "c" apart from "a" + "bc".
+    u64 len = data.size();
+    hi_ = (hi_ ^ len) * 0x100000001b3;
+    lo_ = (lo_ ^ len) * 0x9e3779b97f4a7c15;
+  }
+
+  Key finish() const {
+    return Key{mix(hi_ ^ (lo_ >> 32)), mix(lo_ ^ (hi_ << 32))};
+  }
+
+private:
+  static u64 mix(u64 h) {
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111eb;
+    return h ^ (h >> 31);
+  }
+
+  u64 hi_ = 0xcbf29ce484222325;
+  u64 lo_ = 0x84222325cbf29ce4;
+};
+} // namespace
+
+Key key_of(std::string_view input, std::string_view options) {
+  Hasher hasher;
+  // a rebuilt compiler may produce different output for the same input.
+  hasher.add(build::id());
+  hasher.add(options);
+  hasher.add(input);
+  return hasher.finish();
+}
+
+// entries live in dir/xx/yyyy..., the first two hex digits spread them over
+// 256 subdirectories.
+static std::string entry_path(const char *dir, const Key &key) {
+  char hex[33];
+  std::snprintf(hex, sizeof(hex), "%016lx%016lx", key.hi_, key.lo_);
+  std::string path = dir;
+  path += '/';
+  path.append(hex, 2);
+  path += '/';
+  path.append(hex + 2);
+  return path;
+}
+
+bool lookup(const char *dir, const Key &key, output::Writer &out) {
+  int fd = open(entry_path(dir, key).c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  // read it all before handing anything out, a failed read is a miss.
+  std::string entry;
+  char buffer[64 * 1024];
+  for (;;) {
+    ssize_t n = read(fd, buffer, sizeof(buffer));
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      close(fd);
+      if (n < 0)
+        return false;
+      out.put(entry);
+      return true;
+    }
+    entry.append(buffer, n);
+  }
+}
+
+void store(const char *dir, const Key &key, std::string_view output) {
+  std::string path = entry_path(dir, key);
+  std::string subdir = path.substr(0, path.rfind('/'));
+  mkdir(dir, 0755);
+  mkdir(subdir.c_str(), 0755);
+
+  // unique to this process and thread.
+  std::string tmp =
+      path + ".tmp." + std::to_string(getpid()) + "." +
+      std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+  int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+  if (fd < 0)
+    return;
+
+  const char *p = output.data();
+  u64 left = output.size();
+  while (left) {
+    ssize_t n = write(fd, p, left);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      break;
+    p += n;
+    left -= n;
+  }
+  close(fd);
+
+  if (left || rename(tmp.c_str(), path.c_str()) < 0)
+    unlink(tmp.c_str());
+}
+
+} // namespace cache
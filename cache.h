@@ -0,0 +1,31 @@
+#ifndef _ASMLAI_CACHE_H
+#define _ASMLAI_CACHE_H
+
+#include "output.h"
+#include "types.h"
+#include <string>
+#include <string_view>
+
+// On-disk cache of compiler output, addressed by a hash of the input bytes,
+// the compiler build and everything on the command line that changes the
+// output. Entries are written to a temporary file and renamed into place, so
+// concurrent compilers sharing a directory only ever see complete entries.
+// The cache never fails a compilation: entries that can't be read or written
+// are treated as misses.
+namespace cache {
+
+struct Key {
+  u64 hi_;
+  u64 lo_;
+};
+
+// key of compiling input with the given options.
+Key key_of(std::string_view input, std::string_view options);
+
+// appends the entry for key to out, false when there is none.
+bool lookup(const char *dir, const Key &key, output::Writer &out);
+void store(const char *dir, const Key &key, std::string_view output);
+
+} // namespace cache
+
+#endif
@@ -1,23 +1,31 @@
 #include "codegen.h"
+#include "diag.h"
+#include "output.h"
 #include "parser.h"
+#include "stats.h"
 #include "types.h"
 #include "typesystem.h"
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstdio>
-#include <iostream>
-#include <string>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <string_view>
+#include <thread>
 #include <variant>
 
 namespace codegen {
-constexpr static const char *arg_8bit[] = {"%dil", "%sil", "%dl",
-                                           "%cl",  "%r8b", "%r9b"};
-constexpr static const char *arg_16bit[] = {"%di", "%si",  "%dx",
-                                            "%cx", "%r8w", "%r9w"};
-constexpr static const char *arg_32bit[] = {"%edi", "%esi", "%edx",
-                                            "%ecx", "%r8d", "%r9d"};
-constexpr static const char *arg_64bit[] = {"%rdi", "%rsi", "%rdx",
-                                            "%rcx", "%r8",  "%r9"};
+// fragments are string views so their lengths are known up front.
+constexpr static std::string_view arg_8bit[] = {"%dil", "%sil", "%dl",
+                                                "%cl",  "%r8b", "%r9b"};
+constexpr static std::string_view arg_16bit[] = {"%di", "%si",  "%dx",
+                                                 "%cx", "%r8w", "%r9w"};
+constexpr static std::string_view arg_32bit[] = {"%edi", "%esi", "%edx",
+                                                 "%ecx", "%r8d", "%r9d"};
+constexpr static std::string_view arg_64bit[] = {"%rdi", "%rsi", "%rdx",
+                                                 "%rcx", "%r8",  "%r9"};
 
 enum class TypeID { I8, I16, I32, I64 };
 #define INT(x) static_cast<int>(x)
@@ -39,172 +47,175 @@ static TypeID get_type_id(parser::Type *ty) {
   }
 }
 
-constexpr static const char *i32i8 = "movsbl %al, %eax";
-constexpr static const char *i32i16 = "movsbl %al, %eax";
-constexpr static const char *i32i64 = "movsbl %al, %eax";
-constexpr static const char *casts[][10] = {
-    {nullptr, nullptr, nullptr, i32i64}, // i8
-    {i32i8, nullptr, nullptr, i32i64},   // i16
-    {i32i8, i32i16, nullptr, i32i64},    // i32
-    {i32i8, i32i16, nullptr, nullptr},   // i64
+constexpr static std::string_view i32i8 = "movsbl %al, %eax";
+constexpr static std::string_view i32i16 = "movsbl %al, %eax";
+constexpr static std::string_view i32i64 = "movsbl %al, %eax";
+constexpr static std::string_view casts[][10] = {
+    {{}, {}, {}, i32i64},        // i8
+    {i32i8, {}, {}, i32i64},     // i16
+    {i32i8, i32i16, {}, i32i64}, // i32
+    {i32i8, i32i16, {}, {}},     // i64
 };
 
-static std::shared_ptr<parser::Object> curr_func;
-static i64 depth{};
-static FILE *out_file;
+// Everything generating one function needs. Functions only share read-only
+// data, so each gets its own context and may be generated on any thread.
+struct Context {
+  const parser::Object *func_ = nullptr;
+  i64 depth_ = 0;
+  // next local label number, the function's range comes from label_counts.
+  i64 label_ = 0;
+  output::Writer *out_ = nullptr;
+};
 
-static i64 count() {
-  static i64 i = 1;
-  return i++;
-}
+static i64 count(Context &ctx) { return ctx.label_++; }
 
 i64 align_to(i64 n, i64 align) { return (n + align - 1) / align * align; }
 
-template <typename... Args> static void emit(const char *fmt, Args... args) {
-  std::fprintf(out_file, "  ");
-  std::fprintf(out_file, fmt, args...);
-  std::fprintf(out_file, "\n");
+template <typename... Args>
+static void emit(Context &ctx, const Args &...pieces) {
+  ctx.out_->emit(pieces...);
 }
 
-template <typename... Args> static void print(const char *fmt, Args... args) {
-  std::fprintf(out_file, fmt, args...);
-  std::fprintf(out_file, "\n");
+template <typename... Args>
+static void print(Context &ctx, const Args &...pieces) {
+  ctx.out_->print(pieces...);
 }
 
-static void cmp_zero(parser::Type *ty) {
+static void cmp_zero(Context &ctx, parser::Type *ty) {
   if (typesystem::is_number(ty) && ty->size_ <= 4) {
-    emit("cmp $0, %%eax");
+    emit(ctx, "cmp $0, %eax");
   } else {
-    emit("cmp $0, %%rax");
+    emit(ctx, "cmp $0, %rax");
   }
 }
 
-static void cast(parser::Type *from, parser::Type *to) {
+static void cast(Context &ctx, parser::Type *from, parser::Type *to) {
   if (to->type_ == parser::Types::Void) {
     return;
   }
 
   if (to->type_ == parser::Types::Bool) {
-    cmp_zero(from);
-    emit("setne %%al");
-    emit("movzx %%al, %%eax");
+    cmp_zero(ctx, from);
+    emit(ctx, "setne %al");
+    emit(ctx, "movzx %al, %eax");
     return;
   }
 
   int type1 = INT(get_type_id(from));
   int type2 = INT(get_type_id(to));
 
-  if (casts[type1][type2] != nullptr) {
-    emit("%s", casts[type1][type2]);
+  if (!casts[type1][type2].empty()) {
+    emit(ctx, casts[type1][type2]);
   }
 }
 
-static void gen_stmt(const parser::Node &);
-static void push() {
-  emit("push %%rax");
-  ++depth;
+static void gen_stmt(Context &ctx, const parser::Node &);
+static void push(Context &ctx) {
+  emit(ctx, "push %rax");
+  ++ctx.depth_;
 }
 
-static void pop(const char *argument) {
-  emit("pop %s", argument);
-  --depth;
+static void pop(Context &ctx, std::string_view argument) {
+  emit(ctx, "pop ", argument);
+  --ctx.depth_;
 }
 
-static void load(parser::Type *ty) {
+static void load(Context &ctx, parser::Type *ty) {
   if (ty->type_ == parser::Types::Array || ty->type_ == parser::Types::Struct ||
       ty->type_ == parser::Types::Union) {
     return;
   }
 
   if (ty->size_ == 1)
-    emit("movsbl (%%rax), %%eax");
+    emit(ctx, "movsbl (%rax), %eax");
   else if (ty->size_ == 2)
-    emit("movswl (%%rax), %%eax");
+    emit(ctx, "movswl (%rax), %eax");
   else if (ty->size_ == 4)
-    emit("movsxd (%%rax), %%rax");
+    emit(ctx, "movsxd (%rax), %rax");
   else
-    emit("mov (%%rax), %%rax");
+    emit(ctx, "mov (%rax), %rax");
 }
 
-static void store(parser::Type *ty) {
-  pop("%rdi");
+static void store(Context &ctx, parser::Type *ty) {
+  pop(ctx, "%rdi");
 
   if (ty->type_ == parser::Types::Struct || ty->type_ == parser::Types::Union) {
     for (i32 i = 0; i < ty->size_; ++i) {
-      emit("mov %d(%%rax), %%r8b", i);
-      emit("mov %%r8b, %d(%%rdi)", i);
+      emit(ctx, "mov ", i, "(%rax), %r8b");
+      emit(ctx, "mov %r8b, ", i, "(%rdi)");
     }
     return;
   }
 
   if (ty->size_ == 1)
-    emit("mov %%al, (%%rdi)");
+    emit(ctx, "mov %al, (%rdi)");
   else if (ty->size_ == 2)
-    emit("mov %%ax, (%%rdi)");
+    emit(ctx, "mov %ax, (%rdi)");
   else if (ty->size_ == 4)
-    emit("mov %%eax, (%%rdi)");
+    emit(ctx, "mov %eax, (%rdi)");
   else
-    emit("mov %%rax, (%%rdi)");
+    emit(ctx, "mov %rax, (%rdi)");
 }
 
-static void store_parameter(i32 arg_reg, i32 offset, i32 size) {
+static void store_parameter(Context &ctx, i32 arg_reg, i32 offset, i32 size) {
   switch (size) {
   case 1: {
-    emit("mov %s, %d(%%rbp)", arg_8bit[arg_reg], offset);
+    emit(ctx, "mov ", arg_8bit[arg_reg], ", ", offset, "(%rbp)");
     return;
   }
   case 4: {
-    emit("mov %s %d(%%rbp)", arg_32bit[arg_reg], offset);
+    emit(ctx, "mov ", arg_32bit[arg_reg], ", ", offset, "(%rbp)");
     return;
   }
   case 8: {
-    emit("mov %s, %d(%%rbp)", arg_64bit[arg_reg], offset);
+    emit(ctx, "mov ", arg_64bit[arg_reg], ", ", offset, "(%rbp)");
     return;
   }
   default: {
-    std::fprintf(stderr, "unrecognized type size.");
-    std::exit(1);
+    diag::fail("unrecognized type size.");
   }
   }
 }
 
-static void gen_expression(const parser::Node &node);
-static void gen_address(const parser::Node &node) {
+static void gen_expression(Context &ctx, const parser::Node &node);
+static void gen_address(Context &ctx, const parser::Node &node) {
   if (node.type_ == parser::NodeType::Variable) {
     const auto &obj = std::get<std::shared_ptr<parser::Object>>(node.data_);
     if (obj->is_local_) {
-      emit("lea %ld(%%rbp), %%rax", obj->offset_);
+      emit(ctx, "lea ", obj->offset_, "(%rbp), %rax");
     } else {
-      emit("lea %s(%%rip), %%rax", obj->name_);
+      emit(ctx, "lea ", obj->name_, "(%rip), %rax");
     }
 
     return;
   } else if (node.type_ == parser::NodeType::Derefence) {
-    gen_expression(*node.lhs_);
+    gen_expression(ctx, *node.lhs_);
     return;
   } else if (node.type_ == parser::NodeType::Comma) {
-    gen_expression(*node.lhs_);
-    gen_expression(*node.rhs_);
+    gen_expression(ctx, *node.lhs_);
+    gen_expression(ctx, *node.rhs_);
     return;
   } else if (node.type_ == parser::NodeType::Member) {
-    gen_address(*node.lhs_);
-    emit("add $%ld, %%rax", std::get<parser::Member *>(node.data_)->offset);
+    gen_address(ctx, *node.lhs_);
+    emit(ctx, "add $", std::get<parser::Member *>(node.data_)->offset,
+         ", %rax");
     return;
   }
 
   std::fprintf(stderr, "non-lvalue\n");
 }
 
-static void
-assign_lvar_offsets(std::vector<std::shared_ptr<parser::Object>> &functions) {
+void assign_lvar_offsets(
+    std::vector<std::shared_ptr<parser::Object>> &functions) {
   for (auto &func : functions) {
     if (func->is_func_) {
       i64 offset = 0;
-      // assign first for parameters
-      std::reverse(func->params_.begin(), func->params_.end());
-      for (auto &par : func->params_) {
-        offset += par->ty_->size_;
-        par->offset_ = -offset;
+      // assign first for parameters. params_ keeps declaration order, it is
+      // matched against the argument registers.
+      for (auto it = func->params_.rbegin(); it != func->params_.rend();
+           ++it) {
+        offset += (*it)->ty_->size_;
+        (*it)->offset_ = -offset;
       }
     }
 
@@ -220,75 +231,73 @@ assign_lvar_offsets(std::vector<std::shared_ptr<parser::Object>> &functions) {
   }
 }
 
-static void gen_expression(const parser::Node &node) {
+static void gen_expression(Context &ctx, const parser::Node &node) {
   using NodeType = parser::NodeType;
 
   switch (node.type_) {
   case NodeType::Num: {
-    emit("mov $%ld, %%rax", std::get<i64>(node.data_));
+    emit(ctx, "mov $", std::get<i64>(node.data_), ", %rax");
     return;
   }
   case NodeType::Neg: {
-    gen_expression(*node.lhs_);
-    emit("neg %%rax");
+    gen_expression(ctx, *node.lhs_);
+    emit(ctx, "neg %rax");
     return;
   }
   case NodeType::Member:
   case NodeType::Variable: {
-    gen_address(node);
-    load(node.tt_);
+    gen_address(ctx, node);
+    load(ctx, node.tt_);
     return;
   }
   case NodeType::Derefence:
-    gen_expression(*node.lhs_);
-    load(node.tt_);
+    gen_expression(ctx, *node.lhs_);
+    load(ctx, node.tt_);
     return;
   case NodeType::Addr:
-    gen_address(*node.lhs_);
+    gen_address(ctx, *node.lhs_);
     return;
   case NodeType::Assign: {
-    gen_address(*node.lhs_);
-    push();
-    gen_expression(*node.rhs_);
-    store(node.tt_);
+    gen_address(ctx, *node.lhs_);
+    push(ctx);
+    gen_expression(ctx, *node.rhs_);
+    store(ctx, node.tt_);
     return;
   }
   case NodeType::StmtExpr: {
-    const auto &nodes = std::get<parser::NodeList>(node.data_);
-    for (const auto &node : nodes) {
-      gen_stmt(*node);
-    }
+    // the body is a block, its last expression statement leaves the value.
+    gen_stmt(ctx, *std::get<parser::NodePtr>(node.data_));
     return;
   }
   case NodeType::LogAnd: {
-    int c = count();
+    int c = count(ctx);
 
-    gen_expression(*node.lhs_);
-    emit("cmp $0, %%rax");
-    emit("je .L.false.%d", c);
-    gen_expression(*node.rhs_);
-    emit("cmp $0, %%rax");
-    emit("je .L.false.%d", c);
-    emit("mov $1, %%rax");
-    emit("jmp .L.end.%d", c);
-    print(".L.false.%d:", c);
-    emit("mov $0, %%rax");
-    print(".L.end.%d:", c);
+    gen_expression(ctx, *node.lhs_);
+    emit(ctx, "cmp $0, %rax");
+    emit(ctx, "je .L.false.", c);
+    gen_expression(ctx, *node.rhs_);
+    emit(ctx, "cmp $0, %rax");
+    emit(ctx, "je .L.false.", c);
+    emit(ctx, "mov $1, %rax");
+    emit(ctx, "jmp .L.end.", c);
+    print(ctx, ".L.false.", c, ":");
+    emit(ctx, "mov $0, %rax");
+    print(ctx, ".L.end.", c, ":");
     return;
   }
   case NodeType::LogOr: {
-    int c = count();
-    gen_expression(*node.lhs_);
-    emit("cmp $0, %%rax");
-    emit("jne .L.true.%d", c);
-    gen_expression(*node.rhs_);
-    emit("cmp $0, %%rax");
-    emit("jne .L.true.%d", c);
-    emit("mov $0, %%rax");
-    emit("jmp .L.end.%d", c);
-    print(".L.true.%d:", c);
-    emit("mov $1, %%rax");
-    print(".L.end.%d:", c);
+    int c = count(ctx);
+    gen_expression(ctx, *node.lhs_);
+    emit(ctx, "cmp $0, %rax");
+    emit(ctx, "jne .L.true.", c);
+    gen_expression(ctx, *node.rhs_);
+    emit(ctx, "cmp $0, %rax");
+    emit(ctx, "jne .L.true.", c);
+    emit(ctx, "mov $0, %rax");
+    emit(ctx, "jmp .L.end.", c);
+    print(ctx, ".L.true.", c, ":");
+    emit(ctx, "mov $1, %rax");
+    print(ctx, ".L.end.", c, ":");
     return;
   }
   case NodeType::FunctionCall: {
@@ -297,134 +306,131 @@ static void gen_expression(const parser::Node &node) {
     i32 arg_count = static_cast<i32>(nodes.size());
 
     for (const auto &node : nodes) {
-      gen_expression(*node);
-      push();
+      gen_expression(ctx, *node);
+      push(ctx);
     }
 
     for (i32 i = arg_count - 1; i >= 0; --i) {
-      pop(arg_64bit[i]);
+      pop(ctx, arg_64bit[i]);
     }
 
-    emit("mov $0, %%rax");
-    emit("call %s", node.func_name_);
+    emit(ctx, "mov $0, %rax");
+    emit(ctx, "call ", node.func_name_);
     return;
   }
   case NodeType::Cond: {
-    auto L = count();
+    auto L = count(ctx);
 
     const auto &if_node = std::get<parser::IfNode>(node.data_);
-    gen_expression(*if_node.condition_);
-    emit("cmp $0, %%rax");
-    emit("je .L.else.%d", L);
-    gen_expression(*if_node.then_);
-    emit("jmp .L.end.%d", L);
-    print(".L.else.%d", L);
-    gen_expression(*if_node.else_);
-    print(".L.end.%d:", L);
+    gen_expression(ctx, *if_node.condition_);
+    emit(ctx, "cmp $0, %rax");
+    emit(ctx, "je .L.else.", L);
+    gen_expression(ctx, *if_node.then_);
+    emit(ctx, "jmp .L.end.", L);
+    print(ctx, ".L.else.", L, ":");
+    gen_expression(ctx, *if_node.else_);
+    print(ctx, ".L.end.", L, ":");
 
     return;
   }
   case NodeType::Not: {
-    gen_expression(*node.rhs_);
-    emit("cmp $0, %%rax");
-    emit("sete %%al");
-    emit("movzx %%al, %%rax");
+    gen_expression(ctx, *node.rhs_);
+    emit(ctx, "cmp $0, %rax");
+    emit(ctx, "sete %al");
+    emit(ctx, "movzx %al, %rax");
 
     return;
   }
   case NodeType::Comma: {
-    gen_expression(*node.lhs_);
-    gen_expression(*node.rhs_);
+    gen_expression(ctx, *node.lhs_);
+    gen_expression(ctx, *node.rhs_);
     return;
   }
   default: {
   }
   }
 
-  gen_expression(*node.rhs_);
-  push();
+  gen_expression(ctx, *node.rhs_);
+  push(ctx);
 
-  gen_expression(*node.lhs_);
-  pop("%rdi");
+  gen_expression(ctx, *node.lhs_);
+  pop(ctx, "%rdi");
 
-  std::string ax_, di_;
+  std::string_view ax, di;
   if (node.lhs_->tt_->type_ == parser::Types::Long ||
       node.lhs_->tt_->base_type_) {
-    ax_ = "%rax";
-    di_ = "%rdi";
+    ax = "%rax";
+    di = "%rdi";
   } else {
-    ax_ = "%eax";
-    di_ = "%edi";
+    ax = "%eax";
+    di = "%edi";
   }
 
-  const char *ax = ax_.c_str();
-  const char *di = di_.c_str();
-
   switch (node.type_) {
   case NodeType::Add: {
-    emit("add %s, %s", di, ax);
+    emit(ctx, "add ", di, ", ", ax);
     return;
   }
   case NodeType::Sub: {
-    emit("sub %s, %s", di, ax);
+    emit(ctx, "sub ", di, ", ", ax);
     return;
   }
   case NodeType::Mul: {
-    emit("imul %s, %s", di, ax);
+    emit(ctx, "imul ", di, ", ", ax);
     return;
   }
   case NodeType::Mod:
   case NodeType::Div: {
     if (node.lhs_->tt_->size_ == 8) {
-      emit("cqo");
+      emit(ctx, "cqo");
     } else {
-      emit("cdq");
+      emit(ctx, "cdq");
     }
-    emit("idiv %s", di);
+    emit(ctx, "idiv ", di);
 
     if (node.type_ == NodeType::Mod) {
-      emit("mov %%rdx, %%rax");
+      emit(ctx, "mov %rdx, %rax");
     }
     return;
   }
   case NodeType::BitAnd: {
-    emit("and %%rdi, %%rax");
+    emit(ctx, "and %rdi, %rax");
     return;
   }
   case NodeType::BitOr: {
-    emit("or %%rdi, %%rax");
+    emit(ctx, "or %rdi, %rax");
     return;
   }
   case NodeType::BitXor: {
-    emit("xor %%rdi, %%rax");
+    emit(ctx, "xor %rdi, %rax");
     return;
   }
   case NodeType::Shl: {
-    emit("mov %%rdi, %%rcx");
-    emit("shl %%cl, %s", ax);
+    emit(ctx, "mov %rdi, %rcx");
+    emit(ctx, "shl %cl, ", ax);
     return;
   }
   case NodeType::Shr: {
-    emit("mov %%rdi, %%rcx");
-    emit("sar %%cl, %s", ax);
+    emit(ctx, "mov %rdi, %rcx");
+    emit(ctx, "sar %cl, ", ax);
     return;
   }
   case NodeType::EQ:
   case NodeType::LT:
   case NodeType::NE:
   case NodeType::LE: {
-    emit("cmp %s, %s", di, ax);
+    emit(ctx, "cmp ", di, ", ", ax);
 
     if (node.type_ == NodeType::EQ) {
-      emit("sete %%al");
+      emit(ctx, "sete %al");
     } else if (node.type_ == NodeType::NE) {
-      emit("setne %%al");
+      emit(ctx, "setne %al");
     } else if (node.type_ == NodeType::LT) {
-      emit("setl %%al");
+      emit(ctx, "setl %al");
     } else if (node.type_ == NodeType::LE) {
-      emit("setle %%al");
+      emit(ctx, "setle %al");
     }
-    emit("movzb %%al, %%rax");
+    emit(ctx, "movzb %al, %rax");
     return;
   }
   default: {
@@ -433,22 +439,22 @@ static void gen_expression(const parser::Node &node) {
   }
 }
 
-static void gen_stmt(const parser::Node &node) {
+static void gen_stmt(Context &ctx, const parser::Node &node) {
   switch (node.type_) {
   case parser::NodeType::ExprStmt: {
-    gen_expression(*node.lhs_);
+    gen_expression(ctx, *node.lhs_);
     return;
   }
   case parser::NodeType::Return: {
-    gen_expression(*node.lhs_);
-    emit("jmp .L.return.%s", curr_func->name_);
+    gen_expression(ctx, *node.lhs_);
+    emit(ctx, "jmp .L.return.", ctx.func_->name_);
     return;
   }
   case parser::NodeType::Block: {
     try {
       const auto &nodes = std::get<parser::NodeList>(node.data_);
       for (const auto &node : nodes) {
-        gen_stmt(*node);
+        gen_stmt(ctx, *node);
       }
 
       return;
@@ -458,107 +464,222 @@ static void gen_stmt(const parser::Node &node) {
     }
   }
   case parser::NodeType::If: {
-    i64 L = count();
+    i64 L = count(ctx);
     const auto &if_node = std::get<parser::IfNode>(node.data_);
-    gen_expression(*if_node.condition_);
-    emit("cmp $0, %%rax");
-    emit("je .L.else.%ld", L);
-    gen_stmt(*if_node.then_);
-    emit("jmp .L.end.%ld", L);
-    std::fprintf(out_file, ".L.else.%ld:\n", L);
+    gen_expression(ctx, *if_node.condition_);
+    emit(ctx, "cmp $0, %rax");
+    emit(ctx, "je .L.else.", L);
+    gen_stmt(ctx, *if_node.then_);
+    emit(ctx, "jmp .L.end.", L);
+    print(ctx, ".L.else.", L, ":");
     if (if_node.else_ != nullptr) {
-      gen_stmt(*if_node.else_);
+      gen_stmt(ctx, *if_node.else_);
     }
-    std::fprintf(out_file, ".L.end.%ld:\n", L);
+    print(ctx, ".L.end.", L, ":");
     return;
   }
   case parser::NodeType::For: {
-    i64 L = count();
+    i64 L = count(ctx);
     const auto &for_node = std::get<parser::ForNode>(node.data_);
 
     if (for_node.initialization_ != nullptr) {
-      gen_stmt(*for_node.initialization_);
+      gen_stmt(ctx, *for_node.initialization_);
     }
 
-    std::fprintf(out_file, ".L.begin.%ld:\n", L);
+    print(ctx, ".L.begin.", L, ":");
     if (for_node.condition_ != nullptr) {
-      gen_expression(*for_node.condition_);
-      emit("cmp $0, %%rax");
-      emit("je  .L.end.%ld", L);
+      gen_expression(ctx, *for_node.condition_);
+      emit(ctx, "cmp $0, %rax");
+      emit(ctx, "je  .L.end.", L);
     }
 
-    gen_stmt(*for_node.body_);
+    gen_stmt(ctx, *for_node.body_);
     if (for_node.increment_ != nullptr)
-      gen_expression(*for_node.increment_);
-    emit("jmp .L.begin.%ld", L);
-    std::fprintf(out_file, ".L.end.%ld:\n", L);
+      gen_expression(ctx, *for_node.increment_);
+    emit(ctx, "jmp .L.begin.", L);
+    print(ctx, ".L.end.", L, ":");
     return;
   }
   case parser::NodeType::Goto: {
-    emit("jmp %s", std::get<parser::LabelGotoData>(node.data_).unique_label);
+    emit(ctx, "jmp ",
+         std::get<parser::LabelGotoData>(node.data_).unique_label);
     return;
   }
   case parser::NodeType::Label: {
-    std::fprintf(out_file, "%s:",
-                 std::get<parser::LabelGotoData>(node.data_).unique_label);
-    gen_stmt(*node.lhs_);
+    // the statement follows on the same line.
+    ctx.out_->put(std::get<parser::LabelGotoData>(node.data_).unique_label);
+    ctx.out_->put(":");
+    gen_stmt(ctx, *node.lhs_);
     return;
   }
   default: {
-    std::fprintf(stderr, "invalid statement\n");
-    std::exit(1);
+    diag::fail("invalid statement");
+  }
   }
+}
+
+// number of local labels codegen takes for node and everything under it.
+// Every node is visited, so this is never less than what generating the
+// function actually uses.
+static i64 count_labels(const parser::Node *node) {
+  using NodeType = parser::NodeType;
+  if (!node)
+    return 0;
+
+  i64 labels = 0;
+  switch (node->type_) {
+  case NodeType::If:
+  case NodeType::For:
+  case NodeType::Cond:
+  case NodeType::LogAnd:
+  case NodeType::LogOr:
+    labels = 1;
+    break;
+  default:
+    break;
+  }
+
+  labels += count_labels(node->lhs_) + count_labels(node->rhs_);
+  if (const auto *nodes = std::get_if<parser::NodeList>(&node->data_)) {
+    for (const auto *child : *nodes)
+      labels += count_labels(child);
+  } else if (const auto *if_node = std::get_if<parser::IfNode>(&node->data_)) {
+    labels += count_labels(if_node->condition_) +
+              count_labels(if_node->then_) + count_labels(if_node->else_);
+  } else if (const auto *for_node =
+                 std::get_if<parser::ForNode>(&node->data_)) {
+    labels += count_labels(for_node->initialization_) +
+              count_labels(for_node->condition_) +
+              count_labels(for_node->increment_) +
+              count_labels(for_node->body_);
+  } else if (const auto *body = std::get_if<parser::NodePtr>(&node->data_)) {
+    labels += count_labels(*body);
+  }
+  return labels;
+}
+
+static void gen_function(Context &ctx) {
+  const parser::Object *func = ctx.func_;
+  emit(ctx, ".globl ", func->name_);
+  emit(ctx, ".text");
+  print(ctx, func->name_, ":");
+
+  emit(ctx, "push %rbp");
+  emit(ctx, "mov %rsp, %rbp");
+  emit(ctx, "sub $", func->stack_sz, ", %rsp");
+
+  u64 arg_reg_index = 0;
+  for (auto &par : func->params_) {
+    store_parameter(ctx, arg_reg_index++, par->offset_, par->ty_->size_);
   }
+
+  gen_stmt(ctx, *func->body);
+
+  print(ctx, ".L.return.", func->name_, ":");
+  emit(ctx, "mov %rbp, %rsp");
+  emit(ctx, "pop %rbp");
+  emit(ctx, "ret");
 }
 
-void gen_code(std::vector<std::shared_ptr<parser::Object>> &&root, FILE *out) {
-  out_file = out;
-  assign_lvar_offsets(root);
+// files with fewer functions aren't worth starting threads for.
+constexpr u64 kMinParallelFunctions = 32;
 
+void gen_code(std::vector<std::shared_ptr<parser::Object>> &&root,
+              output::Writer &writer, u64 max_threads) {
+  Context globals;
+  globals.out_ = &writer;
   for (u64 i = 0; i < root.size(); ++i) {
     if (root[i]->is_func_) {
       continue;
     }
 
-    emit(".data");
-    emit(".globl %s", root[i]->name_);
-    std::fprintf(out_file, "%s:\n", root[i]->name_);
+    // string literals are named .L..N in every file, they stay local to it
+    // and read-only. Other globals without an initializer take no space in
+    // the object file.
+    bool literal = !std::strncmp(root[i]->name_, ".L", 2);
+    if (literal) {
+      emit(globals, ".section .rodata");
+    } else {
+      emit(globals, root[i]->init_data_ ? ".data" : ".bss");
+      emit(globals, ".globl ", root[i]->name_);
+    }
+    print(globals, root[i]->name_, ":");
 
     if (root[i]->init_data_ == nullptr) {
-      emit(".zero %d", root[i]->ty_->size_);
+      emit(globals, ".zero ", root[i]->ty_->size_);
     } else {
       for (int j = 0; j < root[i]->ty_->size_; ++j) {
-        emit(".byte %d", root[i]->init_data_[j]);
+        emit(globals, ".byte ", root[i]->init_data_[j]);
       }
     }
   }
 
-  for (u64 i = 0; i < root.size(); ++i) {
-    if (!root[i]->is_func_ || !root[i]->is_definition_) {
+  // every function gets its own range of label numbers up front, so the
+  // labels don't depend on the order functions are generated in.
+  std::vector<Context> functions;
+  i64 label = 1;
+  for (const auto &obj : root) {
+    if (!obj->is_func_ || !obj->is_definition_) {
       continue;
     }
 
-    curr_func = root[i];
-
-    emit(".globl %s", curr_func->name_);
-    emit(".text");
-    std::fprintf(out_file, "%s:\n", curr_func->name_);
-
-    emit("push %%rbp");
-    emit("mov %%rsp, %%rbp");
-    emit("sub $%ld, %%rsp", curr_func->stack_sz);
+    Context ctx;
+    ctx.func_ = obj.get();
+    ctx.label_ = label;
+    label += count_labels(obj->body);
+    functions.push_back(ctx);
+  }
 
-    u64 arg_reg_index = 0;
-    for (auto &par : curr_func->params_) {
-      store_parameter(arg_reg_index++, par->offset_, par->ty_->size_);
+  u64 threads = std::min<u64>(max_threads, functions.size());
+  if (threads <= 1 || functions.size() < kMinParallelFunctions) {
+    for (auto &ctx : functions) {
+      ctx.out_ = &writer;
+      gen_function(ctx);
     }
+    return;
+  }
 
-    gen_stmt(*curr_func->body);
+  // each worker appends the functions it takes to a buffer of its own and
+  // notes where they landed, they're copied out in order once all are done.
+  std::vector<std::unique_ptr<output::Writer>> buffers(threads);
+  std::vector<std::pair<u64, u64>> ranges(functions.size());
+  std::atomic<u64> next{0};
+  // an error stops the other workers and is rethrown here once they're done.
+  std::vector<std::exception_ptr> errors(threads);
+  // what the workers used counts for the compilation, -ftime-report adds it.
+  std::vector<stats::Helper> usage(threads);
+  std::vector<std::thread> workers;
+  for (u64 t = 0; t < threads; ++t) {
+    buffers[t] = std::make_unique<output::Writer>();
+    workers.emplace_back([&, t] {
+      usage[t].start();
+      output::Writer &buffer = *buffers[t];
+      try {
+        for (u64 i = next++; i < functions.size(); i = next++) {
+          u64 start = buffer.text().size();
+          functions[i].out_ = &buffer;
+          gen_function(functions[i]);
+          ranges[i] = {start, buffer.text().size()};
+        }
+      } catch (...) {
+        errors[t] = std::current_exception();
+        next = functions.size();
+      }
+      usage[t].done();
+    });
+  }
+  for (auto &worker : workers)
+    worker.join();
+  for (const auto &helper : usage)
+    stats::add_helper(helper);
+  for (auto &error : errors) {
+    if (error)
+      std::rethrow_exception(error);
+  }
 
-    std::fprintf(out_file, ".L.return.%s:\n", curr_func->name_);
-    emit("mov %%rbp, %%rsp");
-    emit("pop %%rbp");
-    emit("ret");
+  for (u64 i = 0; i < functions.size(); ++i) {
+    auto [start, end] = ranges[i];
+    writer.put(functions[i].out_->text().substr(start, end - start));
   }
 }
 } // namespace codegen
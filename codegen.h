@@ -1,11 +1,17 @@
 #ifndef _ASMLAI_CODEGEN_H
 #define _ASMLAI_CODEGEN_H
 
+#include "output.h"
 #include "parser.h"
-#include <bits/types/FILE.h>
 
 namespace codegen {
-void gen_code(std::vector<std::shared_ptr<parser::Object>> &&root, FILE *fp);
+// gives every local and parameter its place in the stack frame, gen_code
+// expects it done.
+void assign_lvar_offsets(std::vector<std::shared_ptr<parser::Object>> &root);
+// threads is the most functions gen_code generates at once, on threads of
+// its own when it's more than one.
+void gen_code(std::vector<std::shared_ptr<parser::Object>> &&root,
+              output::Writer &out, u64 threads);
 i64 align_to(i64 n, i64 align);
 }; // namespace codegen
 
@@ -0,0 +1,39 @@
+#ifndef _ASMLAI_DIAG_H
+#define _ASMLAI_DIAG_H
+
+#include <cstdio>
+#include <exception>
+#include <string>
+#include <utility>
+
+// Errors are reported by throwing a CompileError that carries the complete
+// diagnostic. The driver prints it and moves on, so one process can compile
+// many inputs and a bad one doesn't take the others down with it.
+namespace diag {
+
+class CompileError : public std::exception {
+public:
+  explicit CompileError(std::string message) : message_(std::move(message)) {}
+  const char *what() const noexcept override { return message_.c_str(); }
+
+private:
+  std::string message_;
+};
+
+// printf into a string.
+template <typename... Args>
+std::string format(const char *format_string, Args... args) {
+  int len = std::snprintf(nullptr, 0, format_string, args...);
+  std::string s(len, '\0');
+  std::snprintf(s.data(), len + 1, format_string, args...);
+  return s;
+}
+
+template <typename... Args>
+[[noreturn]] void fail(const char *format_string, Args... args) {
+  throw CompileError(format(format_string, args...));
+}
+
+} // namespace diag
+
+#endif
@@ -0,0 +1,240 @@
+#include "elf.h"
+
+#include <algorithm>
+#include <cstring>
+#include <elf.h>
+#include <string_view>
+#include <vector>
+
+namespace elf {
+
+using assembler::SectionId;
+
+namespace {
+// a string table under construction, offset 0 is the empty string.
+class StringTable {
+public:
+  u32 add(std::string_view s) {
+    u32 offset = bytes_.size();
+    bytes_.insert(bytes_.end(), s.begin(), s.end());
+    bytes_.push_back('\0');
+    return offset;
+  }
+
+  std::vector<u8> bytes_{'\0'};
+};
+
+struct OutputSection {
+  Elf64_Shdr header_{};
+  const std::vector<u8> *bytes_ = nullptr;
+};
+} // namespace
+
+template <typename T> static std::vector<u8> to_bytes(const std::vector<T> &v) {
+  std::vector<u8> bytes(v.size() * sizeof(T));
+  if (!v.empty())
+    std::memcpy(bytes.data(), v.data(), bytes.size());
+  return bytes;
+}
+
+void write_object(const assembler::Object &obj, output::Writer &writer) {
+  StringTable section_names;
+  StringTable names;
+  std::vector<OutputSection> sections(1);
+
+  // index of the ELF section each assembler section ends up in.
+  u16 index[assembler::kSectionCount];
+  for (u64 i = 0; i < assembler::kSectionCount; ++i) {
+    const assembler::Section &sec = obj.sections_[i];
+    auto id = static_cast<SectionId>(i);
+    OutputSection out;
+    out.header_.sh_name = section_names.add(assembler::section_name(id));
+    out.header_.sh_type = id == SectionId::Bss ? SHT_NOBITS : SHT_PROGBITS;
+    out.header_.sh_flags = SHF_ALLOC;
+    if (id == SectionId::Text)
+      out.header_.sh_flags |= SHF_EXECINSTR;
+    if (id == SectionId::Data || id == SectionId::Bss)
+      out.header_.sh_flags |= SHF_WRITE;
+    out.header_.sh_size = sec.size_;
+    out.header_.sh_addralign = sec.align_;
+    out.bytes_ = &sec.bytes_;
+    index[i] = sections.size();
+    sections.push_back(out);
+  }
+
+  // the symbol table lists locals first. Local labels only make it in when a
+  // relocation refers to them, undefined symbols are always global.
+  std::vector<bool> referenced(obj.symbols_.size());
+  for (const auto &rel : obj.relocations_)
+    referenced[rel.symbol_] = true;
+
+  std::vector<Elf64_Sym> symbols(1);
+  std::vector<u32> symbol_index(obj.symbols_.size());
+  // .L names are assembler locals, they're never exported even when
+  // declared .globl, like string literals that every file numbers from 0.
+  auto global = [&](const assembler::Symbol &sym) {
+    return sym.global_ && sym.name_.compare(0, 2, ".L") != 0;
+  };
+  auto add_symbol = [&](u32 i) {
+    const assembler::Symbol &sym = obj.symbols_[i];
+    Elf64_Sym out{};
+    out.st_name = names.add(sym.name_);
+    out.st_value = sym.value_;
+    if (sym.section_ == SectionId::Undefined) {
+      out.st_shndx = SHN_UNDEF;
+      out.st_info = ELF64_ST_INFO(STB_GLOBAL, STT_NOTYPE);
+    } else {
+      out.st_shndx = index[static_cast<u64>(sym.section_)];
+      int type = !global(sym)                       ? STT_NOTYPE
+                 : sym.section_ == SectionId::Text ? STT_FUNC
+                                                   : STT_OBJECT;
+      out.st_info =
+          ELF64_ST_INFO(global(sym) ? STB_GLOBAL : STB_LOCAL, type);
+    }
+    symbol_index[i] = symbols.size();
+    symbols.push_back(out);
+  };
+
+  for (u32 i = 0; i < obj.symbols_.size(); ++i) {
+    const assembler::Symbol &sym = obj.symbols_[i];
+    bool local = !global(sym) && sym.section_ != SectionId::Undefined;
+    if (local && (referenced[i] || sym.name_.compare(0, 2, ".L") != 0))
+      add_symbol(i);
+  }
+  u32 first_global = symbols.size();
+  for (u32 i = 0; i < obj.symbols_.size(); ++i) {
+    const assembler::Symbol &sym = obj.symbols_[i];
+    if (global(sym) || (sym.section_ == SectionId::Undefined && referenced[i]))
+      add_symbol(i);
+  }
+
+  // one relocation section for every section that has relocations.
+  std::vector<std::vector<u8>> relocation_bytes;
+  relocation_bytes.reserve(assembler::kSectionCount);
+  std::vector<std::pair<u64, u64>> relocation_sections;
+  for (u64 i = 0; i < assembler::kSectionCount; ++i) {
+    std::vector<Elf64_Rela> relas;
+    for (const auto &rel : obj.relocations_) {
+      if (static_cast<u64>(rel.section_) != i)
+        continue;
+      u32 type = rel.kind_ == assembler::RelocationKind::PLT32
+                     ? R_X86_64_PLT32
+                     : R_X86_64_PC32;
+      relas.push_back(Elf64_Rela{
+          rel.offset_, ELF64_R_INFO(symbol_index[rel.symbol_], type),
+          rel.addend_});
+    }
+    if (relas.empty())
+      continue;
+    relocation_bytes.push_back(to_bytes(relas));
+    relocation_sections.emplace_back(i, relocation_bytes.size() - 1);
+  }
+
+  u16 symtab_index = sections.size() + relocation_sections.size();
+  for (auto [i, bytes] : relocation_sections) {
+    OutputSection out;
+    std::string name = ".rela";
+    name += assembler::section_name(static_cast<SectionId>(i));
+    out.header_.sh_name = section_names.add(name);
+    out.header_.sh_type = SHT_RELA;
+    out.header_.sh_flags = SHF_INFO_LINK;
+    out.header_.sh_size = relocation_bytes[bytes].size();
+    out.header_.sh_link = symtab_index;
+    out.header_.sh_info = index[i];
+    out.header_.sh_addralign = 8;
+    out.header_.sh_entsize = sizeof(Elf64_Rela);
+    out.bytes_ = &relocation_bytes[bytes];
+    sections.push_back(out);
+  }
+
+  std::vector<u8> symbol_bytes = to_bytes(symbols);
+  OutputSection symtab;
+  symtab.header_.sh_name = section_names.add(".symtab");
+  symtab.header_.sh_type = SHT_SYMTAB;
+  symtab.header_.sh_size = symbol_bytes.size();
+  symtab.header_.sh_link = symtab_index + 1;
+  symtab.header_.sh_info = first_global;
+  symtab.header_.sh_addralign = 8;
+  symtab.header_.sh_entsize = sizeof(Elf64_Sym);
+  symtab.bytes_ = &symbol_bytes;
+  sections.push_back(symtab);
+
+  OutputSection strtab;
+  strtab.header_.sh_name = section_names.add(".strtab");
+  strtab.header_.sh_type = SHT_STRTAB;
+  strtab.header_.sh_size = names.bytes_.size();
+  strtab.header_.sh_addralign = 1;
+  strtab.bytes_ = &names.bytes_;
+  sections.push_back(strtab);
+
+  // an empty .note.GNU-stack keeps the linker from making the stack
+  // executable.
+  static const std::vector<u8> no_bytes;
+  OutputSection note;
+  note.header_.sh_name = section_names.add(".note.GNU-stack");
+  note.header_.sh_type = SHT_PROGBITS;
+  note.header_.sh_addralign = 1;
+  note.bytes_ = &no_bytes;
+  sections.push_back(note);
+
+  OutputSection shstrtab;
+  shstrtab.header_.sh_name = section_names.add(".shstrtab");
+  shstrtab.header_.sh_type = SHT_STRTAB;
+  shstrtab.header_.sh_addralign = 1;
+  shstrtab.bytes_ = &section_names.bytes_;
+  u16 shstrtab_index = sections.size();
+  sections.push_back(shstrtab);
+  sections.back().header_.sh_size = section_names.bytes_.size();
+
+  // section contents follow the file header, the section headers come last.
+  u64 offset = sizeof(Elf64_Ehdr);
+  for (u64 i = 1; i < sections.size(); ++i) {
+    Elf64_Shdr &header = sections[i].header_;
+    u64 align = header.sh_addralign ? header.sh_addralign : 1;
+    offset = (offset + align - 1) / align * align;
+    header.sh_offset = offset;
+    if (header.sh_type != SHT_NOBITS)
+      offset += header.sh_size;
+  }
+  offset = (offset + 7) / 8 * 8;
+
+  Elf64_Ehdr ehdr{};
+  std::memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+  ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+  ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+  ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+  ehdr.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+  ehdr.e_type = ET_REL;
+  ehdr.e_machine = EM_X86_64;
+  ehdr.e_version = EV_CURRENT;
+  ehdr.e_shoff = offset;
+  ehdr.e_ehsize = sizeof(Elf64_Ehdr);
+  ehdr.e_shentsize = sizeof(Elf64_Shdr);
+  ehdr.e_shnum = sections.size();
+  ehdr.e_shstrndx = shstrtab_index;
+
+  u64 written = 0;
+  auto put = [&](const void *data, u64 size) {
+    writer.put(std::string_view(static_cast<const char *>(data), size));
+    written += size;
+  };
+  auto pad_to = [&](u64 position) {
+    static const char zeros[16] = {};
+    while (written < position)
+      put(zeros, std::min<u64>(position - written, sizeof(zeros)));
+  };
+
+  put(&ehdr, sizeof(ehdr));
+  for (u64 i = 1; i < sections.size(); ++i) {
+    const Elf64_Shdr &header = sections[i].header_;
+    if (header.sh_type == SHT_NOBITS)
+      continue;
+    pad_to(header.sh_offset);
+    put(sections[i].bytes_->data(), sections[i].bytes_->size());
+  }
+  pad_to(offset);
+  for (const auto &section : sections)
+    put(&section.header_, sizeof(section.header_));
+}
+
+} // namespace elf
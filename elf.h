@@ -0,0 +1,16 @@
+#ifndef _ASMLAI_ELF_H
+#define _ASMLAI_ELF_H
+
+#include "assembler.h"
+#include "output.h"
+
+// Writes assembled code as an ELF64 relocatable object for x86-64, the kind
+// of file `cc -c` produces and the system linker takes.
+namespace elf {
+
+// appends obj as an object file to writer.
+void write_object(const assembler::Object &obj, output::Writer &writer);
+
+} // namespace elf
+
+#endif
@@ -0,0 +1,94 @@
+#include "intern.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace intern {
+constexpr u64 kPoolChunkSize = 64 * 1024;
+
+struct Entry {
+  const char *str_;
+  u32 len_;
+  u32 hash_;
+};
+
+// every thread interns into its own table, so symbols are only meaningful on
+// the thread that made them. entries_[0] is kNoSymbol, so real symbols start
+// from one.
+static thread_local std::vector<Entry> entries_{Entry{"", 0, 0}};
+// open addressing table of symbols, 0 marks an empty slot.
+static thread_local std::vector<Symbol> slots_(1024, kNoSymbol);
+
+static thread_local char *pool_ptr = nullptr;
+static thread_local char *pool_end = nullptr;
+
+static u32 hash_of(const char *str, u64 len) {
+  u32 hash = 2166136261u;
+  for (u64 i = 0; i < len; ++i) {
+    hash ^= static_cast<u8>(str[i]);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static const char *store(const char *str, u64 len) {
+  if (pool_ptr == nullptr || (u64)(pool_end - pool_ptr) < len + 1) {
+    u64 size = len + 1 > kPoolChunkSize ? len + 1 : kPoolChunkSize;
+    pool_ptr = static_cast<char *>(std::malloc(size));
+    if (!pool_ptr) {
+      std::abort();
+    }
+    pool_end = pool_ptr + size;
+  }
+
+  char *res = pool_ptr;
+  std::memcpy(res, str, len);
+  res[len] = '\0';
+  pool_ptr += len + 1;
+  return res;
+}
+
+static void grow() {
+  std::vector<Symbol> slots(slots_.size() * 2, kNoSymbol);
+  u64 mask = slots.size() - 1;
+  for (Symbol sym = 1; sym < entries_.size(); ++sym) {
+    u64 i = entries_[sym].hash_ & mask;
+    while (slots[i] != kNoSymbol)
+      i = (i + 1) & mask;
+    slots[i] = sym;
+  }
+  slots_ = std::move(slots);
+}
+
+Symbol intern(const char *str, u64 len) {
+  u32 hash = hash_of(str, len);
+  u64 mask = slots_.size() - 1;
+
+  for (u64 i = hash & mask;; i = (i + 1) & mask) {
+    Symbol sym = slots_[i];
+    if (sym == kNoSymbol) {
+      sym = static_cast<Symbol>(entries_.size());
+      entries_.push_back(Entry{store(str, len), static_cast<u32>(len), hash});
+      slots_[i] = sym;
+
+      // keep the load factor under a half so probe chains stay short.
+      if (entries_.size() * 2 > slots_.size())
+        grow();
+      return sym;
+    }
+
+    const Entry &e = entries_[sym];
+    if (e.hash_ == hash && e.len_ == len && !std::memcmp(e.str_, str, len))
+      return sym;
+  }
+}
+
+Symbol intern(const char *str) { return intern(str, std::strlen(str)); }
+
+const char *name(Symbol sym) { return entries_[sym].str_; }
+
+u32 length(Symbol sym) { return entries_[sym].len_; }
+
+u64 symbol_count() { return entries_.size() - 1; }
+} // namespace intern
@@ -0,0 +1,24 @@
+#ifndef _ASMLAI_INTERN_H
+#define _ASMLAI_INTERN_H
+
+#include "types.h"
+
+namespace intern {
+
+// Symbol identifies an interned identifier. Every distinct spelling is stored
+// exactly once, so two names are equal iff their symbols are equal.
+using Symbol = u32;
+constexpr Symbol kNoSymbol = 0;
+
+Symbol intern(const char *str, u64 len);
+Symbol intern(const char *str);
+
+// the interned spelling, null terminated and valid for the whole process.
+const char *name(Symbol sym);
+u32 length(Symbol sym);
+
+u64 symbol_count();
+
+} // namespace intern
+
+#endif
@@ -0,0 +1,124 @@
+#include "jit.h"
+#include "diag.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+namespace jit {
+
+using assembler::SectionId;
+
+template <typename... Args>
+[[noreturn]] static void error(const char *format_string, Args... args) {
+  throw diag::CompileError("jit: " + diag::format(format_string, args...));
+}
+
+// jmp *0(%rip) followed by the target address: a call can reach any address
+// through it, even one more than 2GiB away from the code.
+constexpr u8 kStub[] = {0xff, 0x25, 0x00, 0x00, 0x00, 0x00};
+constexpr u64 kStubSize = sizeof(kStub) + sizeof(u64);
+
+static u64 align_to(u64 n, u64 align) {
+  return (n + align - 1) / align * align;
+}
+
+int run(const assembler::Object &obj, int argc, char **argv) {
+  const u64 page = sysconf(_SC_PAGESIZE);
+  auto section = [&](SectionId id) -> const assembler::Section & {
+    return obj.sections_[static_cast<u64>(id)];
+  };
+
+  // code and its stubs come first and end up read-only and executable, the
+  // other sections follow on their own pages.
+  std::vector<u64> stub(obj.symbols_.size(), 0);
+  u64 stubs = align_to(section(SectionId::Text).size_, 8);
+  u64 code_size = stubs;
+  for (const auto &rel : obj.relocations_) {
+    const assembler::Symbol &sym = obj.symbols_[rel.symbol_];
+    if (rel.kind_ == assembler::RelocationKind::PLT32 &&
+        sym.section_ == SectionId::Undefined && !stub[rel.symbol_]) {
+      stub[rel.symbol_] = code_size;
+      code_size += kStubSize;
+    }
+  }
+
+  u64 offsets[assembler::kSectionCount] = {};
+  u64 size = align_to(code_size, page);
+  for (SectionId id : {SectionId::Rodata, SectionId::Data, SectionId::Bss}) {
+    size = align_to(size, section(id).align_);
+    offsets[static_cast<u64>(id)] = size;
+    size += section(id).size_;
+  }
+  size = align_to(size, page);
+
+  void *mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapping == MAP_FAILED)
+    error("cannot map %lu bytes: %s", size, strerror(errno));
+  u8 *base = static_cast<u8 *>(mapping);
+
+  for (u64 i = 0; i < assembler::kSectionCount; ++i) {
+    const auto &bytes = obj.sections_[i].bytes_;
+    if (!bytes.empty())
+      std::memcpy(base + offsets[i], bytes.data(), bytes.size());
+  }
+
+  auto address = [&](u32 index) -> u64 {
+    const assembler::Symbol &sym = obj.symbols_[index];
+    if (sym.section_ != SectionId::Undefined) {
+      return reinterpret_cast<u64>(base) +
+             offsets[static_cast<u64>(sym.section_)] + sym.value_;
+    }
+
+    void *found = dlsym(RTLD_DEFAULT, sym.name_.c_str());
+    if (!found)
+      error("undefined symbol: %s", sym.name_.c_str());
+    return reinterpret_cast<u64>(found);
+  };
+
+  for (u32 i = 0; i < obj.symbols_.size(); ++i) {
+    if (!stub[i])
+      continue;
+    u64 target = address(i);
+    std::memcpy(base + stub[i], kStub, sizeof(kStub));
+    std::memcpy(base + stub[i] + sizeof(kStub), &target, sizeof(target));
+  }
+
+  for (const auto &rel : obj.relocations_) {
+    u8 *field = base + offsets[static_cast<u64>(rel.section_)] + rel.offset_;
+    u64 target = stub[rel.symbol_]
+                     ? reinterpret_cast<u64>(base) + stub[rel.symbol_]
+                     : address(rel.symbol_);
+    i64 value = target + rel.addend_ - reinterpret_cast<u64>(field);
+    if (value < INT32_MIN || value > INT32_MAX) {
+      error("%s is out of reach of 32-bit relocations",
+            obj.symbols_[rel.symbol_].name_.c_str());
+    }
+    i32 rel32 = static_cast<i32>(value);
+    std::memcpy(field, &rel32, sizeof(rel32));
+  }
+
+  if (mprotect(base, align_to(code_size, page), PROT_READ | PROT_EXEC))
+    error("cannot make code executable: %s", strerror(errno));
+
+  u32 main_index = 0;
+  while (main_index < obj.symbols_.size() &&
+         (obj.symbols_[main_index].name_ != "main" ||
+          obj.symbols_[main_index].section_ != SectionId::Text))
+    ++main_index;
+  if (main_index == obj.symbols_.size())
+    error("no main function");
+
+  auto main_fn = reinterpret_cast<int (*)(int, char **)>(address(main_index));
+  int status = main_fn(argc, argv);
+  munmap(mapping, size);
+  return status;
+}
+
+} // namespace jit
@@ -0,0 +1,19 @@
+#ifndef _ASMLAI_JIT_H
+#define _ASMLAI_JIT_H
+
+#include "assembler.h"
+
+// Runs assembled code in process. Sections are copied into fresh mappings,
+// relocations are applied against their final addresses and calls to
+// functions the object doesn't define go to whatever the running process
+// finds under that name, usually libc.
+namespace jit {
+
+// loads obj, calls its main with argv and returns what main returned. Throws
+// diag::CompileError when obj can't be loaded, e.g. a symbol can't be resolved
+// or there is no main.
+int run(const assembler::Object &obj, int argc, char **argv);
+
+} // namespace jit
+
+#endif
@@ -1,25 +1,73 @@
+#include "arena.h"
+#include "assembler.h"
+#include "cache.h"
 #include "codegen.h"
+#include "diag.h"
+#include "elf.h"
+#include "jit.h"
+#include "output.h"
 #include "parser.h"
+#include "pch.h"
+#include "preprocess.h"
+#include "server.h"
+#include "source.h"
+#include "stats.h"
 #include "token.h"
+#include "typesystem.h"
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
 #include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
 
-parser::Type *parser::default_int = new parser::Type(
-    parser::Types::Int, parser::kNumberSize, parser::kNumberSize);
-parser::Type *parser::default_empty = new parser::Type(parser::Types::Empty, 0);
-parser::Type *parser::default_void =
-    new parser::Type(parser::Types::Void, 1, 1);
-parser::Type *parser::default_long =
-    new parser::Type(parser::Types::Long, parser::kLongSize, parser::kLongSize);
-parser::Scope *parser::scopes = new parser::Scope();
+parser::Type *parser::default_int = typesystem::int_type();
+parser::Type *parser::default_empty = typesystem::empty_type();
+parser::Type *parser::default_void = typesystem::void_type();
+parser::Type *parser::default_long = typesystem::long_type();
+thread_local parser::Scope *parser::scopes = nullptr;
 
-static char *input_path;
+static std::vector<char *> input_paths;
 static char *o_opt;
+static bool mem_report;
+enum class TimeReport {
+  None,
+  Table,
+  Json,
+};
+static TimeReport time_report = TimeReport::None;
+static bool c_opt;
+static bool run_opt;
+static u64 jobs = 1;
+// threads each compilation may generate code on, see main.
+static u64 codegen_threads = 1;
+static char *server_path;
+static const char *cache_dir = std::getenv("ASMLAI_CACHE_DIR");
+static preprocess::Options pp_options;
+static bool emit_pch;
+static char *include_pch;
 static void usage(int status) {
-  std::fprintf(stderr, "asmlai [ -o <path> ] <file>\n");
+  std::fprintf(stderr, "asmlai [ -c | --run | --emit-pch ] [ -o <path> ] "
+                       "[ -j <jobs> ] [ -I <dir> ] [ -D <name>[=<value>] ]\n"
+                       "       [ --include-pch <file> ] [ --cache-dir <dir> ] "
+                       "[ -fmem-report ]\n"
+                       "       [ -ftime-report[=json] ] <file>...\n"
+                       "asmlai --server <socket>\n");
   std::exit(status);
 }
 
+static u64 parse_jobs(const char *arg) {
+  char *end;
+  long n = std::strtol(arg, &end, 10);
+  if (*arg == '\0' || *end != '\0' || n < 1) {
+    std::fprintf(stderr, "invalid job count: %s\n", arg);
+    std::exit(1);
+  }
+  return n;
+}
+
 static void parse_cmd_args(int argc, char **argv) {
   for (int i = 1; i < argc; ++i) {
     if (!strcmp(argv[i], "--help"))
@@ -32,51 +80,402 @@ static void parse_cmd_args(int argc, char **argv) {
       continue;
     }
 
+    if (!strcmp(argv[i], "-j")) {
+      if (!argv[++i])
+        usage(1);
+      jobs = parse_jobs(argv[i]);
+      continue;
+    }
+
+    if (!strcmp(argv[i], "-I")) {
+      if (!argv[++i])
+        usage(1);
+      pp_options.include_paths_.push_back(argv[i]);
+      continue;
+    }
+
+    if (!strcmp(argv[i], "-D")) {
+      if (!argv[++i])
+        usage(1);
+      pp_options.defines_.push_back(argv[i]);
+      continue;
+    }
+
+    if (!strcmp(argv[i], "--include-pch")) {
+      if (!argv[++i])
+        usage(1);
+      include_pch = argv[i];
+      continue;
+    }
+
+    if (!strcmp(argv[i], "--server")) {
+      if (!argv[++i])
+        usage(1);
+      server_path = argv[i];
+      continue;
+    }
+
+    if (!strcmp(argv[i], "--cache-dir")) {
+      if (!argv[++i])
+        usage(1);
+      cache_dir = argv[i];
+      continue;
+    }
+
+    if (!strcmp(argv[i], "-c")) {
+      c_opt = true;
+      continue;
+    }
+
+    if (!strcmp(argv[i], "--run")) {
+      run_opt = true;
+      continue;
+    }
+
+    if (!strcmp(argv[i], "--emit-pch")) {
+      emit_pch = true;
+      continue;
+    }
+
+    if (!strcmp(argv[i], "-fmem-report")) {
+      mem_report = true;
+      continue;
+    }
+
+    if (!strcmp(argv[i], "-ftime-report")) {
+      time_report = TimeReport::Table;
+      stats::tracking = true;
+      continue;
+    }
+
+    if (!strcmp(argv[i], "-ftime-report=json")) {
+      time_report = TimeReport::Json;
+      stats::tracking = true;
+      continue;
+    }
+
     if (!strncmp(argv[i], "-o", 2)) {
       o_opt = argv[i] + 2;
       continue;
     }
 
+    if (!strncmp(argv[i], "-j", 2)) {
+      jobs = parse_jobs(argv[i] + 2);
+      continue;
+    }
+
+    if (!strncmp(argv[i], "-I", 2)) {
+      pp_options.include_paths_.push_back(argv[i] + 2);
+      continue;
+    }
+
+    if (!strncmp(argv[i], "-D", 2)) {
+      pp_options.defines_.push_back(argv[i] + 2);
+      continue;
+    }
+
     if (argv[i][0] == '-' && argv[i][1] != '\0') {
       std::fprintf(stderr, "unknown argument: %s", argv[i]);
       std::exit(1);
     }
 
-    input_path = argv[i];
+    input_paths.push_back(argv[i]);
   }
 
-  if (!input_path) {
+  if (input_paths.empty() && !server_path) {
     std::fprintf(stderr, "no input files.");
     std::exit(1);
   }
+
+  if (emit_pch && (c_opt || run_opt)) {
+    std::fprintf(stderr, "cannot use --emit-pch with -c or --run.\n");
+    std::exit(1);
+  }
+
+  if (input_paths.size() > 1) {
+    if (o_opt) {
+      std::fprintf(stderr, "cannot use -o with multiple input files.\n");
+      std::exit(1);
+    }
+    if (run_opt) {
+      std::fprintf(stderr, "cannot use --run with multiple input files.\n");
+      std::exit(1);
+    }
+    for (const char *path : input_paths) {
+      if (!strcmp(path, "-")) {
+        std::fprintf(stderr, "cannot read stdin with multiple input files.\n");
+        std::exit(1);
+      }
+    }
+  }
 }
 
-static FILE *open_file(char *path) {
-  if (!path || strcmp(path, "-") == 0)
-    return stdout;
+// output of one of several inputs: its file name in the current directory
+// with the extension replaced, like cc -S and cc -c do.
+static std::string output_path(const char *input_path) {
+  std::string path = input_path;
+  u64 slash = path.rfind('/');
+  if (slash != std::string::npos)
+    path.erase(0, slash + 1);
+  u64 dot = path.rfind('.');
+  if (dot != std::string::npos && dot != 0)
+    path.erase(dot);
+  return path + (emit_pch ? ".pch" : c_opt ? ".o" : ".s");
+}
 
-  FILE *out = std::fopen(path, "w");
-  if (!out) {
-    std::fprintf(stderr, "cannot open output file: %s: %s", path,
-                 strerror(errno));
-    std::exit(1);
+struct PhaseMemory {
+  const char *name_;
+  u64 bytes_;
+  u64 count_;
+};
+
+static void print_mem_report(const std::vector<PhaseMemory> &phases,
+                             const arena::Arena &arena,
+                             const token::TokenStream &tokens) {
+  std::fprintf(stderr, "arena usage:\n");
+  for (const auto &phase : phases) {
+    std::fprintf(stderr, "  %-10s %12lu bytes %10lu allocations\n",
+                 phase.name_, phase.bytes_, phase.count_);
+  }
+  std::fprintf(stderr, "  %-10s %12lu bytes %10lu allocations\n", "total",
+               arena.bytes_allocated(), arena.allocation_count());
+  std::fprintf(stderr, "  %-10s %12lu bytes\n", "reserved",
+               arena.bytes_reserved());
+  std::fprintf(stderr, "tokens: %lu, lookahead %lu slots, %lu bytes\n",
+               tokens.lexed(), tokens.capacity(), tokens.bytes_reserved());
+  std::fprintf(stderr, "headers: %lu\n", tokens.headers());
+}
+
+// diagnostics and mem reports of inputs compiled at the same time don't
+// interleave.
+static std::mutex report_mutex;
+
+enum class Mode {
+  Assembly,
+  Object,
+  Run,
+  // a precompiled header instead of code.
+  Header,
+};
+
+static Mode mode() {
+  if (emit_pch)
+    return Mode::Header;
+  return run_opt ? Mode::Run : c_opt ? Mode::Object : Mode::Assembly;
+}
+
+// compiles one translation unit into out, from source when it isn't null and
+// from the file at input_path otherwise, preprocessed with options and the
+// precompiled header pch when it isn't null. The return value is the exit
+// status, errors are thrown as diag::CompileError. The number of headers read
+// goes to *headers when it isn't null.
+static int compile(char *input_path, char *source, Mode mode,
+                   const preprocess::Options &options, char *pch,
+                   output::Writer &out, u64 *headers = nullptr) {
+  // everything the front end allocates lives until the end of compilation, so
+  // it all goes into one arena that is released at once.
+  arena::Arena ast_arena;
+  arena::current = &ast_arena;
+  struct Cleanup {
+    ~Cleanup() {
+      typesystem::reset_types();
+      arena::current = nullptr;
+    }
+  } cleanup;
+
+  stats::Timer timer(ast_arena);
+  std::vector<PhaseMemory> phases;
+  auto phase_done = [&](const char *name) {
+    u64 bytes = ast_arena.bytes_allocated();
+    u64 count = ast_arena.allocation_count();
+    for (const auto &phase : phases) {
+      bytes -= phase.bytes_;
+      count -= phase.count_;
+    }
+    phases.push_back(PhaseMemory{name, bytes, count});
+  };
+
+  // tokens are lexed as the parser pulls them, so lexing counts as parsing.
+  // Macros from a precompiled header point into its mapping, so it's kept
+  // until the tokens are gone.
+  pch::Prelude prelude;
+  auto tokens = source
+                    ? token::tokenize_input(input_path, source, options)
+                    : token::tokenize_path(input_path, options);
+  if (pch)
+    prelude.load(pch, tokens.preprocessor());
+  timer.phase_done("load");
+  parser::scopes = arena::make<parser::Scope>();
+  auto functions =
+      parser::parse_tokens(tokens, pch ? &prelude.scope() : nullptr);
+  phase_done("parse");
+  timer.phase_done("parse");
+
+  assembler::Object obj;
+  if (mode == Mode::Header) {
+    pch::write(tokens.preprocessor(), parser::file_scope(), out);
+    timer.phase_done("write");
+  } else {
+    codegen::assign_lvar_offsets(functions);
+    timer.phase_done("offsets");
+    if (mode == Mode::Assembly) {
+      out.print(".file 1 \"", input_path, "\"");
+      codegen::gen_code(std::move(functions), out, codegen_threads);
+      timer.phase_done("codegen");
+    } else {
+      // the assembly is kept in memory and assembled right here.
+      output::Writer text;
+      codegen::gen_code(std::move(functions), text, codegen_threads);
+      timer.phase_done("codegen");
+      obj = assembler::assemble(text.text());
+      if (mode == Mode::Object)
+        elf::write_object(obj, out);
+      timer.phase_done("assemble");
+    }
+  }
+  phase_done("codegen");
+  if (headers)
+    *headers = tokens.headers();
+
+  if (mem_report) {
+    std::lock_guard<std::mutex> lock(report_mutex);
+    if (input_paths.size() > 1)
+      std::fprintf(stderr, "%s:\n", input_path);
+    print_mem_report(phases, ast_arena, tokens);
   }
-  return out;
+
+  if (time_report != TimeReport::None) {
+    std::lock_guard<std::mutex> lock(report_mutex);
+    if (time_report == TimeReport::Json)
+      timer.print_json(stderr, input_path);
+    else
+      timer.print_table(stderr, input_path);
+  }
+
+  if (mode == Mode::Run) {
+    char *program_argv[] = {input_path, nullptr};
+    return jit::run(obj, 1, program_argv);
+  }
+
+  return EXIT_SUCCESS;
+}
+
+// compiles input_path into out through the cache: the input is read and
+// hashed up front, and on a hit the stored output is all there is to do.
+static int compile_cached(char *input_path, output::Writer &out) {
+  source::File input = source::load(input_path);
+  struct Unload {
+    source::File &file_;
+    ~Unload() { source::unload(file_); }
+  } unload{input};
+
+  // assembly names its input in the .file directive.
+  std::string options = mode() == Mode::Object ? "obj" : "asm ";
+  if (mode() == Mode::Assembly)
+    options += input_path;
+  for (const std::string &def : pp_options.defines_)
+    options += " -D" + def;
+  for (const std::string &dir : pp_options.include_paths_)
+    options += " -I" + dir;
+  cache::Key key =
+      cache::key_of(std::string_view(input.contents_, input.size_), options);
+  if (cache::lookup(cache_dir, key, out))
+    return EXIT_SUCCESS;
+
+  output::Writer text;
+  u64 headers = 0;
+  int status = compile(input_path, input.contents_, mode(), pp_options,
+                       nullptr, text, &headers);
+  // the key only covers the input itself, so what depends on headers that
+  // may change isn't kept.
+  if (headers == 0)
+    cache::store(cache_dir, key, text.text());
+  out.put(text.text());
+  return status;
+}
+
+// compiles input_path to the file at output_path and prints any error.
+static int compile_file(char *input_path, const char *output_path) {
+  int fd = -1;
+  int status = EXIT_FAILURE;
+  auto fail = [&](const std::string &message) {
+    status = EXIT_FAILURE;
+    std::lock_guard<std::mutex> lock(report_mutex);
+    std::fprintf(stderr, "%s\n", message.c_str());
+    // don't leave a truncated output behind.
+    if (fd >= 0 && fd != STDOUT_FILENO)
+      unlink(output_path);
+  };
+  try {
+    fd = output::open_output(output_path);
+    output::Writer out(fd);
+    // a precompiled header records when its inputs changed, which the cache
+    // key doesn't cover, whether it's written or read.
+    if (cache_dir && mode() != Mode::Run && mode() != Mode::Header &&
+        !include_pch)
+      status = compile_cached(input_path, out);
+    else
+      status =
+          compile(input_path, nullptr, mode(), pp_options, include_pch, out);
+    out.flush();
+  } catch (const diag::CompileError &e) {
+    fail(e.what());
+  } catch (const std::exception &e) {
+    // anything else, like running out of memory, fails this input alone and
+    // other files compiled at the same time go on.
+    fail(std::string(input_path) + ": internal error: " + e.what());
+  }
+  if (fd >= 0)
+    output::close_output(fd);
+  return status;
+}
+
+static void serve_request(server::Request &request, output::Writer &out) {
+  char *name = request.path_.empty() ? request.name_.data()
+                                     : request.path_.data();
+  char *source = request.path_.empty() ? request.source_.data() : nullptr;
+  char *pch = request.pch_.empty() ? nullptr : request.pch_.data();
+  compile(name, source, request.object_ ? Mode::Object : Mode::Assembly,
+          request.options_, pch, out);
 }
 
 int main(int argc, char **argv) {
   parse_cmd_args(argc, argv);
 
-  auto tokens = token::tokenize_path(input_path);
+  // the cores are shared out between the files compiled at once, so -j
+  // doesn't multiply the threads. The server compiles one request at a time.
+  u64 cores = std::max(1u, std::thread::hardware_concurrency());
+  u64 parallel =
+      server_path ? 1 : std::clamp<u64>(jobs, 1, input_paths.size());
+  codegen_threads = std::max<u64>(cores / parallel, 1);
 
-  auto functions = parser::parse_tokens(tokens);
-  FILE *out = open_file(o_opt);
-  fprintf(out, ".file 1 \"%s\"\n", input_path);
-  codegen::gen_code(std::move(functions), out);
+  if (server_path)
+    server::serve(server_path, serve_request);
 
-  delete parser::default_int;
-  delete parser::default_empty;
-  delete parser::default_void;
+  if (input_paths.size() == 1)
+    return compile_file(input_paths[0], o_opt);
 
-  return EXIT_SUCCESS;
+  // inputs are handed out to the workers in order, a worker takes the next
+  // one as soon as it is done with its last.
+  std::vector<std::string> outputs;
+  for (const char *path : input_paths)
+    outputs.push_back(output_path(path));
+
+  std::atomic<u64> next{0};
+  std::atomic<int> status{EXIT_SUCCESS};
+  auto work = [&] {
+    for (u64 i = next++; i < input_paths.size(); i = next++) {
+      if (compile_file(input_paths[i], outputs[i].c_str()) != EXIT_SUCCESS)
+        status = EXIT_FAILURE;
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (u64 t = 1; t < std::min<u64>(jobs, input_paths.size()); ++t)
+    workers.emplace_back(work);
+  work();
+  for (auto &worker : workers)
+    worker.join();
+
+  return status;
 }
@@ -0,0 +1,107 @@
+#include "output.h"
+#include "diag.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace output {
+
+template <typename... Args>
+[[noreturn]] static void error(const char *format_string, Args... args) {
+  diag::fail(format_string, args...);
+}
+
+Writer::Writer(int fd)
+    : fd_(fd), buffer_(static_cast<char *>(std::malloc(kCapacity))) {}
+
+Writer::Writer() : Writer(-1) {}
+
+Writer::~Writer() {
+  // a failed write has already been reported or is on its way out as an
+  // exception, destructors mustn't throw.
+  try {
+    flush();
+  } catch (const diag::CompileError &) {
+  }
+  std::free(buffer_);
+}
+
+u64 Writer::format_int(char *out, i64 value) {
+  char digits[kMaxDigits];
+  // work on the magnitude as unsigned so the most negative value is fine.
+  u64 magnitude = value < 0 ? 0 - static_cast<u64>(value) : value;
+  u64 n = 0;
+  do {
+    digits[n++] = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude);
+
+  u64 len = 0;
+  if (value < 0)
+    out[len++] = '-';
+  while (n)
+    out[len++] = digits[--n];
+  return len;
+}
+
+void Writer::make_room(u64 size) {
+  if (fd_ < 0) {
+    while (size_ + size > capacity_)
+      capacity_ *= 2;
+    buffer_ = static_cast<char *>(std::realloc(buffer_, capacity_));
+    return;
+  }
+
+  flush();
+}
+
+// a piece that doesn't fit what is left of the buffer. Pieces bigger than the
+// whole buffer, like a cached output, go straight to the file.
+void Writer::put_large(std::string_view s) {
+  make_room(s.size());
+  if (size_ + s.size() > capacity_)
+    return write_out(s.data(), s.size());
+  std::memcpy(buffer_ + size_, s.data(), s.size());
+  size_ += s.size();
+}
+
+void Writer::write_out(const char *p, u64 left) {
+  while (left) {
+    ssize_t n = write(fd_, p, left);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      error("cannot write output: %s", strerror(errno));
+    }
+    p += n;
+    left -= n;
+  }
+}
+
+void Writer::flush() {
+  if (fd_ < 0)
+    return;
+
+  write_out(buffer_, size_);
+  size_ = 0;
+}
+
+int open_output(const char *path) {
+  if (!path || std::strcmp(path, "-") == 0)
+    return STDOUT_FILENO;
+
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    error("cannot open output file: %s: %s", path, strerror(errno));
+  return fd;
+}
+
+void close_output(int fd) {
+  if (fd != STDOUT_FILENO)
+    close(fd);
+}
+
+} // namespace output
@@ -0,0 +1,77 @@
+#ifndef _ASMLAI_OUTPUT_H
+#define _ASMLAI_OUTPUT_H
+
+#include "types.h"
+#include <cstring>
+#include <string_view>
+
+// Buffered output for the generated assembly. Text is appended to a large
+// buffer that goes out with write(2) when it fills up, so a translation unit
+// is written with a handful of system calls and no format string is parsed.
+// A writer without a file keeps everything in memory instead, for text that
+// is assembled in process.
+namespace output {
+
+class Writer {
+public:
+  explicit Writer(int fd);
+  Writer();
+  ~Writer();
+  Writer(const Writer &) = delete;
+  Writer &operator=(const Writer &) = delete;
+
+  void put(std::string_view s) {
+    if (size_ + s.size() > capacity_)
+      return put_large(s);
+    std::memcpy(buffer_ + size_, s.data(), s.size());
+    size_ += s.size();
+  }
+
+  void put(i64 value) {
+    if (size_ + kMaxDigits > capacity_)
+      make_room(kMaxDigits);
+    size_ += format_int(buffer_ + size_, value);
+  }
+
+  // an instruction: indented and on a line of its own.
+  template <typename... Args> void emit(const Args &...pieces) {
+    put("  ");
+    (put(pieces), ...);
+    put("\n");
+  }
+
+  // a line without indentation, labels and the like.
+  template <typename... Args> void print(const Args &...pieces) {
+    (put(pieces), ...);
+    put("\n");
+  }
+
+  // writes out the buffer, does nothing for an in-memory writer.
+  void flush();
+  // everything written so far, only complete for an in-memory writer.
+  std::string_view text() const { return std::string_view(buffer_, size_); }
+
+private:
+  static constexpr u64 kCapacity = 1 << 20;
+  // "-9223372036854775808"
+  static constexpr u64 kMaxDigits = 20;
+
+  static u64 format_int(char *out, i64 value);
+  void make_room(u64 size);
+  void put_large(std::string_view s);
+  void write_out(const char *p, u64 size);
+
+  int fd_;
+  u64 capacity_ = kCapacity;
+  char *buffer_;
+  u64 size_ = 0;
+};
+
+// opens path for writing, "-" or nullptr is stdout. Exits when it can't.
+int open_output(const char *path);
+// closes a file from open_output, stdout is left open.
+void close_output(int fd);
+
+} // namespace output
+
+#endif
@@ -1,7 +1,11 @@
 #include "parser.h"
+#include "arena.h"
 #include "codegen.h"
+#include "diag.h"
+#include "intern.h"
 #include "token.h"
 #include "typesystem.h"
+#include <algorithm>
 #include <cstddef>
 #include <cstdio>
 #include <cstdlib>
@@ -13,33 +17,49 @@
 #include <variant>
 
 namespace parser {
-template <typename... Args> static void error(const char *fmt, Args... args) {
-  std::fprintf(stderr, fmt, args...);
-  std::fprintf(stderr, "\n");
-  std::exit(1);
-}
-
-static std::vector<std::shared_ptr<Object>> locals_;
-static std::vector<std::shared_ptr<Object>> globals_;
-static std::shared_ptr<Object> current_function_ = nullptr;
-
-using TokenList = std::vector<token::Token>;
+template <typename... Args>
+[[noreturn]] static void error(const char *fmt, Args... args) {
+  diag::fail(fmt, args...);
+}
+
+// parser state is per thread, every thread parses one file at a time.
+static thread_local std::vector<std::shared_ptr<Object>> locals_;
+static thread_local std::vector<std::shared_ptr<Object>> globals_;
+// statement expressions being parsed. The expression around one may still
+// look back at its own tokens, so statements inside it don't discard any.
+static thread_local u32 stmt_expr_depth_ = 0;
+static thread_local std::shared_ptr<Object> current_function_ = nullptr;
+static thread_local int unique_id_ = 0;
+
+using TokenStream = token::TokenStream;
+using TokenKind = token::TokenKind;
 static NodePtr new_node(NodeType type_) {
-  auto node = std::make_unique<Node>();
+  auto node = arena::make<Node>();
   node->type_ = type_;
 
   return node;
 }
 
-static char *new_unique() {
-  static int L_id = 0;
-  char *buffer = (char *)malloc(20 * sizeof(char));
-  sprintf(buffer, ".L..%d", L_id++);
-  return buffer;
+static intern::Symbol new_unique() {
+  char buffer[20];
+  int len = snprintf(buffer, sizeof(buffer), ".L..%d", unique_id_++);
+  return intern::intern(buffer, len);
+}
+
+// innermost visible binding of each symbol, indexed by the symbol itself.
+static thread_local std::vector<VarScope *> var_bindings_;
+static thread_local std::vector<TagScope *> tag_bindings_;
+
+template <typename T>
+static T *&binding_of(std::vector<T *> &bindings, intern::Symbol sym) {
+  if (sym >= bindings.size()) {
+    bindings.resize(intern::symbol_count() + 1, nullptr);
+  }
+  return bindings[sym];
 }
 
-static void enter_scope() {
-  Scope *n = new Scope();
+void enter_scope() {
+  Scope *n = arena::make<Scope>();
   n->next_ = scopes;
   scopes = n;
 }
@@ -107,7 +127,18 @@ static i64 evaluate_constexpr(Node &n) {
   return 0;
 }
 
-static void leave_scope() { scopes = scopes->next_; }
+void leave_scope() {
+  for (auto it = scopes->variables_.rbegin(); it != scopes->variables_.rend();
+       ++it) {
+    var_bindings_[*it] = var_bindings_[*it]->next_;
+  }
+
+  for (auto it = scopes->tags_.rbegin(); it != scopes->tags_.rend(); ++it) {
+    tag_bindings_[*it] = tag_bindings_[*it]->next;
+  }
+
+  scopes = scopes->next_;
+}
 
 static bool is_enum_varscope(const VarScope &var) {
   return var.data_.index() == 0;
@@ -115,33 +146,25 @@ static bool is_enum_varscope(const VarScope &var) {
 
 // we cannot return a reference, since it can also be null. So instead return a
 // pointer.
-static VarScope *find_var(const token::Token &tok) {
-  for (Scope *sc = scopes; sc; sc = sc->next_) {
-    for (auto &v : sc->variables_) {
-      if (tok == v.name_) {
-        return &v;
-      }
-    }
-  }
+VarScope *find_var(const token::Token &tok) {
+  if (tok.sym_ >= var_bindings_.size())
+    return nullptr;
 
-  return nullptr;
+  return var_bindings_[tok.sym_];
 }
 
 static Type *find_tag(const token::Token &tok) {
-  for (Scope *sc = scopes; sc; sc = sc->next_) {
-    for (const auto &t : sc->tags_) {
-      if (tok == t.name)
-        return t.ty;
-    }
-  }
-  return nullptr;
+  if (tok.sym_ >= tag_bindings_.size())
+    return nullptr;
+
+  TagScope *tag = tag_bindings_[tok.sym_];
+  return tag ? tag->ty : nullptr;
 }
 
 static NodePtr new_cast(NodePtr expr, Type *ty) {
   typesystem::add_type(*expr);
 
-  auto node = std::make_unique<Node>();
-  node->type_ = NodeType::Cast;
+  auto node = new_node(NodeType::Cast);
   node->lhs_ = std::move(expr);
   node->tt_ = ty;
 
@@ -149,15 +172,18 @@ static NodePtr new_cast(NodePtr expr, Type *ty) {
 }
 
 static void push_tag(const token::Token &tok, Type *type) {
-  TagScope tag{};
-  tag.name = strndup(tok.loc_, tok.len_);
-  tag.ty = type;
+  TagScope *tag = arena::make<TagScope>();
+  tag->name = tok.sym_;
+  tag->ty = type;
 
-  scopes->tags_.push_back(std::move(tag));
+  TagScope *&head = binding_of(tag_bindings_, tag->name);
+  tag->next = head;
+  head = tag;
+  scopes->tags_.push_back(tag->name);
 }
 
-static bool consume(const TokenList &tokens, u64 &pos, const char *str) {
-  if (tokens[pos] == str) {
+static bool consume(TokenStream &tokens, u64 &pos, TokenKind kind) {
+  if (tokens[pos] == kind) {
     ++pos;
     return true;
   }
@@ -165,15 +191,19 @@ static bool consume(const TokenList &tokens, u64 &pos, const char *str) {
   return false;
 }
 
-// return the index of the variable in the scope, such that we can edit it
-// without having to use pointers for VarScopes.
-static u64 push_scope(char *name, std::shared_ptr<Object> variable) {
-  VarScope vscope;
-  vscope.name_ = name;
-  vscope.variable_ = variable;
-  scopes->variables_.push_back(std::move(vscope));
+// bindings live in the arena, so the returned pointer stays valid even after
+// the scope has been left.
+VarScope *push_scope(intern::Symbol name, std::shared_ptr<Object> variable) {
+  VarScope *vscope = arena::make<VarScope>();
+  vscope->name_ = name;
+  vscope->variable_ = std::move(variable);
+
+  VarScope *&head = binding_of(var_bindings_, name);
+  vscope->next_ = head;
+  head = vscope;
+  scopes->variables_.push_back(name);
 
-  return scopes->variables_.size() - 1;
+  return vscope;
 }
 
 static void push_tag_scope(const token::Token &tok, Type *type) {}
@@ -206,15 +236,15 @@ static NodePtr new_number(i64 value) {
   return node;
 }
 
-static char *get_identifier(const token::Token &tok) {
-  if (tok.type_ != token::TokenType::Identifier) {
+static intern::Symbol get_identifier(const token::Token &tok) {
+  if (tok.kind_ != TokenKind::Identifier) {
     error("expected an identifier");
   }
 
-  return strndup(tok.loc_, tok.len_);
+  return tok.sym_;
 }
 
-static std::shared_ptr<Object> new_var(char *name, Type *ty) {
+static std::shared_ptr<Object> new_var(intern::Symbol name, Type *ty) {
   std::shared_ptr<Object> obj = std::make_shared<Object>(name, 0);
   obj->is_local_ = false;
   obj->ty_ = ty;
@@ -225,7 +255,7 @@ static std::shared_ptr<Object> new_var(char *name, Type *ty) {
 
 // it needs to be a pointer so that we can change the offset stored in the
 // object more easily
-static std::shared_ptr<Object> new_lvar(char *name, Type *ty) {
+static std::shared_ptr<Object> new_lvar(intern::Symbol name, Type *ty) {
   auto obj = new_var(name, ty);
   obj->is_local_ = true;
   obj->ty_ = ty;
@@ -234,7 +264,7 @@ static std::shared_ptr<Object> new_lvar(char *name, Type *ty) {
   return obj;
 }
 
-static std::shared_ptr<Object> new_gvar(char *name, Type *ty) {
+static std::shared_ptr<Object> new_gvar(intern::Symbol name, Type *ty) {
   auto obj = new_var(name, ty);
   obj->is_local_ = false;
   obj->ty_ = ty;
@@ -254,8 +284,17 @@ static std::shared_ptr<Object> new_string_literal(char *p, Type *ty) {
   return var;
 }
 
-static void skip_until(const TokenList &tokens, const char *tok, u64 &pos) {
-  while (!(tokens[pos] == tok)) {
+// whether the token at pos isn't kind yet. The input ending before kind shows
+// up is an error, so loops looking for it always stop.
+static bool before(TokenStream &tokens, u64 pos, TokenKind kind) {
+  TokenKind at = tokens.kind(pos);
+  if (at == TokenKind::Eof && kind != TokenKind::Eof)
+    error("unexpected end of file");
+  return at != kind;
+}
+
+static void skip_until(TokenStream &tokens, TokenKind kind, u64 &pos) {
+  while (before(tokens, pos, kind)) {
     ++pos;
   }
   ++pos; // skip the wanted token
@@ -318,7 +357,7 @@ static NodePtr new_subtraction(NodePtr lhs_, NodePtr rhs_) {
   if (lhs->tt_->base_type_ != nullptr && rhs->tt_->base_type_ != nullptr) {
     i32 size = lhs->tt_->size_;
     auto n = new_binary_node(NodeType::Sub, std::move(lhs), std::move(rhs));
-    n->tt_ = new parser::Type(Types::Int, kNumberSize);
+    n->tt_ = typesystem::int_type();
     return new_binary_node(NodeType::Div, std::move(n), new_number(size));
   }
 
@@ -326,54 +365,54 @@ static NodePtr new_subtraction(NodePtr lhs_, NodePtr rhs_) {
   return nullptr;
 }
 
-static NodePtr parse_compound_stmt(const TokenList &, u64 &);
-static NodePtr parse_expression(const TokenList &, u64 &);
-static NodePtr parse_equal(const TokenList &, u64 &);
-static NodePtr parse_mul(const TokenList &, u64 &);
-static NodePtr parse_add(const TokenList &, u64 &);
-static NodePtr parse_shift(const TokenList &, u64 &);
-static NodePtr parse_unary(const TokenList &, u64 &);
-static NodePtr parse_primary(const TokenList &, u64 &);
-static NodePtr parse_relational(const TokenList &, u64 &);
-static NodePtr parse_assign(const TokenList &, u64 &);
-static NodePtr parse_postfix(const TokenList &, u64 &);
-static NodePtr bit_and(const TokenList &, u64 &);
-static NodePtr bit_or(const TokenList &, u64 &);
-static NodePtr bit_xor(const TokenList &, u64 &);
-static NodePtr log_and(const TokenList &, u64 &);
-static NodePtr log_or(const TokenList &, u64 &);
-static Type *parse_struct_declaration(const TokenList &, u64 &);
-static Type *parse_union_declaration(const TokenList &, u64 &);
-static Type *struct_union(const TokenList &tokens, u64 &pos);
-static Type *type_suffix(const TokenList &tokens, u64 &pos, Type *ty);
-static Type *declarator(const TokenList &tokens, u64 &pos, Type *ty);
-static Type *decl_type(const TokenList &tokens, u64 &pos,
-                       VariableAttributes *attr);
-static Type *enum_declaration(const TokenList &tokens, u64 &pos);
-
-static i64 const_expr(const TokenList &tokens, u64 &pos);
-
-static NodePtr parse_expr_stmt(const TokenList &tokens, u64 &pos) {
-  if (tokens[pos] == ";") { // encountered a empty statement
+static NodePtr parse_compound_stmt(TokenStream &, u64 &);
+static NodePtr parse_expression(TokenStream &, u64 &);
+static NodePtr parse_equal(TokenStream &, u64 &);
+static NodePtr parse_mul(TokenStream &, u64 &);
+static NodePtr parse_add(TokenStream &, u64 &);
+static NodePtr parse_shift(TokenStream &, u64 &);
+static NodePtr parse_unary(TokenStream &, u64 &);
+static NodePtr parse_primary(TokenStream &, u64 &);
+static NodePtr parse_relational(TokenStream &, u64 &);
+static NodePtr parse_assign(TokenStream &, u64 &);
+static NodePtr parse_postfix(TokenStream &, u64 &);
+static NodePtr bit_and(TokenStream &, u64 &);
+static NodePtr bit_or(TokenStream &, u64 &);
+static NodePtr bit_xor(TokenStream &, u64 &);
+static NodePtr log_and(TokenStream &, u64 &);
+static NodePtr log_or(TokenStream &, u64 &);
+static Type *parse_struct_declaration(TokenStream &, u64 &);
+static Type *parse_union_declaration(TokenStream &, u64 &);
+static Type *struct_union(TokenStream &tokens, u64 &pos);
+static Type *type_suffix(TokenStream &tokens, u64 &pos, Type *ty);
+static Type *declarator(TokenStream &tokens, u64 &pos, Type *ty,
+                        intern::Symbol *name);
+static Type *decl_type(TokenStream &tokens, u64 &pos, VariableAttributes *attr);
+static Type *enum_declaration(TokenStream &tokens, u64 &pos);
+
+static i64 const_expr(TokenStream &tokens, u64 &pos);
+
+static NodePtr parse_expr_stmt(TokenStream &tokens, u64 &pos) {
+  if (tokens[pos] == TokenKind::Semicolon) { // encountered a empty statement
     ++pos;
     return new_node(NodeType::Block);
   }
 
   auto node = new_single(NodeType::ExprStmt, parse_expression(tokens, pos));
-  skip_until(tokens, ";", pos);
+  skip_until(tokens, TokenKind::Semicolon, pos);
   return node;
 }
 
-static i64 get_number_value(const TokenList &tokens, u64 &pos) {
-  if (tokens[pos].type_ != token::TokenType::Num) {
+static i64 get_number_value(TokenStream &tokens, u64 &pos) {
+  if (tokens[pos].kind_ != TokenKind::Num) {
     error("expecting number");
   }
 
-  return std::get<i64>(tokens[pos].data_); // guaranteed not to fail
+  return tokens.number(pos);
 }
 
 static Type *find_typedef(const token::Token &tok) {
-  if (tok.type_ == token::TokenType::Identifier) {
+  if (tok.kind_ == TokenKind::Identifier) {
     auto tp = find_var(tok);
     if (tp) {
       return tp->typedef_;
@@ -383,17 +422,18 @@ static Type *find_typedef(const token::Token &tok) {
   return nullptr;
 }
 
-static Type *abstract_declarator(const TokenList &tokens, u64 &pos, Type *typ) {
-  while (tokens[pos] == "*") {
+static Type *abstract_declarator(TokenStream &tokens, u64 &pos, Type *typ) {
+  while (tokens[pos] == TokenKind::Star) {
     typ = typesystem::ptr_to(typ);
     ++pos;
   }
 
-  if (tokens[pos] == "(") {
+  if (tokens[pos] == TokenKind::LParen) {
     u64 original_pos = pos;
-    Type xdd(Types::Empty, 0);
-    abstract_declarator(tokens, original_pos, &xdd);
-    skip_until(tokens, ")", pos);
+    // skip over the nested declarator, it's parsed again once the suffix
+    // is known. Types are canonical, so it must not be built on a temporary.
+    abstract_declarator(tokens, original_pos, typesystem::empty_type());
+    skip_until(tokens, TokenKind::RParen, pos);
     typ = type_suffix(tokens, pos, typ);
 
     ++original_pos;
@@ -403,20 +443,29 @@ static Type *abstract_declarator(const TokenList &tokens, u64 &pos, Type *typ) {
   return type_suffix(tokens, pos, typ);
 }
 
-static Type *typename_(const TokenList &tokens, u64 &pos) {
+static Type *typename_(TokenStream &tokens, u64 &pos) {
   Type *ty = decl_type(tokens, pos, nullptr);
   return abstract_declarator(tokens, pos, ty);
 }
 
 static bool is_typename(const token::Token &tok) {
-  if (tok == "char" || tok == "int" || tok == "struct" || tok == "union" ||
-      tok == "long" || tok == "void")
+  switch (tok.kind_) {
+  case TokenKind::KwChar:
+  case TokenKind::KwShort:
+  case TokenKind::KwInt:
+  case TokenKind::KwStruct:
+  case TokenKind::KwUnion:
+  case TokenKind::KwEnum:
+  case TokenKind::KwLong:
+  case TokenKind::KwVoid:
+  case TokenKind::KwTypedef:
     return true;
-
-  return find_typedef(tok);
+  default:
+    return find_typedef(tok);
+  }
 }
 
-static Type *parse_union_declaration(const TokenList &tokens, u64 &pos) {
+static Type *parse_union_declaration(TokenStream &tokens, u64 &pos) {
   Type *ty = struct_union(tokens, pos);
   ty->type_ = Types::Union;
 
@@ -434,7 +483,7 @@ static Type *parse_union_declaration(const TokenList &tokens, u64 &pos) {
   return ty;
 }
 
-static Type *decl_type(const TokenList &tokens, u64 &pos,
+static Type *decl_type(TokenStream &tokens, u64 &pos,
                        VariableAttributes *attr) {
   enum {
     VOID = 1 << 0,
@@ -445,11 +494,11 @@ static Type *decl_type(const TokenList &tokens, u64 &pos,
     OTHER = 1 << 10,
   };
 
-  Type *ty = new Type(Types::Int, kNumberSize, kNumberSize);
+  Type *ty = typesystem::int_type();
   int counter = 0;
 
   while (is_typename(tokens[pos])) {
-    if (tokens[pos] == "typedef") {
+    if (tokens[pos] == TokenKind::KwTypedef) {
       if (!attr)
         error("storage class specifier is not allowed in this context");
       attr->is_typedef_ = true;
@@ -459,18 +508,19 @@ static Type *decl_type(const TokenList &tokens, u64 &pos,
     }
 
     Type *ty2 = find_typedef(tokens[pos]);
-    if (tokens[pos] == "struct" || tokens[pos] == "union" ||
-        tokens[pos] == "enum" || ty2) {
+    if (tokens[pos] == TokenKind::KwStruct ||
+        tokens[pos] == TokenKind::KwUnion ||
+        tokens[pos] == TokenKind::KwEnum || ty2) {
       if (counter)
         break;
 
-      if (tokens[pos] == "struct") {
+      if (tokens[pos] == TokenKind::KwStruct) {
         ++pos;
         ty = parse_struct_declaration(tokens, pos);
-      } else if (tokens[pos] == "union") {
+      } else if (tokens[pos] == TokenKind::KwUnion) {
         ++pos;
         ty = parse_union_declaration(tokens, pos);
-      } else if (tokens[pos] == "enum") {
+      } else if (tokens[pos] == TokenKind::KwEnum) {
         ++pos;
         ty = enum_declaration(tokens, pos);
       } else {
@@ -482,38 +532,38 @@ static Type *decl_type(const TokenList &tokens, u64 &pos,
       continue;
     }
 
-    if (tokens[pos] == "void")
+    if (tokens[pos] == TokenKind::KwVoid)
       counter += VOID;
-    else if (tokens[pos] == "char")
+    else if (tokens[pos] == TokenKind::KwChar)
       counter += CHAR;
-    else if (tokens[pos] == "short")
+    else if (tokens[pos] == TokenKind::KwShort)
       counter += SHORT;
-    else if (tokens[pos] == "int")
+    else if (tokens[pos] == TokenKind::KwInt)
       counter += INT;
-    else if (tokens[pos] == "long")
+    else if (tokens[pos] == TokenKind::KwLong)
       counter += LONG;
     else
-      std::exit(1);
+      error("invalid type.");
 
     switch (counter) {
     case VOID:
-      ty = new Type(Types::Void, 1, 1);
+      ty = typesystem::void_type();
       break;
     case CHAR:
-      ty = new Type(Types::Char, kCharSize, kCharSize);
+      ty = typesystem::char_type();
       break;
     case SHORT:
     case SHORT + INT:
-      ty = new Type(Types::Short, kShortSize, kShortSize);
+      ty = typesystem::short_type();
       break;
     case INT:
-      ty = new Type(Types::Int, kNumberSize, kNumberSize);
+      ty = typesystem::int_type();
       break;
     case LONG:
     case LONG + INT:
     case LONG + LONG:
     case LONG + LONG + INT:
-      ty = new Type(Types::Long, kLongSize, kLongSize);
+      ty = typesystem::long_type();
       break;
     default:
       error("invalid type");
@@ -525,22 +575,21 @@ static Type *decl_type(const TokenList &tokens, u64 &pos,
   return ty;
 }
 
-static Member *struct_members(const TokenList &tokens, u64 &pos) {
+static Member *struct_members(TokenStream &tokens, u64 &pos) {
   Member head{};
   Member *current = &head;
 
-  while (tokens[pos] != "}") {
+  while (before(tokens, pos, TokenKind::RBrace)) {
     Type *base_type = decl_type(tokens, pos, nullptr);
     i32 i = 0;
 
-    while (!consume(tokens, pos, ";")) {
+    while (!consume(tokens, pos, TokenKind::Semicolon)) {
       if (i++) {
-        skip_until(tokens, ",", pos);
+        skip_until(tokens, TokenKind::Comma, pos);
       }
 
-      Member *mem = new Member();
-      mem->type = declarator(tokens, pos, base_type);
-      mem->name = mem->type->name_;
+      Member *mem = arena::make<Member>();
+      mem->type = declarator(tokens, pos, base_type, &mem->name);
 
       current = current->next_ = mem;
     }
@@ -549,28 +598,29 @@ static Member *struct_members(const TokenList &tokens, u64 &pos) {
   return head.next_;
 }
 
-static void parse_typedef(const TokenList &tokens, u64 &pos, Type *base) {
+// binds every declarator's name to its type, in the current scope like a
+// variable would be.
+static void parse_typedef(TokenStream &tokens, u64 &pos, Type *base) {
   int i = 0;
 
-  while (!consume(tokens, pos, ";")) {
+  while (!consume(tokens, pos, TokenKind::Semicolon)) {
     if (i++ > 0) {
-      skip_until(tokens, ";", pos);
+      skip_until(tokens, TokenKind::Comma, pos);
     }
-    Type *ty = declarator(tokens, pos, base);
-
-    // TODO: do this
+    intern::Symbol name;
+    Type *ty = declarator(tokens, pos, base, &name);
+    push_scope(name, nullptr)->typedef_ = ty;
   }
-  return;
 }
 
-static Type *struct_union(const TokenList &tokens, u64 &pos) {
+static Type *struct_union(TokenStream &tokens, u64 &pos) {
   i32 tag_pos = -1;
-  if (tokens[pos].type_ == token::TokenType::Identifier) {
+  if (tokens[pos].kind_ == TokenKind::Identifier) {
     tag_pos = pos;
     ++pos;
   }
 
-  if (tag_pos != -1 && tokens[pos] != "{") {
+  if (tag_pos != -1 && tokens[pos] != TokenKind::LBrace) {
     Type *ty = find_tag(tokens[tag_pos]);
     if (!ty) {
       error("unknown struct type");
@@ -578,7 +628,7 @@ static Type *struct_union(const TokenList &tokens, u64 &pos) {
     return ty;
   }
 
-  Type *ty = new Type(Types::Struct, 0);
+  Type *ty = arena::make<Type>(Types::Struct, 0);
   ++pos;
   auto members = struct_members(tokens, pos);
   ty->align_ = 1;
@@ -591,16 +641,16 @@ static Type *struct_union(const TokenList &tokens, u64 &pos) {
   return ty;
 }
 
-static Type *enum_declaration(const TokenList &tokens, u64 &pos) {
+static Type *enum_declaration(TokenStream &tokens, u64 &pos) {
   Type *ty = typesystem::enum_type();
 
   i32 tag_pos = -1;
-  if (tokens[pos].type_ == token::TokenType::Identifier) {
+  if (tokens[pos].kind_ == TokenKind::Identifier) {
     tag_pos = pos;
     ++pos;
   }
 
-  if (tag_pos != -1 && tokens[pos] != "{") {
+  if (tag_pos != -1 && tokens[pos] != TokenKind::LBrace) {
     Type *ty = find_tag(tokens[tag_pos]);
     if (!ty) {
       error("unknown enum type.");
@@ -611,18 +661,18 @@ static Type *enum_declaration(const TokenList &tokens, u64 &pos) {
 
     return ty;
   }
-  skip_until(tokens, "{", pos);
+  skip_until(tokens, TokenKind::LBrace, pos);
 
   i32 idx = 0, value = 0;
-  while (tokens[pos] != "}") {
+  while (before(tokens, pos, TokenKind::RBrace)) {
     if (idx++ > 0) {
-      skip_until(tokens, ",", pos);
+      skip_until(tokens, TokenKind::Comma, pos);
     }
 
-    char *name = get_identifier(tokens[pos]);
+    intern::Symbol name = get_identifier(tokens[pos]);
     ++pos;
 
-    if (tokens[pos] == "=") {
+    if (tokens[pos] == TokenKind::Assign) {
       ++pos;
       value = const_expr(tokens, pos);
     }
@@ -631,8 +681,8 @@ static Type *enum_declaration(const TokenList &tokens, u64 &pos) {
     enum_var.enum_type = ty;
     enum_var.enum_val = value++;
 
-    u64 sc = push_scope(name, nullptr);
-    scopes->variables_[sc].data_ = std::move(enum_var);
+    VarScope *sc = push_scope(name, nullptr);
+    sc->data_ = std::move(enum_var);
   }
 
   ++pos;
@@ -644,7 +694,7 @@ static Type *enum_declaration(const TokenList &tokens, u64 &pos) {
   return ty;
 }
 
-static Type *parse_struct_declaration(const TokenList &tokens, u64 &pos) {
+static Type *parse_struct_declaration(TokenStream &tokens, u64 &pos) {
   Type *ty = struct_union(tokens, pos);
   ty->type_ = Types::Struct;
 
@@ -664,12 +714,12 @@ static Type *parse_struct_declaration(const TokenList &tokens, u64 &pos) {
   return ty;
 }
 
-static NodePtr parse_cast(const TokenList &tokens, u64 &pos) {
-  if (tokens[pos] == "(" && is_typename(tokens[pos + 1])) {
+static NodePtr parse_cast(TokenStream &tokens, u64 &pos) {
+  if (tokens[pos] == TokenKind::LParen && is_typename(tokens[pos + 1])) {
     u64 original_pos = pos;
     ++pos;
     Type *ty = decl_type(tokens, pos, nullptr);
-    skip_until(tokens, ")", pos);
+    skip_until(tokens, TokenKind::RParen, pos);
   }
 
   return parse_unary(tokens, pos);
@@ -678,9 +728,8 @@ static NodePtr parse_cast(const TokenList &tokens, u64 &pos) {
 static Member *get_struct_member(Type *ty, const token::Token &tok) {
   try {
     Member *ptr = std::get<Member *>(ty->optional_data_);
-    for (Member *mem = ptr; mem; mem = ptr->next_) {
-      if (strlen(mem->name) == tok.len_ &&
-          !strncmp(mem->name, tok.loc_, tok.len_)) {
+    for (Member *mem = ptr; mem; mem = mem->next_) {
+      if (mem->name == tok.sym_) {
         return mem;
       }
     }
@@ -688,7 +737,6 @@ static Member *get_struct_member(Type *ty, const token::Token &tok) {
     error("no such struct member.");
   }
   error("no such struct member.");
-  std::exit(1);
 }
 
 static NodePtr struct_ref(NodePtr lhs, const token::Token &tok) {
@@ -703,42 +751,38 @@ static NodePtr struct_ref(NodePtr lhs, const token::Token &tok) {
   return node;
 }
 
-static Type *function_parameters(const TokenList &tokens, u64 &pos,
+static Type *function_parameters(TokenStream &tokens, u64 &pos,
                                  Type *func_type) {
-  std::vector<Type *> params;
-  while (tokens[pos] != ")") {
-    if (params.size() != 0) {
-      skip_until(tokens, ",", pos);
+  FunctionType f_data;
+  while (before(tokens, pos, TokenKind::RParen)) {
+    if (f_data.params_.size() != 0) {
+      skip_until(tokens, TokenKind::Comma, pos);
     }
 
     Type *base = decl_type(tokens, pos, nullptr);
-    Type *tt = declarator(tokens, pos, base);
-
-    params.push_back(tt);
+    intern::Symbol name;
+    f_data.params_.push_back(declarator(tokens, pos, base, &name));
+    f_data.param_names_.push_back(name);
   }
-
-  FunctionType f_data;
-  f_data.params_ = std::move(params);
   f_data.return_type_ = func_type;
 
-  Type *func_wrapper = new Type(Types::Function, 0);
-  func_wrapper->name_ = strndup(func_type->name_, strlen(func_type->name_));
-  func_wrapper->optional_data_ = f_data;
+  Type *func_wrapper = arena::make<Type>(Types::Function, 0);
+  func_wrapper->optional_data_ = std::move(f_data);
 
   ++pos;
 
   return func_wrapper;
 }
 
-static Type *array_dimensions(const TokenList &tokens, u64 &pos, Type *ty);
+static Type *array_dimensions(TokenStream &tokens, u64 &pos, Type *ty);
 
-static Type *type_suffix(const TokenList &tokens, u64 &pos, Type *ty) {
-  if (tokens[pos] == "(") {
+static Type *type_suffix(TokenStream &tokens, u64 &pos, Type *ty) {
+  if (tokens[pos] == TokenKind::LParen) {
     ++pos;
     return function_parameters(tokens, pos, ty);
   }
 
-  if (tokens[pos] == "[") {
+  if (tokens[pos] == TokenKind::LBracket) {
     ++pos;
     return array_dimensions(tokens, pos, ty);
   }
@@ -746,52 +790,55 @@ static Type *type_suffix(const TokenList &tokens, u64 &pos, Type *ty) {
   return ty;
 }
 
-static Type *array_dimensions(const TokenList &tokens, u64 &pos, Type *ty) {
-  if (tokens[pos] == "]") {
+static Type *array_dimensions(TokenStream &tokens, u64 &pos, Type *ty) {
+  if (tokens[pos] == TokenKind::RBracket) {
     ++pos;
     ty = type_suffix(tokens, pos, ty);
     return typesystem::array_of_type(ty, -1);
   }
 
   auto sz = const_expr(tokens, pos);
-  skip_until(tokens, "]", pos);
+  skip_until(tokens, TokenKind::RBracket, pos);
   ty = type_suffix(tokens, pos, ty);
   return typesystem::array_of_type(ty, sz);
 }
 
-static Type *declarator(const TokenList &tokens, u64 &pos, Type *ty) {
-  while (consume(tokens, pos, "*")) {
+// types are shared, so the declared name is handed back through name instead
+// of being stored in the type.
+static Type *declarator(TokenStream &tokens, u64 &pos, Type *ty,
+                        intern::Symbol *name) {
+  while (consume(tokens, pos, TokenKind::Star)) {
     ty = typesystem::ptr_to(ty);
   }
 
-  if (tokens[pos].type_ != token::TokenType::Identifier) {
+  if (tokens[pos].kind_ != TokenKind::Identifier) {
     error("expected a variable name");
   }
 
-  ty->name_ = strndup(tokens[pos].loc_, tokens[pos].len_);
+  *name = tokens[pos].sym_;
   ++pos;
   ty = type_suffix(tokens, pos, ty);
   return ty;
 }
 
-static NodePtr parse_declaration(const TokenList &tokens, u64 &pos,
-                                 Type *base) {
+static NodePtr parse_declaration(TokenStream &tokens, u64 &pos, Type *base) {
   int i = 0;
   std::vector<NodePtr> nodes;
 
-  while (tokens[pos] != ";") {
+  while (before(tokens, pos, TokenKind::Semicolon)) {
     if (i++ > 0)
-      skip_until(tokens, ",", pos);
-    Type *ty = declarator(tokens, pos, base);
+      skip_until(tokens, TokenKind::Comma, pos);
+    intern::Symbol name;
+    Type *ty = declarator(tokens, pos, base, &name);
     if (ty->size_ < 0) {
       error("variable has incomplete type");
     }
     if (ty->type_ == Types::Void)
       error("variable declared void");
 
-    auto obj = new_lvar(ty->name_, ty);
+    auto obj = new_lvar(name, ty);
 
-    if (tokens[pos] != "=")
+    if (tokens[pos] != TokenKind::Assign)
       continue;
 
     auto lhs = new_variable_node(obj);
@@ -809,19 +856,19 @@ static NodePtr parse_declaration(const TokenList &tokens, u64 &pos,
   return node;
 }
 
-static void create_parameter_lvalues(std::vector<Type *> &params) {
-  for (auto &t : params) {
-    new_lvar(t->name_, t);
+static void create_parameter_lvalues(const FunctionType &func) {
+  for (u64 i = 0; i < func.params_.size(); ++i) {
+    new_lvar(func.param_names_[i], func.params_[i]);
   }
 }
 
-static NodePtr parse_stmt(const TokenList &tokens, u64 &pos) {
-  if (tokens[pos] == "return") {
+static NodePtr parse_stmt(TokenStream &tokens, u64 &pos) {
+  if (tokens[pos] == TokenKind::KwReturn) {
     auto node = new_node(NodeType::Return);
     ++pos;
 
     auto exp = parse_expression(tokens, pos);
-    skip_until(tokens, ";", pos);
+    skip_until(tokens, TokenKind::Semicolon, pos);
 
     typesystem::add_type(*exp);
     node->lhs_ = std::move(exp);
@@ -829,15 +876,15 @@ static NodePtr parse_stmt(const TokenList &tokens, u64 &pos) {
     return node;
   }
 
-  if (tokens[pos] == "if") {
+  if (tokens[pos] == TokenKind::KwIf) {
     auto node = new_node(NodeType::If);
-    skip_until(tokens, "(", pos);
+    skip_until(tokens, TokenKind::LParen, pos);
 
     IfNode if_node;
     if_node.condition_ = parse_expression(tokens, pos);
-    skip_until(tokens, ")", pos);
+    skip_until(tokens, TokenKind::RParen, pos);
     if_node.then_ = parse_stmt(tokens, pos);
-    if (tokens[pos] == "else") {
+    if (tokens[pos] == TokenKind::KwElse) {
       ++pos;
       if_node.else_ = parse_stmt(tokens, pos);
     }
@@ -846,9 +893,9 @@ static NodePtr parse_stmt(const TokenList &tokens, u64 &pos) {
     return node;
   }
 
-  if (tokens[pos] == "for") {
+  if (tokens[pos] == TokenKind::KwFor) {
     auto node = new_node(NodeType::For);
-    skip_until(tokens, "(", pos);
+    skip_until(tokens, TokenKind::LParen, pos);
 
     enter_scope();
 
@@ -860,15 +907,15 @@ static NodePtr parse_stmt(const TokenList &tokens, u64 &pos) {
       for_node.initialization_ = parse_expr_stmt(tokens, pos);
     }
 
-    if (tokens[pos] != ";") {
+    if (tokens[pos] != TokenKind::Semicolon) {
       for_node.condition_ = parse_expression(tokens, pos);
     }
-    skip_until(tokens, ";", pos);
+    skip_until(tokens, TokenKind::Semicolon, pos);
 
-    if (tokens[pos] != ")") {
+    if (tokens[pos] != TokenKind::RParen) {
       for_node.increment_ = parse_expression(tokens, pos);
     }
-    skip_until(tokens, ")", pos);
+    skip_until(tokens, TokenKind::RParen, pos);
 
     for_node.body_ = parse_stmt(tokens, pos);
     node->data_ = std::move(for_node);
@@ -877,12 +924,12 @@ static NodePtr parse_stmt(const TokenList &tokens, u64 &pos) {
     return node;
   }
 
-  if (tokens[pos] == "while") {
+  if (tokens[pos] == TokenKind::KwWhile) {
     auto node = new_node(NodeType::For);
-    skip_until(tokens, "(", pos);
+    skip_until(tokens, TokenKind::LParen, pos);
     ForNode for_node{};
     for_node.condition_ = parse_expression(tokens, pos);
-    skip_until(tokens, ")", pos);
+    skip_until(tokens, TokenKind::RParen, pos);
     for_node.body_ = parse_stmt(tokens, pos);
 
     node->data_ = std::move(for_node);
@@ -890,7 +937,7 @@ static NodePtr parse_stmt(const TokenList &tokens, u64 &pos) {
     return node;
   }
 
-  if (tokens[pos] == "{") {
+  if (tokens[pos] == TokenKind::LBrace) {
     ++pos;
     return parse_compound_stmt(tokens, pos);
   }
@@ -898,10 +945,10 @@ static NodePtr parse_stmt(const TokenList &tokens, u64 &pos) {
   return parse_expr_stmt(tokens, pos);
 }
 
-static NodePtr parse_expression(const TokenList &tokens, u64 &pos) {
+static NodePtr parse_expression(TokenStream &tokens, u64 &pos) {
   auto node = parse_assign(tokens, pos);
 
-  if (tokens[pos] == ",") {
+  if (tokens[pos] == TokenKind::Comma) {
     ++pos;
     return new_binary_node(NodeType::Comma, std::move(node),
                            parse_expression(tokens, pos));
@@ -909,17 +956,17 @@ static NodePtr parse_expression(const TokenList &tokens, u64 &pos) {
   return node;
 }
 
-static NodePtr parse_equal(const TokenList &tokens, u64 &pos) {
+static NodePtr parse_equal(TokenStream &tokens, u64 &pos) {
   auto node = parse_relational(tokens, pos);
   for (;;) {
-    if (tokens[pos] == "==") {
+    if (tokens[pos] == TokenKind::Eq) {
       ++pos;
       node = new_binary_node(NodeType::EQ, std::move(node),
                              parse_relational(tokens, pos));
       continue;
     }
 
-    if (tokens[pos] == "!=") {
+    if (tokens[pos] == TokenKind::Ne) {
       ++pos;
       node = new_binary_node(NodeType::NE, std::move(node),
                              parse_relational(tokens, pos));
@@ -934,10 +981,8 @@ static NodePtr to_assign(NodePtr binary) {
   typesystem::add_type(*binary->lhs_);
   typesystem::add_type(*binary->rhs_);
 
-  // XD
-  std::string name = "";
-  char *name_ = strndup(name.c_str(), name.size());
-  auto var = new_lvar(name_, typesystem::ptr_to(binary->lhs_->tt_));
+  auto var =
+      new_lvar(intern::intern(""), typesystem::ptr_to(binary->lhs_->tt_));
   auto expr1 =
       new_binary_node(NodeType::Assign, new_variable_node(var),
                       new_single(NodeType::Addr, std::move(binary->lhs_)));
@@ -951,9 +996,9 @@ static NodePtr to_assign(NodePtr binary) {
   return new_binary_node(NodeType::Comma, std::move(expr1), std::move(expr2));
 }
 
-static NodePtr bit_and(const TokenList &tokens, u64 &pos) {
+static NodePtr bit_and(TokenStream &tokens, u64 &pos) {
   auto node = parse_equal(tokens, pos);
-  while (tokens[pos] == "&") {
+  while (tokens[pos] == TokenKind::Amp) {
     ++pos;
     node = new_binary_node(NodeType::BitAnd, std::move(node),
                            parse_equal(tokens, pos));
@@ -961,9 +1006,9 @@ static NodePtr bit_and(const TokenList &tokens, u64 &pos) {
 
   return node;
 }
-static NodePtr bit_xor(const TokenList &tokens, u64 &pos) {
+static NodePtr bit_xor(TokenStream &tokens, u64 &pos) {
   auto node = bit_and(tokens, pos);
-  while (tokens[pos] == "^") {
+  while (tokens[pos] == TokenKind::Caret) {
     ++pos;
     node = new_binary_node(NodeType::BitXor, std::move(node),
                            parse_equal(tokens, pos));
@@ -972,9 +1017,9 @@ static NodePtr bit_xor(const TokenList &tokens, u64 &pos) {
   return node;
 }
 
-static NodePtr bit_or(const TokenList &tokens, u64 &pos) {
+static NodePtr bit_or(TokenStream &tokens, u64 &pos) {
   auto node = bit_xor(tokens, pos);
-  while (tokens[pos] == "|") {
+  while (tokens[pos] == TokenKind::Pipe) {
     ++pos;
     node = new_binary_node(NodeType::BitOr, std::move(node),
                            parse_equal(tokens, pos));
@@ -983,9 +1028,9 @@ static NodePtr bit_or(const TokenList &tokens, u64 &pos) {
   return node;
 }
 
-static NodePtr log_or(const TokenList &tokens, u64 &pos) {
+static NodePtr log_or(TokenStream &tokens, u64 &pos) {
   auto node = log_and(tokens, pos);
-  while (tokens[pos] == "&&") {
+  while (tokens[pos] == TokenKind::LogAnd) {
     ++pos;
     node = new_binary_node(NodeType::LogAnd, std::move(node),
                            log_and(tokens, pos));
@@ -994,9 +1039,9 @@ static NodePtr log_or(const TokenList &tokens, u64 &pos) {
   return node;
 }
 
-static NodePtr log_and(const TokenList &tokens, u64 &pos) {
+static NodePtr log_and(TokenStream &tokens, u64 &pos) {
   auto node = bit_or(tokens, pos);
-  while (tokens[pos] == "&&") {
+  while (tokens[pos] == TokenKind::LogAnd) {
     ++pos;
     node =
         new_binary_node(NodeType::LogAnd, std::move(node), bit_or(tokens, pos));
@@ -1014,27 +1059,27 @@ static NodePtr new_incdec(NodePtr node, int to_add) {
       tt);
 }
 
-static NodePtr parse_postfix(const TokenList &tokens, u64 &pos) {
+static NodePtr parse_postfix(TokenStream &tokens, u64 &pos) {
   auto node = parse_primary(tokens, pos);
 
   for (;;) {
-    if (tokens[pos] == "[") {
+    if (tokens[pos] == TokenKind::LBracket) {
       ++pos;
       auto index = parse_expression(tokens, pos);
 
-      skip_until(tokens, "]", pos);
+      skip_until(tokens, TokenKind::RBracket, pos);
       node = new_single(NodeType::Derefence,
                         new_addition(std::move(node), std::move(index)));
     }
 
-    if (tokens[pos] == ".") {
+    if (tokens[pos] == TokenKind::Dot) {
       ++pos;
       node = struct_ref(std::move(node), tokens[pos]);
       ++pos;
       continue;
     }
 
-    if (tokens[pos] == "->") {
+    if (tokens[pos] == TokenKind::Arrow) {
       auto nod = new_single(NodeType::Derefence, std::move(node));
       nod = struct_ref(std::move(nod), tokens[pos + 1]);
 
@@ -1042,13 +1087,13 @@ static NodePtr parse_postfix(const TokenList &tokens, u64 &pos) {
       continue;
     }
 
-    if (tokens[pos] == "++") {
+    if (tokens[pos] == TokenKind::Inc) {
       node = new_incdec(std::move(node), 1);
       ++pos;
       continue;
     }
 
-    if (tokens[pos] == "--") {
+    if (tokens[pos] == TokenKind::Dec) {
       node = new_incdec(std::move(node), -1);
       ++pos;
       continue;
@@ -1060,9 +1105,9 @@ static NodePtr parse_postfix(const TokenList &tokens, u64 &pos) {
   return node;
 }
 
-static NodePtr parse_conditional(const TokenList &tokens, u64 &pos) {
+static NodePtr parse_conditional(TokenStream &tokens, u64 &pos) {
   auto cond = log_or(tokens, pos);
-  if (tokens[pos] != "?") {
+  if (tokens[pos] != TokenKind::Question) {
     return cond;
   }
 
@@ -1072,79 +1117,79 @@ static NodePtr parse_conditional(const TokenList &tokens, u64 &pos) {
   ++pos;
   ifnode.then_ = parse_expression(tokens, pos);
 
-  skip_until(tokens, ":", pos);
+  skip_until(tokens, TokenKind::Colon, pos);
   ifnode.else_ = std::move(parse_conditional(tokens, pos));
   node->data_ = std::move(ifnode);
   return node;
 }
 
-static i64 const_expr(const TokenList &tokens, u64 &pos) {
+static i64 const_expr(TokenStream &tokens, u64 &pos) {
   auto node = parse_conditional(tokens, pos);
   return evaluate_constexpr(*node);
 }
 
-static NodePtr parse_assign(const TokenList &tokens, u64 &pos) {
+static NodePtr parse_assign(TokenStream &tokens, u64 &pos) {
   auto node = log_or(tokens, pos);
-  if (tokens[pos] == "=") {
+  if (tokens[pos] == TokenKind::Assign) {
     ++pos;
     return new_binary_node(NodeType::Assign, std::move(node),
                            parse_assign(tokens, pos));
   }
 
-  if (tokens[pos] == "+=") {
+  if (tokens[pos] == TokenKind::PlusAssign) {
     ++pos;
     return to_assign(new_addition(std::move(node), parse_assign(tokens, pos)));
   }
 
-  if (tokens[pos] == "-=") {
+  if (tokens[pos] == TokenKind::MinusAssign) {
     ++pos;
     return to_assign(
         new_subtraction(std::move(node), parse_assign(tokens, pos)));
   }
 
-  if (tokens[pos] == "*=") {
+  if (tokens[pos] == TokenKind::StarAssign) {
     ++pos;
     return to_assign(new_binary_node(NodeType::Mul, std::move(node),
                                      parse_assign(tokens, pos)));
   }
 
-  if (tokens[pos] == "/=") {
+  if (tokens[pos] == TokenKind::SlashAssign) {
     ++pos;
     return to_assign(new_binary_node(NodeType::Div, std::move(node),
                                      parse_assign(tokens, pos)));
   }
 
-  if (tokens[pos] == "&=") {
+  if (tokens[pos] == TokenKind::AmpAssign) {
     ++pos;
     return to_assign(new_binary_node(NodeType::BitAnd, std::move(node),
                                      parse_assign(tokens, pos)));
   }
 
-  if (tokens[pos] == "|=") {
+  if (tokens[pos] == TokenKind::PipeAssign) {
     ++pos;
     return to_assign(new_binary_node(NodeType::BitOr, std::move(node),
                                      parse_assign(tokens, pos)));
   }
 
-  if (tokens[pos] == "^=") {
+  if (tokens[pos] == TokenKind::CaretAssign) {
     ++pos;
     return to_assign(new_binary_node(NodeType::BitXor, std::move(node),
                                      parse_assign(tokens, pos)));
   }
 
-  if (tokens[pos] == "%=") {
+  if (tokens[pos] == TokenKind::PercentAssign) {
     ++pos;
     return to_assign(new_binary_node(NodeType::Mod, std::move(node),
                                      parse_assign(tokens, pos)));
   }
 
-  if (tokens[pos] == "<<=") {
+  if (tokens[pos] == TokenKind::ShlAssign) {
     ++pos;
     return to_assign(new_binary_node(NodeType::Shl, std::move(node),
                                      parse_assign(tokens, pos)));
   }
 
-  if (tokens[pos] == ">>=") {
+  if (tokens[pos] == TokenKind::ShrAssign) {
     ++pos;
     return to_assign(new_binary_node(NodeType::Shr, std::move(node),
                                      parse_assign(tokens, pos)));
@@ -1153,31 +1198,31 @@ static NodePtr parse_assign(const TokenList &tokens, u64 &pos) {
   return node;
 }
 
-static NodePtr parse_relational(const TokenList &tokens, u64 &pos) {
+static NodePtr parse_relational(TokenStream &tokens, u64 &pos) {
   auto node = parse_add(tokens, pos);
   for (;;) {
-    if (tokens[pos] == "<") {
+    if (tokens[pos] == TokenKind::Lt) {
       ++pos;
       node = new_binary_node(NodeType::LT, std::move(node),
                              parse_shift(tokens, pos));
       continue;
     }
 
-    if (tokens[pos] == "<=") {
+    if (tokens[pos] == TokenKind::Le) {
       ++pos;
       node = new_binary_node(NodeType::LE, std::move(node),
                              parse_shift(tokens, pos));
       continue;
     }
 
-    if (tokens[pos] == ">") {
+    if (tokens[pos] == TokenKind::Gt) {
       ++pos;
       node = new_binary_node(NodeType::LT, parse_shift(tokens, pos),
                              std::move(node));
       continue;
     }
 
-    if (tokens[pos] == ">=") {
+    if (tokens[pos] == TokenKind::Ge) {
       ++pos;
       node = new_binary_node(NodeType::LE, parse_shift(tokens, pos),
                              std::move(node));
@@ -1188,18 +1233,18 @@ static NodePtr parse_relational(const TokenList &tokens, u64 &pos) {
   }
 }
 
-static NodePtr parse_shift(const TokenList &tokens, u64 &pos) {
+static NodePtr parse_shift(TokenStream &tokens, u64 &pos) {
   auto node = parse_add(tokens, pos);
 
   for (;;) {
-    if (tokens[pos] == "<<") {
+    if (tokens[pos] == TokenKind::Shl) {
       ++pos;
       node = new_binary_node(NodeType::Shl, std::move(node),
                              parse_add(tokens, pos));
       continue;
     }
 
-    if (tokens[pos] == ">>") {
+    if (tokens[pos] == TokenKind::Shr) {
       ++pos;
       node = new_binary_node(NodeType::Shr, std::move(node),
                              parse_add(tokens, pos));
@@ -1210,16 +1255,16 @@ static NodePtr parse_shift(const TokenList &tokens, u64 &pos) {
   }
 }
 
-static NodePtr parse_add(const TokenList &tokens, u64 &pos) {
+static NodePtr parse_add(TokenStream &tokens, u64 &pos) {
   auto node = parse_mul(tokens, pos);
   for (;;) {
-    if (tokens[pos] == "+") {
+    if (tokens[pos] == TokenKind::Plus) {
       ++pos;
       node = new_addition(std::move(node), parse_mul(tokens, pos));
       continue;
     }
 
-    if (tokens[pos] == "-") {
+    if (tokens[pos] == TokenKind::Minus) {
       ++pos;
       node = new_subtraction(std::move(node), parse_mul(tokens, pos));
       continue;
@@ -1229,24 +1274,24 @@ static NodePtr parse_add(const TokenList &tokens, u64 &pos) {
   }
 }
 
-static NodePtr parse_mul(const TokenList &tokens, u64 &pos) {
+static NodePtr parse_mul(TokenStream &tokens, u64 &pos) {
   auto node = parse_unary(tokens, pos);
   for (;;) {
-    if (tokens[pos] == "*") {
+    if (tokens[pos] == TokenKind::Star) {
       ++pos;
       node = new_binary_node(NodeType::Mul, std::move(node),
                              parse_unary(tokens, pos));
       continue;
     }
 
-    if (tokens[pos] == "/") {
+    if (tokens[pos] == TokenKind::Slash) {
       ++pos;
       node = new_binary_node(NodeType::Div, std::move(node),
                              parse_unary(tokens, pos));
       continue;
     }
 
-    if (tokens[pos] == "%") {
+    if (tokens[pos] == TokenKind::Percent) {
       ++pos;
       node = new_binary_node(NodeType::Mod, std::move(node),
                              parse_unary(tokens, pos));
@@ -1257,37 +1302,37 @@ static NodePtr parse_mul(const TokenList &tokens, u64 &pos) {
   }
 }
 
-static NodePtr parse_unary(const TokenList &tokens, u64 &pos) {
-  if (tokens[pos] == "+") {
+static NodePtr parse_unary(TokenStream &tokens, u64 &pos) {
+  if (tokens[pos] == TokenKind::Plus) {
     ++pos;
     return parse_unary(tokens, pos);
   }
 
-  if (tokens[pos] == "!") {
+  if (tokens[pos] == TokenKind::Not) {
     return new_single(NodeType::Not, parse_unary(tokens, pos));
   }
 
-  if (tokens[pos] == "-") {
+  if (tokens[pos] == TokenKind::Minus) {
     ++pos;
     return new_single(NodeType::Neg, parse_unary(tokens, pos));
   }
 
-  if (tokens[pos] == "&") {
+  if (tokens[pos] == TokenKind::Amp) {
     ++pos;
     return new_single(NodeType::Addr, parse_unary(tokens, pos));
   }
 
-  if (tokens[pos] == "*") {
+  if (tokens[pos] == TokenKind::Star) {
     ++pos;
     return new_single(NodeType::Derefence, parse_unary(tokens, pos));
   }
 
-  if (tokens[pos] == "++") {
+  if (tokens[pos] == TokenKind::Inc) {
     ++pos;
     return to_assign(new_addition(parse_unary(tokens, pos), new_number(1)));
   }
 
-  if (tokens[pos] == "--") {
+  if (tokens[pos] == TokenKind::Dec) {
     ++pos;
     return to_assign(new_subtraction(parse_unary(tokens, pos), new_number(1)));
   }
@@ -1295,9 +1340,9 @@ static NodePtr parse_unary(const TokenList &tokens, u64 &pos) {
   return parse_postfix(tokens, pos);
 }
 
-static NodePtr parse_func_call(const TokenList &tokens, u64 &pos) {
+static NodePtr parse_func_call(TokenStream &tokens, u64 &pos) {
   u64 start_pos = pos;
-  skip_until(tokens, "(", pos);
+  skip_until(tokens, TokenKind::LParen, pos);
 
   auto var_scope = find_var(tokens[start_pos]);
   if (!var_scope) {
@@ -1311,9 +1356,9 @@ static NodePtr parse_func_call(const TokenList &tokens, u64 &pos) {
 
   NodeList nodes;
 
-  while (tokens[pos] != ")") {
+  while (before(tokens, pos, TokenKind::RParen)) {
     if (nodes.size() != 0) {
-      skip_until(tokens, ",", pos);
+      skip_until(tokens, TokenKind::Comma, pos);
     }
 
     auto node = parse_assign(tokens, pos);
@@ -1321,42 +1366,46 @@ static NodePtr parse_func_call(const TokenList &tokens, u64 &pos) {
     nodes.push_back(std::move(node));
   }
 
-  skip_until(tokens, ")", pos);
+  skip_until(tokens, TokenKind::RParen, pos);
   auto node = new_node(NodeType::FunctionCall);
-  node->func_name_ = strndup(tokens[start_pos].loc_, tokens[start_pos].len_);
+  node->func_name_ = intern::name(tokens[start_pos].sym_);
   node->data_ = std::move(nodes);
 
   return node;
 }
 
-static NodePtr parse_primary(const TokenList &tokens, u64 &pos) {
-  if (tokens[pos] == "(" && tokens[pos + 1] == "{") {
+static NodePtr parse_primary(TokenStream &tokens, u64 &pos) {
+  if (tokens[pos] == TokenKind::LParen &&
+      tokens[pos + 1] == TokenKind::LBrace) {
     auto node = new_node(NodeType::StmtExpr);
     pos += 2;
+    ++stmt_expr_depth_;
     node->data_ = parse_compound_stmt(tokens, pos);
-    skip_until(tokens, ")", pos);
+    --stmt_expr_depth_;
+    skip_until(tokens, TokenKind::RParen, pos);
 
     return node;
   }
 
-  if (tokens[pos] == "(") {
+  if (tokens[pos] == TokenKind::LParen) {
     ++pos;
     auto node = parse_expression(tokens, pos);
-    skip_until(tokens, ")", pos);
+    skip_until(tokens, TokenKind::RParen, pos);
 
     return node;
   }
 
-  if (tokens[pos] == "sizeof" && tokens[pos + 1] == "(" &&
+  if (tokens[pos] == TokenKind::KwSizeof &&
+      tokens[pos + 1] == TokenKind::LParen &&
       is_typename(tokens[pos + 2])) {
     pos += 2;
     Type *ty = typename_(tokens, pos);
-    skip_until(tokens, ")", pos);
+    skip_until(tokens, TokenKind::RParen, pos);
 
     return new_number(ty->size_);
   }
 
-  if (tokens[pos] == "sizeof") {
+  if (tokens[pos] == TokenKind::KwSizeof) {
     ++pos;
     auto node = parse_unary(tokens, pos);
     typesystem::add_type(*node);
@@ -1364,8 +1413,8 @@ static NodePtr parse_primary(const TokenList &tokens, u64 &pos) {
     return new_number(node->tt_->size_);
   }
 
-  if (tokens[pos].type_ == token::TokenType::Identifier) {
-    if (tokens[pos + 1] == "(") {
+  if (tokens[pos].kind_ == TokenKind::Identifier) {
+    if (tokens[pos + 1] == TokenKind::LParen) {
       return parse_func_call(tokens, pos);
     }
 
@@ -1385,20 +1434,20 @@ static NodePtr parse_primary(const TokenList &tokens, u64 &pos) {
     }
   }
 
-  if (tokens[pos].type_ == token::TokenType::String) {
-    const auto &string_literal =
-        std::get<token::StringLiteral>(tokens[pos].data_);
+  if (tokens[pos].kind_ == TokenKind::String) {
+    const auto &string_literal = tokens.string(pos);
+    // literals may contain NULs, copy all of the bytes.
     auto len = string_literal.length;
+    char *data = static_cast<char *>(arena::current->allocate(len, 1));
+    memcpy(data, string_literal.data, len);
     auto obj = new_string_literal(
-        strndup(string_literal.data, len),
-        typesystem::array_of_type(new Type(Types::Char, kCharSize),
-                                  string_literal.length));
+        data, typesystem::array_of_type(typesystem::char_type(), len));
     ++pos;
     return new_variable_node(std::move(obj));
   }
 
-  if (tokens[pos].type_ == token::TokenType::Num) {
-    auto node = new_number(std::get<i64>(tokens[pos].data_));
+  if (tokens[pos].kind_ == TokenKind::Num) {
+    auto node = new_number(tokens.number(pos));
     ++pos;
     return node;
   }
@@ -1407,11 +1456,14 @@ static NodePtr parse_primary(const TokenList &tokens, u64 &pos) {
   return nullptr;
 }
 
-static NodePtr parse_compound_stmt(const TokenList &tokens, u64 &pos) {
+static NodePtr parse_compound_stmt(TokenStream &tokens, u64 &pos) {
   std::vector<NodePtr> nodes;
   enter_scope();
 
-  while (tokens[pos] != "}") {
+  while (before(tokens, pos, TokenKind::RBrace)) {
+    if (!stmt_expr_depth_)
+      tokens.discard_before(pos);
+
     if (is_typename(tokens[pos])) {
       VariableAttributes attrs{};
       Type *baset = decl_type(tokens, pos, &attrs);
@@ -1437,33 +1489,29 @@ static NodePtr parse_compound_stmt(const TokenList &tokens, u64 &pos) {
   return node;
 }
 
-static void parse_function(const TokenList &tokens, u64 &pos, Type *ty) {
-  ty = declarator(tokens, pos, ty);
+// name and ty come from the function's already parsed declarator.
+static void parse_function(TokenStream &tokens, u64 &pos, intern::Symbol name,
+                           Type *ty) {
+  // declared in the enclosing scope so the body and everything after it can
+  // call the function.
+  std::shared_ptr<Object> func_obj = new_gvar(name, ty);
+  func_obj->is_func_ = true;
+  func_obj->is_definition_ = !consume(tokens, pos, TokenKind::Semicolon);
 
-  try {
-    create_parameter_lvalues(
-        std::get<FunctionType>(ty->optional_data_).params_);
-  } catch (const std::bad_variant_access &e) {
-    // no params do nothing.
+  if (!func_obj->is_definition_) {
+    // function prototype.
+    return;
   }
 
   enter_scope();
-  std::shared_ptr<Object> func_obj =
-      new_gvar(strndup(ty->name_, strlen(ty->name_)), ty);
-  func_obj->is_func_ = true;
-  func_obj->is_definition_ = !consume(tokens, pos, ";");
-
-  // if (!func_obj->is_definition_) {
-  //   // function prototype.
-  //   return;
-  // }
+  create_parameter_lvalues(std::get<FunctionType>(ty->optional_data_));
 
   func_obj->params_ = ObjectList{};
   for (auto &p : locals_) {
     func_obj->params_.push_back(p);
   }
 
-  skip_until(tokens, "{", pos);
+  skip_until(tokens, TokenKind::LBrace, pos);
   func_obj->body = parse_compound_stmt(tokens, pos);
   func_obj->locals_ = std::move(locals_);
 
@@ -1472,36 +1520,74 @@ static void parse_function(const TokenList &tokens, u64 &pos, Type *ty) {
   locals_.clear();
 }
 
-static void global_varialble(const TokenList &tokens, u64 &pos, Type *base) {
-  bool first = true;
-  while (!consume(tokens, pos, ";")) {
-    if (!first) {
-      skip_until(tokens, ",", pos);
-    }
-
-    first = false;
-    Type *ty = declarator(tokens, pos, base);
-    new_gvar(strndup(ty->name_, strlen(ty->name_)), ty);
-  }
-}
-
-static bool is_func(const TokenList &tokens, u64 &pos) {
-  if (tokens[pos] == ";") {
-    return false;
-  }
-
-  u64 original = pos;
-  Type *ty = declarator(tokens, pos, default_empty);
-  bool verdict = ty->type_ == Types::Function;
-  pos = original;
-
-  return verdict;
-}
+// name and ty come from the already parsed declarator of the first variable.
+static void global_varialble(TokenStream &tokens, u64 &pos, Type *base,
+                             intern::Symbol name, Type *ty) {
+  new_gvar(name, ty);
+  while (!consume(tokens, pos, TokenKind::Semicolon)) {
+    skip_until(tokens, TokenKind::Comma, pos);
+    ty = declarator(tokens, pos, base, &name);
+    new_gvar(name, ty);
+  }
+}
+
+FileScope file_scope() {
+  // a name bound twice only keeps its last binding, found walking backwards.
+  FileScope scope;
+  std::vector<bool> seen(intern::symbol_count() + 1);
+  for (auto it = scopes->variables_.rbegin(); it != scopes->variables_.rend();
+       ++it) {
+    if (!seen[*it])
+      scope.variables_.push_back(var_bindings_[*it]);
+    seen[*it] = true;
+  }
+  seen.assign(seen.size(), false);
+  for (auto it = scopes->tags_.rbegin(); it != scopes->tags_.rend(); ++it) {
+    if (!seen[*it])
+      scope.tags_.push_back(tag_bindings_[*it]);
+    seen[*it] = true;
+  }
+  std::reverse(scope.variables_.begin(), scope.variables_.end());
+  std::reverse(scope.tags_.begin(), scope.tags_.end());
+  return scope;
+}
+
+// binds a prelude's declarations at file scope. Its variables are globals of
+// this translation unit like any declared in it.
+static void bind_prelude(const FileScope &prelude) {
+  for (VarScope *var : prelude.variables_) {
+    VarScope *&head = binding_of(var_bindings_, var->name_);
+    var->next_ = head;
+    head = var;
+    scopes->variables_.push_back(var->name_);
+    if (var->variable_)
+      globals_.push_back(var->variable_);
+  }
+  for (TagScope *tag : prelude.tags_) {
+    TagScope *&head = binding_of(tag_bindings_, tag->name);
+    tag->next = head;
+    head = tag;
+    scopes->tags_.push_back(tag->name);
+  }
+}
+
+std::vector<std::shared_ptr<Object>> parse_tokens(TokenStream &tokens,
+                                                  const FileScope *prelude) {
+  // bindings left over from a previous file point into its freed arena.
+  var_bindings_.clear();
+  tag_bindings_.clear();
+  globals_.clear();
+  locals_.clear();
+  stmt_expr_depth_ = 0;
+  unique_id_ = 0;
+  if (prelude)
+    bind_prelude(*prelude);
 
-std::vector<std::shared_ptr<Object>> parse_tokens(const TokenList &tokens) {
   u64 pos = 0;
 
-  while (tokens[pos].type_ != token::TokenType::Eof) {
+  while (tokens[pos].kind_ != TokenKind::Eof) {
+    tokens.discard_before(pos);
+
     VariableAttributes attrs{};
     Type *base_type = decl_type(tokens, pos, &attrs);
     if (attrs.is_typedef_) {
@@ -1509,12 +1595,21 @@ std::vector<std::shared_ptr<Object>> parse_tokens(const TokenList &tokens) {
       continue;
     }
 
-    if (is_func(tokens, pos)) {
-      parse_function(tokens, pos, base_type);
+    if (consume(tokens, pos, TokenKind::Semicolon)) {
+      // a struct, union or enum declared on its own.
+      continue;
+    }
+
+    // the first declarator tells functions and variables apart, it is parsed
+    // once and handed on.
+    intern::Symbol name;
+    Type *ty = declarator(tokens, pos, base_type, &name);
+    if (ty->type_ == Types::Function) {
+      parse_function(tokens, pos, name, ty);
       continue;
     }
 
-    global_varialble(tokens, pos, base_type);
+    global_varialble(tokens, pos, base_type, name, ty);
   }
 
   return std::move(globals_);
@@ -1,6 +1,7 @@
 #ifndef _ASMLAI_PARSER_H
 #define _ASMLAI_PARSER_H
 
+#include "intern.h"
 #include "token.h"
 #include <memory>
 #include <optional>
@@ -50,12 +51,13 @@ struct ArrayType {
 struct FunctionType {
   Type *return_type_;
   std::vector<Type *> params_;
+  std::vector<intern::Symbol> param_names_;
 };
 
 struct Member {
   i64 offset = 0;
 
-  char *name;
+  intern::Symbol name = intern::kNoSymbol;
   Member *next_ = nullptr;
   Type *type = nullptr;
 };
@@ -72,15 +74,15 @@ public:
   i32 size_ = 0;
   Types type_;
   Type *base_type_ = nullptr;
-  char *name_ = nullptr;
   std::variant<std::vector<Type *>, std::monostate, Type *, FunctionType,
                ArrayType, Member *>
       optional_data_;
 };
 
+// bindings form a stack per name, next points to the binding this one shadows.
 struct TagScope {
   TagScope *next = nullptr;
-  char *name = nullptr;
+  intern::Symbol name = intern::kNoSymbol;
   Type *ty = nullptr;
 };
 
@@ -89,7 +91,7 @@ extern parser::Type *default_int;
 extern parser::Type *default_empty;
 extern parser::Type *default_long;
 extern parser::Type *default_void;
-extern Scope
+extern thread_local Scope
     *scopes; // use linked list since globals vectors didn't work very well.
 extern TagScope *tag_scopes;
 
@@ -136,7 +138,8 @@ struct Node;
 struct Object;
 struct Function;
 
-using NodePtr = std::unique_ptr<Node>;
+// nodes live in the compilation arena, so plain pointers are enough.
+using NodePtr = Node *;
 using NodeList = std::vector<NodePtr>;
 using ObjectList = std::vector<std::shared_ptr<Object>>;
 
@@ -147,8 +150,10 @@ struct LabelGotoData {
 };
 
 struct Object {
-  Object(char *name, i64 offset) : name_(name), offset_(offset) {}
-  char *name_ = nullptr;
+  Object(intern::Symbol sym, i64 offset)
+      : name_(intern::name(sym)), sym_(sym), offset_(offset) {}
+  const char *name_ = nullptr;
+  intern::Symbol sym_ = intern::kNoSymbol;
   i64 offset_ = 0;
   Type *ty_ = nullptr;
   char *init_data_ = nullptr;
@@ -169,25 +174,32 @@ struct EnumVarScope {
 };
 
 struct VarScope {
-  char *name_ = nullptr;
+  VarScope *next_ = nullptr; // the binding shadowed by this one.
+  intern::Symbol name_ = intern::kNoSymbol;
   std::shared_ptr<Object> variable_ = nullptr;
   Type *typedef_ = nullptr;
   std::variant<EnumVarScope, std::monostate> data_ =
       std::monostate{}; // we want to optionally store enum data.
 };
 
+// A Scope only remembers which names it bound. The bindings themselves are
+// found through a table indexed by symbol, so lookups don't depend on how
+// many scopes or names are visible, and leaving a scope just pops the names
+// it bound.
 struct Scope {
-  Scope() {
-    next_ = nullptr;
-    variables_ = std::vector<VarScope>();
-    tags_ = std::vector<TagScope>();
-  }
-
-  Scope *next_;
-  std::vector<VarScope> variables_;
-  std::vector<TagScope> tags_;
+  Scope *next_ = nullptr;
+  std::vector<intern::Symbol> variables_;
+  std::vector<intern::Symbol> tags_;
 };
 
+// the scope chain the parser binds names in, open to bench/micro too.
+// push_scope binds name in the innermost scope, find_var gives the innermost
+// binding of the token's name or null.
+void enter_scope();
+void leave_scope();
+VarScope *push_scope(intern::Symbol name, std::shared_ptr<Object> variable);
+VarScope *find_var(const token::Token &tok);
+
 struct IfNode {
   NodePtr condition_ = nullptr;
   NodePtr then_ = nullptr;
@@ -204,9 +216,11 @@ struct ForNode {
 struct Node {
   Node() : tt_(default_empty) {}
   NodeType type_ = NodeType::Add; // default type
-  std::unique_ptr<Node> lhs_ = nullptr;
-  std::unique_ptr<Node> rhs_ = nullptr;
+  NodePtr lhs_ = nullptr;
+  NodePtr rhs_ = nullptr;
   Type *tt_ = nullptr;
+  // set once typesystem::add_type has annotated the node and its children.
+  bool typed_ = false;
 
   std::variant<i64, std::shared_ptr<Object>, NodeList, IfNode, ForNode, char *,
                NodePtr, Member *, LabelGotoData, std::monostate>
@@ -216,7 +230,7 @@ struct Node {
   // functions, we also need the arguments list which is stored in the
   // std::variant so we need the new struct member. NOTE: This is used when
   // defining functions and calling them.
-  char *func_name_ = NULL;
+  const char *func_name_ = NULL;
 };
 
 struct Function {
@@ -228,8 +242,21 @@ struct Function {
   char *name_;
 };
 
+// What a translation unit bound at file scope, in binding order, one binding
+// per name: the state a precompiled header saves and a later compilation
+// starts from.
+struct FileScope {
+  std::vector<VarScope *> variables_;
+  std::vector<TagScope *> tags_;
+};
+
+// file scope left by the last parse_tokens on this thread.
+FileScope file_scope();
+
+// parses a translation unit. Bindings in prelude are made before the first
+// token, as if the declarations had been parsed in front of it.
 std::vector<std::shared_ptr<Object>>
-parse_tokens(const std::vector<token::Token> &tokens);
+parse_tokens(token::TokenStream &tokens, const FileScope *prelude = nullptr);
 } // namespace parser
 
 #endif
@@ -0,0 +1,561 @@
+#include "pch.h"
+#include "arena.h"
+#include "build.h"
+#include "diag.h"
+#include "intern.h"
+#include "typesystem.h"
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <variant>
+
+namespace pch {
+using parser::Type;
+using parser::Types;
+
+// what's saved follows the compiler's own structures, so the magic is followed
+// by the build::id() of the writer and a file written by any other build is
+// rejected.
+constexpr std::string_view kMagic = "asmlai-pch";
+
+constexpr u32 kNone = ~0u;
+
+// optional_data_ alternatives of a Type, by variant index.
+enum TypeData : u8 {
+  kTypeList,
+  kNoData,
+  kBaseType,
+  kFunction,
+  kArray,
+  kMembers,
+};
+
+enum BindingKind : u8 {
+  kTypedefOnly,
+  kEnumConstant,
+  kObject,
+};
+
+// Integers are stored as they are in memory, strings with their length in
+// front and a NUL behind, so a loaded string can be used in place.
+class Encoder {
+public:
+  void byte(u8 v) { bytes_.push_back(v); }
+  void word(u32 v) { put(&v, sizeof v); }
+  void quad(u64 v) { put(&v, sizeof v); }
+  void str(std::string_view s) {
+    word(s.size());
+    bytes_.append(s);
+    bytes_.push_back('\0');
+  }
+
+  const std::string &bytes() const { return bytes_; }
+
+private:
+  void put(const void *p, u64 n) {
+    bytes_.append(static_cast<const char *>(p), n);
+  }
+
+  std::string bytes_;
+};
+
+class Decoder {
+public:
+  explicit Decoder(const source::File &file)
+      : path_(file.path_), p_(file.contents_),
+        end_(file.contents_ + file.size_) {}
+
+  u8 byte() { return get<u8>(); }
+  u32 word() { return get<u32>(); }
+  u64 quad() { return get<u64>(); }
+  std::string_view str() {
+    u32 len = word();
+    need(len + 1);
+    std::string_view s(p_, len);
+    p_ += len + 1;
+    return s;
+  }
+
+  [[noreturn]] void corrupt() const {
+    diag::fail("%s: corrupt precompiled header", path_);
+  }
+
+private:
+  void need(u64 n) const {
+    if (static_cast<u64>(end_ - p_) < n)
+      corrupt();
+  }
+
+  template <typename T> T get() {
+    need(sizeof(T));
+    T v;
+    std::memcpy(&v, p_, sizeof v);
+    p_ += sizeof v;
+    return v;
+  }
+
+  const char *path_;
+  const char *p_;
+  const char *end_;
+};
+
+// Numbers every type reachable from the saved declarations. Types refer to
+// each other by number in the file, which takes care of sharing and of
+// structs pointing to themselves.
+class TypeTable {
+public:
+  u32 add(Type *ty) {
+    if (!ty)
+      return kNone;
+    auto it = index_.find(ty);
+    if (it != index_.end())
+      return it->second;
+
+    u32 index = types_.size();
+    index_.emplace(ty, index);
+    types_.push_back(ty);
+    add(ty->base_type_);
+    std::visit(
+        [&](auto &data) {
+          using T = std::decay_t<decltype(data)>;
+          if constexpr (std::is_same_v<T, std::vector<Type *>>) {
+            for (Type *t : data)
+              add(t);
+          } else if constexpr (std::is_same_v<T, Type *>) {
+            add(data);
+          } else if constexpr (std::is_same_v<T, parser::FunctionType>) {
+            add(data.return_type_);
+            for (Type *t : data.params_)
+              add(t);
+          } else if constexpr (std::is_same_v<T, parser::Member *>) {
+            for (parser::Member *mem = data; mem; mem = mem->next_)
+              add(mem->type);
+          }
+        },
+        ty->optional_data_);
+    return index;
+  }
+
+  u32 at(Type *ty) const { return ty ? index_.at(ty) : kNone; }
+
+  void write(Encoder &enc) const {
+    enc.word(types_.size());
+    for (Type *ty : types_) {
+      enc.byte(static_cast<u8>(ty->type_));
+      enc.word(ty->size_);
+      enc.word(ty->align_);
+      enc.word(at(ty->base_type_));
+      enc.byte(ty->optional_data_.index());
+      std::visit(
+          [&](auto &data) {
+            using T = std::decay_t<decltype(data)>;
+            if constexpr (std::is_same_v<T, std::vector<Type *>>) {
+              enc.word(data.size());
+              for (Type *t : data)
+                enc.word(at(t));
+            } else if constexpr (std::is_same_v<T, Type *>) {
+              enc.word(at(data));
+            } else if constexpr (std::is_same_v<T, parser::FunctionType>) {
+              enc.word(at(data.return_type_));
+              enc.word(data.params_.size());
+              for (u64 i = 0; i < data.params_.size(); ++i) {
+                enc.word(at(data.params_[i]));
+                enc.str(name_of(data.param_names_[i]));
+              }
+            } else if constexpr (std::is_same_v<T, parser::ArrayType>) {
+              enc.word(data.array_length);
+            } else if constexpr (std::is_same_v<T, parser::Member *>) {
+              u32 count = 0;
+              for (parser::Member *mem = data; mem; mem = mem->next_)
+                ++count;
+              enc.word(count);
+              for (parser::Member *mem = data; mem; mem = mem->next_) {
+                enc.str(name_of(mem->name));
+                enc.quad(mem->offset);
+                enc.word(at(mem->type));
+              }
+            }
+          },
+          ty->optional_data_);
+    }
+  }
+
+  static std::string_view name_of(intern::Symbol sym) {
+    return sym == intern::kNoSymbol
+               ? std::string_view()
+               : std::string_view(intern::name(sym), intern::length(sym));
+  }
+
+private:
+  std::unordered_map<Type *, u32> index_;
+  std::vector<Type *> types_;
+};
+
+static void write_files(const preprocess::Preprocessor &pp, Encoder &enc) {
+  std::vector<std::string> files = pp.files();
+  enc.word(files.size());
+  for (const std::string &path : files) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+      diag::fail("cannot stat %s: %s", path.c_str(), strerror(errno));
+    enc.str(path);
+    enc.quad(st.st_size);
+    enc.quad(st.st_mtim.tv_sec);
+    enc.quad(st.st_mtim.tv_nsec);
+  }
+}
+
+static void write_macros(const preprocess::Preprocessor &pp, Encoder &enc) {
+  const auto &macros = pp.macros();
+  u32 count = 0;
+  for (const auto &m : macros)
+    count += m && m->builtin_ == preprocess::Builtin::None;
+
+  enc.word(count);
+  for (u64 sym = 0; sym < macros.size(); ++sym) {
+    const preprocess::Macro *m = macros[sym].get();
+    if (!m || m->builtin_ != preprocess::Builtin::None)
+      continue;
+    enc.str(TypeTable::name_of(sym));
+    enc.byte(m->function_like_ | m->variadic_ << 1);
+    enc.word(m->params_.size());
+    for (intern::Symbol param : m->params_)
+      enc.str(TypeTable::name_of(param));
+    enc.word(m->body_.size());
+    for (const token::RawToken &tok : m->body_) {
+      enc.byte(static_cast<u8>(tok.kind_));
+      enc.byte(tok.space_);
+      enc.str(std::string_view(tok.loc_, tok.len_));
+    }
+  }
+}
+
+void write(const preprocess::Preprocessor &pp, const parser::FileScope &scope,
+           output::Writer &out) {
+  TypeTable types;
+  for (parser::VarScope *var : scope.variables_) {
+    const parser::Object *obj = var->variable_.get();
+    if (obj && ((obj->is_func_ && obj->is_definition_) || obj->init_data_))
+      diag::fail("%s: only declarations can be precompiled", obj->name_);
+    types.add(var->typedef_);
+    if (var->data_.index() == 0)
+      types.add(std::get<parser::EnumVarScope>(var->data_).enum_type);
+    if (obj)
+      types.add(obj->ty_);
+  }
+  for (parser::TagScope *tag : scope.tags_)
+    types.add(tag->ty);
+
+  Encoder enc;
+  enc.str(kMagic);
+  enc.str(build::id());
+  write_files(pp, enc);
+  write_macros(pp, enc);
+  types.write(enc);
+
+  enc.word(scope.tags_.size());
+  for (parser::TagScope *tag : scope.tags_) {
+    enc.str(TypeTable::name_of(tag->name));
+    enc.word(types.at(tag->ty));
+  }
+
+  enc.word(scope.variables_.size());
+  for (parser::VarScope *var : scope.variables_) {
+    enc.str(TypeTable::name_of(var->name_));
+    enc.word(types.at(var->typedef_));
+    if (var->data_.index() == 0) {
+      const auto &e = std::get<parser::EnumVarScope>(var->data_);
+      enc.byte(kEnumConstant);
+      enc.word(types.at(e.enum_type));
+      enc.word(e.enum_val);
+    } else if (var->variable_) {
+      enc.byte(kObject);
+      enc.word(types.at(var->variable_->ty_));
+      enc.byte(var->variable_->is_func_);
+    } else {
+      enc.byte(kTypedefOnly);
+    }
+  }
+
+  out.put(enc.bytes());
+}
+
+static intern::Symbol read_symbol(Decoder &dec) {
+  std::string_view s = dec.str();
+  return s.empty() ? intern::kNoSymbol : intern::intern(s.data(), s.size());
+}
+
+static void read_files(Decoder &dec, const char *pch_path,
+                       preprocess::Preprocessor &pp) {
+  for (u32 n = dec.word(); n > 0; --n) {
+    std::string path(dec.str());
+    u64 size = dec.quad();
+    u64 sec = dec.quad();
+    u64 nsec = dec.quad();
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || (u64)st.st_size != size ||
+        (u64)st.st_mtim.tv_sec != sec || (u64)st.st_mtim.tv_nsec != nsec)
+      diag::fail("%s: precompiled header is out of date, %s changed",
+                 pch_path, path.c_str());
+    pp.skip_header(path);
+  }
+}
+
+static void read_macros(Decoder &dec, preprocess::Preprocessor &pp) {
+  for (u32 n = dec.word(); n > 0; --n) {
+    intern::Symbol name = read_symbol(dec);
+    auto m = std::make_unique<preprocess::Macro>();
+    u8 flags = dec.byte();
+    m->function_like_ = flags & 1;
+    m->variadic_ = flags & 2;
+    for (u32 i = dec.word(); i > 0; --i)
+      m->params_.push_back(read_symbol(dec));
+    for (u32 i = dec.word(); i > 0; --i) {
+      token::RawToken tok;
+      tok.kind_ = static_cast<token::TokenKind>(dec.byte());
+      tok.space_ = dec.byte();
+      std::string_view s = dec.str();
+      // the spelling stays in the mapping, NUL terminated like source text.
+      tok.loc_ = const_cast<char *>(s.data());
+      tok.len_ = s.size();
+      if (tok.kind_ == token::TokenKind::Identifier)
+        tok.sym_ = intern::intern(s.data(), s.size());
+      m->body_.push_back(tok);
+    }
+    pp.define(name, std::move(m));
+  }
+}
+
+struct TypeRecord {
+  Types kind_;
+  i32 size_;
+  i32 align_;
+  u32 base_;
+  u8 data_;
+  std::vector<u32> types_;
+  std::vector<intern::Symbol> names_;
+  std::vector<i64> offsets_;
+  i64 length_ = 0;
+};
+
+// Rebuilds types in the current arena. Builtin, pointer, array and enum
+// types go through typesystem so they come out canonical; structs, unions
+// and functions are created first and filled in last, since they can be
+// reached again from their own members.
+class TypeLoader {
+public:
+  explicit TypeLoader(Decoder &dec) : dec_(dec) {
+    for (u32 n = dec.word(); n > 0; --n) {
+      TypeRecord r;
+      r.kind_ = static_cast<Types>(dec.byte());
+      r.size_ = dec.word();
+      r.align_ = dec.word();
+      r.base_ = dec.word();
+      r.data_ = dec.byte();
+      switch (r.data_) {
+      case kTypeList:
+        for (u32 i = dec.word(); i > 0; --i)
+          r.types_.push_back(dec.word());
+        break;
+      case kNoData:
+        break;
+      case kBaseType:
+        r.types_.push_back(dec.word());
+        break;
+      case kFunction:
+        r.types_.push_back(dec.word());
+        for (u32 i = dec.word(); i > 0; --i) {
+          r.types_.push_back(dec.word());
+          r.names_.push_back(read_symbol(dec));
+        }
+        break;
+      case kArray:
+        r.length_ = static_cast<i32>(dec.word());
+        break;
+      case kMembers:
+        for (u32 i = dec.word(); i > 0; --i) {
+          r.names_.push_back(read_symbol(dec));
+          r.offsets_.push_back(dec.quad());
+          r.types_.push_back(dec.word());
+        }
+        break;
+      default:
+        dec.corrupt();
+      }
+      records_.push_back(std::move(r));
+    }
+
+    types_.resize(records_.size());
+    for (u64 i = 0; i < records_.size(); ++i) {
+      const TypeRecord &r = records_[i];
+      if (!canonical(r.kind_))
+        types_[i] = arena::make<Type>(r.kind_, r.size_, r.align_);
+    }
+    for (u64 i = 0; i < records_.size(); ++i) {
+      if (!canonical(records_[i].kind_))
+        fill(types_[i], records_[i]);
+    }
+  }
+
+  Type *get(u32 index) {
+    if (index == kNone)
+      return nullptr;
+    if (index >= records_.size())
+      dec_.corrupt();
+    if (types_[index])
+      return types_[index];
+
+    const TypeRecord &r = records_[index];
+    Type *ty = nullptr;
+    switch (r.kind_) {
+    case Types::Empty:
+      ty = typesystem::empty_type();
+      break;
+    case Types::Void:
+      ty = typesystem::void_type();
+      break;
+    case Types::Char:
+      ty = typesystem::char_type();
+      break;
+    case Types::Short:
+      ty = typesystem::short_type();
+      break;
+    case Types::Int:
+      ty = typesystem::int_type();
+      break;
+    case Types::Long:
+      ty = typesystem::long_type();
+      break;
+    case Types::Enum:
+      ty = typesystem::enum_type();
+      break;
+    case Types::Ptr:
+      ty = typesystem::ptr_to(base(r));
+      break;
+    case Types::Array:
+      ty = typesystem::array_of_type(base(r), r.length_);
+      break;
+    default:
+      dec_.corrupt();
+    }
+    return types_[index] = ty;
+  }
+
+private:
+  static bool canonical(Types kind) {
+    return kind != Types::Struct && kind != Types::Union &&
+           kind != Types::Function && kind != Types::Bool;
+  }
+
+  Type *base(const TypeRecord &r) {
+    Type *ty = get(r.base_);
+    if (!ty)
+      dec_.corrupt();
+    return ty;
+  }
+
+  void fill(Type *ty, const TypeRecord &r) {
+    ty->base_type_ = get(r.base_);
+    switch (r.data_) {
+    case kTypeList: {
+      std::vector<Type *> list;
+      for (u32 t : r.types_)
+        list.push_back(get(t));
+      ty->optional_data_ = std::move(list);
+      break;
+    }
+    case kNoData:
+      ty->optional_data_ = std::monostate{};
+      break;
+    case kBaseType:
+      ty->optional_data_ = get(r.types_[0]);
+      break;
+    case kFunction: {
+      parser::FunctionType f;
+      f.return_type_ = get(r.types_[0]);
+      for (u64 i = 1; i < r.types_.size(); ++i)
+        f.params_.push_back(get(r.types_[i]));
+      f.param_names_ = r.names_;
+      ty->optional_data_ = std::move(f);
+      break;
+    }
+    case kArray:
+      ty->optional_data_ = parser::ArrayType{static_cast<i32>(r.length_)};
+      break;
+    case kMembers: {
+      parser::Member head{};
+      parser::Member *current = &head;
+      for (u64 i = 0; i < r.types_.size(); ++i) {
+        parser::Member *mem = arena::make<parser::Member>();
+        mem->name = r.names_[i];
+        mem->offset = r.offsets_[i];
+        mem->type = get(r.types_[i]);
+        current = current->next_ = mem;
+      }
+      ty->optional_data_ = head.next_;
+      break;
+    }
+    }
+  }
+
+  Decoder &dec_;
+  std::vector<TypeRecord> records_;
+  std::vector<Type *> types_;
+};
+
+Prelude::~Prelude() {
+  if (loaded_)
+    source::unload(file_);
+}
+
+void Prelude::load(char *path, preprocess::Preprocessor &pp) {
+  file_ = source::load(path);
+  loaded_ = true;
+
+  Decoder dec(file_);
+  if (dec.str() != kMagic || dec.str() != build::id())
+    diag::fail("%s: not a precompiled header of this build of asmlai", path);
+  read_files(dec, path, pp);
+  read_macros(dec, pp);
+  TypeLoader types(dec);
+
+  for (u32 n = dec.word(); n > 0; --n) {
+    parser::TagScope *tag = arena::make<parser::TagScope>();
+    tag->name = read_symbol(dec);
+    tag->ty = types.get(dec.word());
+    scope_.tags_.push_back(tag);
+  }
+
+  for (u32 n = dec.word(); n > 0; --n) {
+    parser::VarScope *var = arena::make<parser::VarScope>();
+    var->name_ = read_symbol(dec);
+    var->typedef_ = types.get(dec.word());
+    switch (dec.byte()) {
+    case kTypedefOnly:
+      break;
+    case kEnumConstant: {
+      parser::EnumVarScope e;
+      e.enum_type = types.get(dec.word());
+      e.enum_val = dec.word();
+      var->data_ = e;
+      break;
+    }
+    case kObject: {
+      auto obj = std::make_shared<parser::Object>(var->name_, 0);
+      obj->ty_ = types.get(dec.word());
+      obj->is_func_ = dec.byte();
+      var->variable_ = std::move(obj);
+      break;
+    }
+    default:
+      dec.corrupt();
+    }
+    scope_.variables_.push_back(var);
+  }
+}
+
+} // namespace pch
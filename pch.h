@@ -0,0 +1,48 @@
+#ifndef _ASMLAI_PCH_H
+#define _ASMLAI_PCH_H
+
+#include "output.h"
+#include "parser.h"
+#include "preprocess.h"
+#include "source.h"
+#include "types.h"
+
+// Precompiled headers. Compiling a header with --emit-pch saves what it left
+// behind instead of code: the macros, the declarations bound at file scope
+// with the types they use, and the files it was made from. --include-pch
+// maps such a file and starts the compilation from it, as if the header had
+// been included first, so shared headers aren't lexed and parsed again.
+//
+// The file is only read by the build of asmlai that wrote it, and only while
+// the files it was made from are unchanged.
+namespace pch {
+
+// writes the state compiling a header left in pp and the parser's file scope.
+// Only declarations can be saved, function bodies and initializers can't.
+void write(const preprocess::Preprocessor &pp, const parser::FileScope &scope,
+           output::Writer &out);
+
+// A loaded precompiled header. Macro bodies point into the mapped file, so it
+// must outlive the tokens of the compilation.
+class Prelude {
+public:
+  Prelude() = default;
+  ~Prelude();
+  Prelude(const Prelude &) = delete;
+  Prelude &operator=(const Prelude &) = delete;
+
+  // maps the file at path, defines its macros in pp and rebuilds its file
+  // scope in the current arena.
+  void load(char *path, preprocess::Preprocessor &pp);
+
+  const parser::FileScope &scope() const { return scope_; }
+
+private:
+  source::File file_;
+  bool loaded_ = false;
+  parser::FileScope scope_;
+};
+
+} // namespace pch
+
+#endif
@@ -0,0 +1,991 @@
+#include "preprocess.h"
+#include "arena.h"
+#include "diag.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+namespace preprocess {
+using token::RawToken;
+using token::TokenKind;
+
+template <typename... Args>
+[[noreturn]] static void error_at(const RawToken &tok,
+                                  const char *format_string, Args... args) {
+  token::fail_at(tok.loc_, diag::format(format_string, args...));
+}
+
+// how deep #include may nest before it's taken for endless recursion.
+static constexpr u64 kMaxIncludeDepth = 200;
+
+static const char *const kSystemIncludePaths[] = {
+    "/usr/local/include",
+    // the Debian multiarch directory, where glibc keeps its bits/ headers.
+    "/usr/include/x86_64-linux-gnu",
+    "/usr/include",
+};
+
+static const char *const kPredefined[] = {
+    "__STDC__ 1",   "__STDC_VERSION__ 201112L",
+    "__x86_64__ 1", "__LP64__ 1",
+    "__linux__ 1",  "__asmlai__ 1",
+};
+
+static bool is(const RawToken &tok, const char *name) {
+  return tok.len_ == strlen(name) && !memcmp(tok.loc_, name, tok.len_);
+}
+
+static std::string spelling(const RawToken &tok) {
+  return std::string(tok.loc_, tok.len_);
+}
+
+Preprocessor::Preprocessor(source::File main, bool owned,
+                           const Options &options)
+    : options_(options), main_(std::move(main)), owned_(owned) {
+  if (main_.size_ > UINT32_MAX)
+    diag::fail("%s: input is larger than 4GiB", main_.path_);
+  token::add_file(&main_);
+  sources_.push_back(Source{&main_, token::Lexer(main_.contents_, &main_)});
+
+  for (const char *text : kPredefined)
+    define_text(text);
+  for (auto [name, kind] : {std::make_pair("__FILE__", Builtin::File),
+                            std::make_pair("__LINE__", Builtin::Line)}) {
+    auto m = std::make_unique<Macro>();
+    m->builtin_ = kind;
+    define(intern::intern(name), std::move(m));
+  }
+  for (const std::string &def : options_.defines_) {
+    u64 eq = def.find('=');
+    define_text(eq == std::string::npos
+                    ? def + " 1"
+                    : def.substr(0, eq) + " " + def.substr(eq + 1));
+  }
+}
+
+// realpath of path, path itself if it has none.
+static std::string real_path(const char *path) {
+  char *real = realpath(path, nullptr);
+  std::string result = real ? real : path;
+  std::free(real);
+  return result;
+}
+
+u64 Preprocessor::headers() const {
+  u64 count = 0;
+  for (auto &entry : headers_)
+    count += entry.second->loaded_;
+  return count;
+}
+
+std::vector<std::string> Preprocessor::files() const {
+  std::vector<std::string> files{real_path(main_.path_)};
+  for (auto &entry : headers_)
+    files.push_back(entry.first);
+  return files;
+}
+
+void Preprocessor::skip_header(const std::string &real_path) {
+  std::unique_ptr<Header> &header = headers_[real_path];
+  if (!header) {
+    header = std::make_unique<Header>();
+    header->path_ = real_path;
+  }
+  header->once_ = true;
+}
+
+Preprocessor::~Preprocessor() {
+  for (auto &entry : headers_) {
+    if (entry.second->loaded_)
+      source::unload(entry.second->file_);
+  }
+  if (owned_)
+    source::unload(main_);
+}
+
+void Preprocessor::next(RawToken &tok) {
+  do
+    read_unexpanded(tok);
+  while (expand(tok));
+}
+
+void Preprocessor::read_raw(Source &src, RawToken &tok) {
+  if (src.has_peeked_) {
+    tok = src.peeked_;
+    src.has_peeked_ = false;
+    return;
+  }
+  if (src.replay_) {
+    tok = src.header_->tokens_[src.next_++];
+    return;
+  }
+  src.lexer_.next(tok);
+  if (src.recording_) {
+    src.header_->tokens_.push_back(tok);
+    if (tok.kind_ == TokenKind::Eof)
+      src.header_->complete_ = true;
+  }
+}
+
+// reads the next token of a directive, false at the end of its line. The
+// first token of the next line isn't lexed when it can be helped, the line
+// may be in a group that's skipped.
+bool Preprocessor::read_line(Source &src, RawToken &tok) {
+  if (!src.has_peeked_ && !src.replay_ && src.lexer_.at_line_end())
+    return false;
+  read_raw(src, tok);
+  if (tok.bol_ || tok.kind_ == TokenKind::Eof) {
+    src.peeked_ = tok;
+    src.has_peeked_ = true;
+    return false;
+  }
+  return true;
+}
+
+std::vector<RawToken> Preprocessor::rest_of_line(Source &src) {
+  std::vector<RawToken> line;
+  RawToken tok;
+  while (read_line(src, tok))
+    line.push_back(tok);
+  return line;
+}
+
+// the next token of the file being read, after directives. Included files
+// give way to their includer at the end, only the main file reads as Eof.
+void Preprocessor::read_file(RawToken &tok) {
+  for (;;) {
+    Source &src = sources_.back();
+    read_raw(src, tok);
+
+    if (tok.kind_ == TokenKind::Eof) {
+      if (conditionals_.size() > src.conditionals_)
+        error_at(conditionals_.back().at_,
+                 "unterminated conditional directive");
+      if (sources_.size() == 1)
+        return;
+      leave();
+      continue;
+    }
+
+    if (tok.bol_ && tok.kind_ == TokenKind::Hash) {
+      directive(tok);
+      continue;
+    }
+
+    // anything outside the guard's #ifndef means there's no guard.
+    if (src.guard_ != Guard::Inside)
+      src.guard_ = Guard::None;
+    last_loc_ = tok.loc_;
+    return;
+  }
+}
+
+void Preprocessor::read_unexpanded(RawToken &tok) {
+  while (!pending_.empty()) {
+    Pending &p = pending_.back();
+    if (p.stop_) {
+      tok = RawToken{};
+      return;
+    }
+    if (p.enable_) {
+      p.enable_->disabled_ = false;
+      pending_.pop_back();
+      continue;
+    }
+    tok = p.tok_;
+    pending_.pop_back();
+    return;
+  }
+  read_file(tok);
+}
+
+void Preprocessor::unread(const RawToken &tok) {
+  // Eof is where reading stops anyway, reading again finds it again.
+  if (tok.kind_ != TokenKind::Eof)
+    pending_.push_back(Pending{tok});
+}
+
+void Preprocessor::directive(const RawToken &hash) {
+  Source &src = sources_.back();
+  RawToken name;
+  // a # alone on its line does nothing.
+  if (!read_line(src, name))
+    return;
+  if (src.guard_ == Guard::After ||
+      (src.guard_ == Guard::Start && !is(name, "ifndef")))
+    src.guard_ = Guard::None;
+  std::vector<RawToken> line = rest_of_line(src);
+
+  if (is(name, "include")) {
+    include(hash, std::move(line));
+    return;
+  }
+
+  if (is(name, "define")) {
+    define(line, name);
+    return;
+  }
+
+  if (is(name, "undef")) {
+    if (line.empty() || !name_of(line[0]))
+      error_at(name, "macro name must be an identifier");
+    undefine(name_of(line[0]));
+    return;
+  }
+
+  if (is(name, "ifdef") || is(name, "ifndef")) {
+    if (line.empty() || !name_of(line[0]))
+      error_at(name, "macro name must be an identifier");
+    bool defined = macro(name_of(line[0]));
+    if (is(name, "ifdef")) {
+      push_conditional(defined, name);
+      return;
+    }
+    if (src.guard_ == Guard::Start) {
+      src.guard_ = Guard::Inside;
+      src.guard_macro_ = name_of(line[0]);
+      src.guard_depth_ = conditionals_.size() + 1;
+    }
+    push_conditional(!defined, name);
+    return;
+  }
+
+  if (is(name, "if")) {
+    push_conditional(evaluate(line, name), name);
+    return;
+  }
+
+  if (is(name, "elif") || is(name, "else")) {
+    if (conditionals_.size() <= src.conditionals_)
+      error_at(name, "#%s without #if", spelling(name).c_str());
+    Conditional &cond = conditionals_.back();
+    if (cond.else_)
+      error_at(name, "#%s after #else", spelling(name).c_str());
+    cond.else_ = is(name, "else");
+    if (src.guard_ == Guard::Inside &&
+        conditionals_.size() == src.guard_depth_)
+      src.guard_ = Guard::None;
+    // the group before was taken, every one left is skipped.
+    skip_group();
+    return;
+  }
+
+  if (is(name, "endif")) {
+    if (conditionals_.size() <= src.conditionals_)
+      error_at(name, "#endif without #if");
+    pop_conditional();
+    return;
+  }
+
+  if (is(name, "pragma")) {
+    if (!line.empty() && is(line[0], "once") && src.header_)
+      src.header_->once_ = true;
+    return;
+  }
+
+  if (is(name, "error")) {
+    std::string message = "#error";
+    for (const RawToken &tok : line)
+      message += " " + spelling(tok);
+    error_at(name, "%s", message.c_str());
+  }
+
+  // line markers don't change how anything is compiled.
+  if (is(name, "line"))
+    return;
+
+  error_at(name, "invalid preprocessing directive");
+}
+
+void Preprocessor::include(const RawToken &hash, std::vector<RawToken> line) {
+  // #include MACRO names the file once the macro is expanded.
+  if (!line.empty() && line[0].kind_ == TokenKind::Identifier)
+    line = expand_all(line);
+  if (line.empty())
+    error_at(hash, "expected a file name");
+
+  const RawToken &first = line[0];
+  std::string name;
+  bool angled = false;
+  if (first.kind_ == TokenKind::String) {
+    name.assign(first.loc_ + 1, first.len_ - 2);
+  } else if (first.kind_ == TokenKind::Lt) {
+    angled = true;
+    u64 i = 1;
+    for (; i < line.size() && line[i].kind_ != TokenKind::Gt; ++i) {
+      if (i > 1 && line[i].space_)
+        name += ' ';
+      name += spelling(line[i]);
+    }
+    if (i == line.size())
+      error_at(first, "expected '>'");
+  }
+  if (name.empty())
+    error_at(first, "expected a file name");
+
+  std::string path = find_include(name, angled);
+  if (path.empty())
+    error_at(first, "cannot find include file %s", name.c_str());
+
+  // one header reached by two paths is still one header.
+  std::unique_ptr<Header> &header = headers_[real_path(path.c_str())];
+  if (!header) {
+    header = std::make_unique<Header>();
+    header->path_ = path;
+  }
+
+  if (header->once_)
+    return;
+  if (header->guard_ != intern::kNoSymbol && macro(header->guard_))
+    return;
+  if (sources_.size() >= kMaxIncludeDepth)
+    error_at(hash, "#include nested too deeply");
+  enter(header.get());
+}
+
+// "" names are looked up next to the including file first, then both kinds
+// go through the -I directories and the system ones. Empty if not found.
+std::string Preprocessor::find_include(const std::string &name, bool angled) {
+  auto readable = [](const std::string &path) {
+    return access(path.c_str(), R_OK) == 0;
+  };
+
+  if (name[0] == '/')
+    return readable(name) ? name : "";
+
+  if (!angled) {
+    std::string dir = sources_.back().file_->path_;
+    u64 slash = dir.rfind('/');
+    std::string path =
+        slash == std::string::npos ? name : dir.substr(0, slash + 1) + name;
+    if (readable(path))
+      return path;
+  }
+
+  for (const std::string &dir : options_.include_paths_) {
+    std::string path = dir + "/" + name;
+    if (readable(path))
+      return path;
+  }
+  for (const char *dir : kSystemIncludePaths) {
+    std::string path = std::string(dir) + "/" + name;
+    if (readable(path))
+      return path;
+  }
+  return "";
+}
+
+void Preprocessor::enter(Header *header) {
+  Source src{&header->file_, token::Lexer(nullptr, nullptr)};
+  src.header_ = header;
+  src.conditionals_ = conditionals_.size();
+
+  if (header->complete_) {
+    src.replay_ = true;
+  } else if (header->loaded_) {
+    // included from inside itself before it was all read: lex it again
+    // without recording, its lines are known already.
+    src.lexer_ = token::Lexer(header->file_.contents_, nullptr);
+  } else {
+    header->file_ = source::load(header->path_.data());
+    header->loaded_ = true;
+    if (header->file_.size_ > UINT32_MAX)
+      diag::fail("%s: input is larger than 4GiB", header->path_.c_str());
+    token::add_file(&header->file_);
+    src.lexer_ = token::Lexer(header->file_.contents_, &header->file_);
+    src.recording_ = true;
+  }
+  sources_.push_back(std::move(src));
+}
+
+void Preprocessor::leave() {
+  Source &src = sources_.back();
+  if (src.header_ && src.guard_ == Guard::After)
+    src.header_->guard_ = src.guard_macro_;
+  sources_.pop_back();
+}
+
+void Preprocessor::define(const std::vector<RawToken> &line,
+                          const RawToken &at) {
+  if (line.empty() || !name_of(line[0]))
+    error_at(line.empty() ? at : line[0], "macro name must be an identifier");
+
+  auto m = std::make_unique<Macro>();
+  u64 i = 1;
+  // only a parenthesis right after the name makes a function-like macro.
+  if (i < line.size() && line[i].kind_ == TokenKind::LParen &&
+      !line[i].space_) {
+    m->function_like_ = true;
+    ++i;
+    for (bool first = true;; first = false) {
+      if (i == line.size())
+        error_at(line.back(), "expected ')'");
+      const RawToken &tok = line[i++];
+      if (first && tok.kind_ == TokenKind::RParen)
+        break;
+      if (tok.kind_ == TokenKind::Ellipsis) {
+        m->variadic_ = true;
+        m->params_.push_back(intern::intern("__VA_ARGS__"));
+        if (i == line.size() || line[i].kind_ != TokenKind::RParen)
+          error_at(tok, "expected ')'");
+        ++i;
+        break;
+      }
+      if (!name_of(tok))
+        error_at(tok, "expected a parameter name");
+      m->params_.push_back(name_of(tok));
+      if (i == line.size())
+        error_at(tok, "expected ')'");
+      const RawToken &sep = line[i++];
+      if (sep.kind_ == TokenKind::RParen)
+        break;
+      if (sep.kind_ != TokenKind::Comma)
+        error_at(sep, "expected ',' or ')'");
+    }
+  }
+
+  m->body_.assign(line.begin() + i, line.end());
+  if (!m->body_.empty() &&
+      (m->body_.front().kind_ == TokenKind::HashHash ||
+       m->body_.back().kind_ == TokenKind::HashHash))
+    error_at(m->body_.front(), "'##' cannot appear at either end of a macro");
+
+  define(name_of(line[0]), std::move(m));
+}
+
+void Preprocessor::define(intern::Symbol name, std::unique_ptr<Macro> macro) {
+  undefine(name);
+  if (name >= macros_.size())
+    macros_.resize(name + 1);
+  macros_[name] = std::move(macro);
+}
+
+// defines a macro from "name body" text, for predefined and -D macros.
+void Preprocessor::define_text(const std::string &text) {
+  char *buf = arena::current->strndup(text.data(), text.size());
+  token::Lexer lexer(buf, nullptr);
+  std::vector<RawToken> line;
+  RawToken tok;
+  for (lexer.next(tok); tok.kind_ != TokenKind::Eof; lexer.next(tok))
+    line.push_back(tok);
+  define(line, tok);
+}
+
+intern::Symbol Preprocessor::name_of(const RawToken &tok) {
+  if (tok.kind_ == TokenKind::Identifier)
+    return tok.sym_;
+  if (!token::is_keyword(tok.kind_))
+    return intern::kNoSymbol;
+  // keywords aren't interned by the lexer, each is once it's met here.
+  u64 k = static_cast<u64>(tok.kind_) - static_cast<u64>(TokenKind::KwAuto);
+  if (k >= keywords_.size())
+    keywords_.resize(k + 1, intern::kNoSymbol);
+  if (keywords_[k] == intern::kNoSymbol)
+    keywords_[k] = intern::intern(tok.loc_, tok.len_);
+  return keywords_[k];
+}
+
+void Preprocessor::undefine(intern::Symbol sym) {
+  if (sym < macros_.size() && macros_[sym])
+    retired_.push_back(std::move(macros_[sym]));
+}
+
+void Preprocessor::push_conditional(bool taken, const RawToken &at) {
+  conditionals_.push_back(Conditional{taken, false, at});
+  if (!taken)
+    skip_group();
+}
+
+void Preprocessor::pop_conditional() {
+  Source &src = sources_.back();
+  if (src.guard_ == Guard::Inside && conditionals_.size() == src.guard_depth_)
+    src.guard_ = Guard::After;
+  conditionals_.pop_back();
+}
+
+// skips the lines of a group up to the next one starting with #, unlexed. The
+// header being recorded would miss them, so it's left to be lexed again the
+// next time it's included.
+void Preprocessor::skip_text(Source &src) {
+  if (src.replay_ || src.has_peeked_ || !src.lexer_.skip_lines() ||
+      !src.recording_)
+    return;
+  src.recording_ = false;
+  src.header_->tokens_.clear();
+  src.header_->tokens_.shrink_to_fit();
+}
+
+// skips to the next group of the innermost conditional that is taken, or past
+// its #endif if none is. Only conditional directives are looked at on the
+// way, nested ones just need to be matched up.
+void Preprocessor::skip_group() {
+  Source &src = sources_.back();
+  u64 depth = 0;
+  for (;;) {
+    skip_text(src);
+    RawToken tok;
+    read_raw(src, tok);
+    if (tok.kind_ == TokenKind::Eof)
+      error_at(conditionals_.back().at_,
+               "unterminated conditional directive");
+    if (!tok.bol_ || tok.kind_ != TokenKind::Hash)
+      continue;
+
+    RawToken name;
+    if (!read_line(src, name))
+      continue;
+    if (is(name, "if") || is(name, "ifdef") || is(name, "ifndef")) {
+      ++depth;
+      continue;
+    }
+    if (is(name, "endif")) {
+      if (depth > 0) {
+        --depth;
+        continue;
+      }
+      rest_of_line(src);
+      pop_conditional();
+      return;
+    }
+    if (depth > 0 || !(is(name, "elif") || is(name, "else")))
+      continue;
+
+    Conditional &cond = conditionals_.back();
+    if (cond.else_)
+      error_at(name, "#%s after #else", spelling(name).c_str());
+    if (src.guard_ == Guard::Inside &&
+        conditionals_.size() == src.guard_depth_)
+      src.guard_ = Guard::None;
+
+    std::vector<RawToken> line = rest_of_line(src);
+    if (is(name, "else")) {
+      cond.else_ = true;
+      if (!cond.taken_) {
+        cond.taken_ = true;
+        return;
+      }
+    } else if (!cond.taken_ && evaluate(line, name)) {
+      cond.taken_ = true;
+      return;
+    }
+  }
+}
+
+// Evaluates #if expressions with C precedence in 64-bit signed arithmetic.
+// Identifiers still around after expansion read as zero.
+class Evaluator {
+public:
+  Evaluator(const std::vector<RawToken> &tokens, const RawToken &at)
+      : tokens_(tokens), at_(at) {}
+
+  i64 conditional() {
+    i64 cond = binary(0);
+    if (!accept(TokenKind::Question))
+      return cond;
+    i64 then = conditional();
+    if (!accept(TokenKind::Colon))
+      error_at(peek(), "expected ':'");
+    i64 otherwise = conditional();
+    return cond ? then : otherwise;
+  }
+
+  bool done() const { return pos_ == tokens_.size(); }
+  const RawToken &peek() const { return done() ? at_ : tokens_[pos_]; }
+
+private:
+  bool accept(TokenKind kind) {
+    if (done() || tokens_[pos_].kind_ != kind)
+      return false;
+    ++pos_;
+    return true;
+  }
+
+  static int precedence(TokenKind kind) {
+    switch (kind) {
+    case TokenKind::LogOr:
+      return 1;
+    case TokenKind::LogAnd:
+      return 2;
+    case TokenKind::Pipe:
+      return 3;
+    case TokenKind::Caret:
+      return 4;
+    case TokenKind::Amp:
+      return 5;
+    case TokenKind::Eq:
+    case TokenKind::Ne:
+      return 6;
+    case TokenKind::Lt:
+    case TokenKind::Gt:
+    case TokenKind::Le:
+    case TokenKind::Ge:
+      return 7;
+    case TokenKind::Shl:
+    case TokenKind::Shr:
+      return 8;
+    case TokenKind::Plus:
+    case TokenKind::Minus:
+      return 9;
+    case TokenKind::Star:
+    case TokenKind::Slash:
+    case TokenKind::Percent:
+      return 10;
+    default:
+      return 0;
+    }
+  }
+
+  // operators binding tighter than min, left to right.
+  i64 binary(int min) {
+    i64 lhs = unary();
+    while (!done()) {
+      const RawToken &op = tokens_[pos_];
+      int prec = precedence(op.kind_);
+      if (prec <= min)
+        break;
+      ++pos_;
+      i64 rhs = binary(prec);
+      lhs = apply(op, lhs, rhs);
+    }
+    return lhs;
+  }
+
+  static i64 apply(const RawToken &op, i64 lhs, i64 rhs) {
+    switch (op.kind_) {
+    case TokenKind::LogOr:
+      return lhs || rhs;
+    case TokenKind::LogAnd:
+      return lhs && rhs;
+    case TokenKind::Pipe:
+      return lhs | rhs;
+    case TokenKind::Caret:
+      return lhs ^ rhs;
+    case TokenKind::Amp:
+      return lhs & rhs;
+    case TokenKind::Eq:
+      return lhs == rhs;
+    case TokenKind::Ne:
+      return lhs != rhs;
+    case TokenKind::Lt:
+      return lhs < rhs;
+    case TokenKind::Gt:
+      return lhs > rhs;
+    case TokenKind::Le:
+      return lhs <= rhs;
+    case TokenKind::Ge:
+      return lhs >= rhs;
+    case TokenKind::Shl:
+      return (u64)lhs << (rhs & 63);
+    case TokenKind::Shr:
+      return lhs >> (rhs & 63);
+    case TokenKind::Plus:
+      return (u64)lhs + (u64)rhs;
+    case TokenKind::Minus:
+      return (u64)lhs - (u64)rhs;
+    case TokenKind::Star:
+      return (u64)lhs * (u64)rhs;
+    default:
+      if (rhs == 0)
+        error_at(op, "division by zero in #if");
+      if (op.kind_ == TokenKind::Slash)
+        return lhs / rhs;
+      return lhs % rhs;
+    }
+  }
+
+  i64 unary() {
+    if (done())
+      error_at(at_, "expected an expression");
+    const RawToken &tok = tokens_[pos_++];
+    switch (tok.kind_) {
+    case TokenKind::Plus:
+      return unary();
+    case TokenKind::Minus:
+      return -(u64)unary();
+    case TokenKind::Tilde:
+      return ~unary();
+    case TokenKind::Not:
+      return !unary();
+    case TokenKind::LParen: {
+      i64 val = conditional();
+      if (!accept(TokenKind::RParen))
+        error_at(peek(), "expected ')'");
+      return val;
+    }
+    case TokenKind::Num:
+      return token::read_number(tok.loc_);
+    default:
+      if (tok.kind_ == TokenKind::Identifier || token::is_keyword(tok.kind_))
+        return 0;
+      error_at(tok, "invalid token in #if");
+    }
+  }
+
+  const std::vector<RawToken> &tokens_;
+  const RawToken &at_;
+  u64 pos_ = 0;
+};
+
+bool Preprocessor::evaluate(const std::vector<RawToken> &line,
+                            const RawToken &at) {
+  // defined is settled before anything expands.
+  std::vector<RawToken> tokens;
+  for (u64 i = 0; i < line.size(); ++i) {
+    if (!is(line[i], "defined")) {
+      tokens.push_back(line[i]);
+      continue;
+    }
+    bool paren = i + 1 < line.size() && line[i + 1].kind_ == TokenKind::LParen;
+    u64 j = i + 1 + paren;
+    if (j >= line.size() || !name_of(line[j]))
+      error_at(line[i], "macro name must be an identifier");
+    if (paren &&
+        (j + 1 == line.size() || line[j + 1].kind_ != TokenKind::RParen))
+      error_at(line[j], "expected ')'");
+    tokens.push_back(synthesize(macro(name_of(line[j])) ? "1" : "0", line[i]));
+    i = j + paren;
+  }
+
+  tokens = expand_all(tokens);
+  Evaluator eval(tokens, at);
+  i64 val = eval.conditional();
+  if (!eval.done())
+    error_at(eval.peek(), "extra token in #if");
+  return val != 0;
+}
+
+// expands the macro tok names, if it does, by pushing the expansion back to
+// be read next. Returns false when tok is to be used as it is.
+bool Preprocessor::expand(RawToken &tok) {
+  if (tok.noexpand_)
+    return false;
+  Macro *m = macro(name_of(tok));
+  if (!m)
+    return false;
+  if (m->disabled_) {
+    tok.noexpand_ = true;
+    return false;
+  }
+  if (m->builtin_ != Builtin::None) {
+    tok = builtin(m, tok);
+    return false;
+  }
+
+  std::vector<RawToken> out;
+  if (m->function_like_) {
+    // without arguments the name is just a name.
+    RawToken paren;
+    read_unexpanded(paren);
+    if (paren.kind_ != TokenKind::LParen) {
+      unread(paren);
+      return false;
+    }
+    out = substitute(m, collect_args(m, tok));
+  } else {
+    out = substitute(m, {});
+  }
+
+  if (!out.empty())
+    out.front().space_ = tok.space_;
+  pending_.push_back(Pending{RawToken{}, m});
+  for (u64 i = out.size(); i-- > 0;)
+    pending_.push_back(Pending{out[i]});
+  m->disabled_ = true;
+  return true;
+}
+
+Preprocessor::Args Preprocessor::collect_args(Macro *m, const RawToken &name) {
+  Args args(1);
+  u64 depth = 0;
+  for (;;) {
+    RawToken tok;
+    read_unexpanded(tok);
+    if (tok.kind_ == TokenKind::Eof)
+      error_at(name, "unterminated call to macro %s", spelling(name).c_str());
+    if (depth == 0 && tok.kind_ == TokenKind::RParen)
+      break;
+    // the variadic argument takes everything left, commas included.
+    if (depth == 0 && tok.kind_ == TokenKind::Comma &&
+        !(m->variadic_ && args.size() == m->params_.size())) {
+      args.emplace_back();
+      continue;
+    }
+    if (tok.kind_ == TokenKind::LParen)
+      ++depth;
+    else if (tok.kind_ == TokenKind::RParen)
+      --depth;
+    args.back().push_back(tok);
+  }
+
+  if (m->params_.empty() && args.size() == 1 && args[0].empty())
+    args.clear();
+  if (m->variadic_ && args.size() == m->params_.size() - 1)
+    args.emplace_back();
+  if (args.size() != m->params_.size())
+    error_at(name, "macro %s takes %lu arguments, %lu given",
+             spelling(name).c_str(), m->params_.size(), args.size());
+  return args;
+}
+
+// the body of m with its parameters replaced, # and ## applied.
+std::vector<RawToken> Preprocessor::substitute(Macro *m, const Args &args) {
+  auto param = [&](const RawToken &tok) -> i64 {
+    intern::Symbol name = name_of(tok);
+    if (!name)
+      return -1;
+    for (u64 k = 0; k < m->params_.size(); ++k) {
+      if (m->params_[k] == name)
+        return k;
+    }
+    return -1;
+  };
+
+  // an argument is expanded once, and only if it's used outside # and ##.
+  std::vector<std::vector<RawToken>> expanded(args.size());
+  std::vector<bool> done(args.size());
+  const std::vector<RawToken> &body = m->body_;
+  std::vector<RawToken> out;
+  // the left operand of the coming ## is an empty argument.
+  bool placemarker = false;
+
+  for (u64 i = 0; i < body.size(); ++i) {
+    const RawToken &tok = body[i];
+
+    if (m->function_like_ && tok.kind_ == TokenKind::Hash) {
+      i64 k = i + 1 < body.size() ? param(body[i + 1]) : -1;
+      if (k < 0)
+        error_at(tok, "'#' is not followed by a macro parameter");
+      out.push_back(stringize(args[k], tok));
+      placemarker = false;
+      ++i;
+      continue;
+    }
+
+    if (tok.kind_ == TokenKind::HashHash) {
+      const RawToken &rhs = body[++i];
+      i64 k = param(rhs);
+      std::vector<RawToken> operand;
+      if (k >= 0)
+        operand = args[k];
+      else
+        operand.push_back(rhs);
+      if (operand.empty())
+        continue;
+      if (placemarker || out.empty()) {
+        out.insert(out.end(), operand.begin(), operand.end());
+      } else {
+        out.back() = paste(out.back(), operand[0]);
+        out.insert(out.end(), operand.begin() + 1, operand.end());
+      }
+      placemarker = false;
+      continue;
+    }
+
+    i64 k = param(tok);
+    if (k < 0) {
+      out.push_back(tok);
+      placemarker = false;
+      continue;
+    }
+
+    // operands of ## are pasted as written.
+    if (i + 1 < body.size() && body[i + 1].kind_ == TokenKind::HashHash) {
+      out.insert(out.end(), args[k].begin(), args[k].end());
+      placemarker = args[k].empty();
+      continue;
+    }
+
+    if (!done[k]) {
+      expanded[k] = expand_all(args[k]);
+      done[k] = true;
+    }
+    u64 first = out.size();
+    out.insert(out.end(), expanded[k].begin(), expanded[k].end());
+    if (out.size() > first)
+      out[first].space_ = tok.space_;
+    placemarker = false;
+  }
+  return out;
+}
+
+// fully expands a list of tokens without reading past its end.
+std::vector<RawToken>
+Preprocessor::expand_all(const std::vector<RawToken> &tokens) {
+  pending_.push_back(Pending{RawToken{}, nullptr, true});
+  for (u64 i = tokens.size(); i-- > 0;)
+    pending_.push_back(Pending{tokens[i]});
+
+  std::vector<RawToken> out;
+  for (;;) {
+    RawToken tok;
+    read_unexpanded(tok);
+    if (tok.kind_ == TokenKind::Eof)
+      break;
+    if (!expand(tok))
+      out.push_back(tok);
+  }
+  pending_.pop_back();
+  return out;
+}
+
+// __FILE__ and __LINE__ of the last token read from a file.
+RawToken Preprocessor::builtin(Macro *m, const RawToken &tok) {
+  const source::File *file = last_loc_ ? token::file_of(last_loc_) : nullptr;
+  if (!file)
+    return synthesize(m->builtin_ == Builtin::File ? "\"\"" : "0", tok);
+
+  if (m->builtin_ == Builtin::Line) {
+    u32 line = source::locate(*file, last_loc_).line_;
+    return synthesize(std::to_string(line), tok);
+  }
+
+  std::string text = "\"";
+  for (const char *p = file->path_; *p; ++p) {
+    if (*p == '"' || *p == '\\')
+      text += '\\';
+    text += *p;
+  }
+  return synthesize(text + "\"", tok);
+}
+
+RawToken Preprocessor::stringize(const std::vector<RawToken> &tokens,
+                                 const RawToken &at) {
+  std::string text = "\"";
+  for (u64 i = 0; i < tokens.size(); ++i) {
+    const RawToken &tok = tokens[i];
+    if (i > 0 && tok.space_)
+      text += ' ';
+    bool literal = tok.kind_ == TokenKind::String ||
+                   (tok.kind_ == TokenKind::Num && *tok.loc_ == '\'');
+    for (u32 j = 0; j < tok.len_; ++j) {
+      char c = tok.loc_[j];
+      if (literal && (c == '"' || c == '\\'))
+        text += '\\';
+      text += c;
+    }
+  }
+  return synthesize(text + "\"", at);
+}
+
+RawToken Preprocessor::paste(const RawToken &lhs, const RawToken &rhs) {
+  return synthesize(spelling(lhs) + spelling(rhs), lhs);
+}
+
+// lexes text, which must spell exactly one token, into a token placed at at.
+RawToken Preprocessor::synthesize(const std::string &text,
+                                  const RawToken &at) {
+  char *buf = arena::current->strndup(text.data(), text.size());
+  token::Lexer lexer(buf, nullptr);
+  RawToken tok, rest;
+  lexer.next(tok);
+  lexer.next(rest);
+  if (tok.kind_ == TokenKind::Eof || rest.kind_ != TokenKind::Eof)
+    error_at(at, "'%s' is not a valid token", text.c_str());
+  tok.bol_ = false;
+  tok.space_ = at.space_;
+  return tok;
+}
+
+} // namespace preprocess
@@ -0,0 +1,191 @@
+#ifndef _ASMLAI_PREPROCESS_H
+#define _ASMLAI_PREPROCESS_H
+
+#include "intern.h"
+#include "source.h"
+#include "token.h"
+#include "types.h"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// The preprocessor sits between the lexer and the token ring and works on raw
+// tokens: directives are read off the token stream and macros expand into
+// token lists. A header is lexed once per compilation, later inclusions
+// replay its recorded tokens, and a header wrapped in an include guard or
+// marked #pragma once is skipped outright once it is known to be empty.
+namespace preprocess {
+
+struct Options {
+  // -I directories, searched in order after the includer's own directory.
+  std::vector<std::string> include_paths_;
+  // -D arguments, "name" or "name=value".
+  std::vector<std::string> defines_;
+};
+
+enum class Builtin : u8 {
+  None,
+  File,
+  Line,
+};
+
+struct Macro {
+  bool function_like_ = false;
+  // the last parameter is __VA_ARGS__.
+  bool variadic_ = false;
+  // set while its expansion is being read, so it doesn't expand again.
+  bool disabled_ = false;
+  Builtin builtin_ = Builtin::None;
+  std::vector<intern::Symbol> params_;
+  std::vector<token::RawToken> body_;
+};
+
+class Preprocessor {
+public:
+  // main is the file being compiled, it's unloaded at the end when owned.
+  Preprocessor(source::File main, bool owned, const Options &options);
+  ~Preprocessor();
+  Preprocessor(const Preprocessor &) = delete;
+  Preprocessor &operator=(const Preprocessor &) = delete;
+
+  // the next token after preprocessing, Eof once the main file ends.
+  void next(token::RawToken &tok);
+
+  // headers read from disk, each counted once however often it's included.
+  u64 headers() const;
+
+  // the macro defined for each symbol, null where there is none.
+  const std::vector<std::unique_ptr<Macro>> &macros() const {
+    return macros_;
+  }
+  void define(intern::Symbol name, std::unique_ptr<Macro> macro);
+  // real paths of the main file and every header read.
+  std::vector<std::string> files() const;
+  // takes the header at real_path as included already, #include skips it.
+  void skip_header(const std::string &real_path);
+
+private:
+  // a header file and its tokens as lexed the first time it was included.
+  struct Header {
+    std::string path_;
+    source::File file_;
+    bool loaded_ = false;
+    // tokens_ holds the whole file, up to and including its Eof.
+    bool complete_ = false;
+    // #pragma once was seen.
+    bool once_ = false;
+    // the macro whose definition makes the header empty, if any.
+    intern::Symbol guard_ = intern::kNoSymbol;
+    std::vector<token::RawToken> tokens_;
+  };
+
+  // how far a file is into the #ifndef X ... #endif pattern.
+  enum class Guard : u8 {
+    Start,
+    Inside,
+    After,
+    None,
+  };
+
+  // a file being read, lexed as it goes or replayed from its Header.
+  struct Source {
+    const source::File *file_;
+    token::Lexer lexer_;
+    Header *header_ = nullptr;
+    // the tokens are appended to header_ as they are lexed.
+    bool recording_ = false;
+    bool replay_ = false;
+    u64 next_ = 0;
+    // a token put back by a directive that read one too far.
+    token::RawToken peeked_;
+    bool has_peeked_ = false;
+    // depth of the conditional stack when the file was entered.
+    u64 conditionals_ = 0;
+    Guard guard_ = Guard::Start;
+    intern::Symbol guard_macro_ = intern::kNoSymbol;
+    u64 guard_depth_ = 0;
+  };
+
+  struct Conditional {
+    // a group of this conditional was already taken, the rest are skipped.
+    bool taken_;
+    bool else_ = false;
+    // the #if, #ifdef or #ifndef that opened it.
+    token::RawToken at_;
+  };
+
+  // a token waiting to be read again, the point where a macro's expansion
+  // ends and it's enabled again, or the end of a list being expanded.
+  struct Pending {
+    token::RawToken tok_;
+    Macro *enable_ = nullptr;
+    bool stop_ = false;
+  };
+
+  using Args = std::vector<std::vector<token::RawToken>>;
+
+  void read_raw(Source &src, token::RawToken &tok);
+  bool read_line(Source &src, token::RawToken &tok);
+  std::vector<token::RawToken> rest_of_line(Source &src);
+  void read_file(token::RawToken &tok);
+  void read_unexpanded(token::RawToken &tok);
+  void unread(const token::RawToken &tok);
+
+  void directive(const token::RawToken &hash);
+  void include(const token::RawToken &hash,
+               std::vector<token::RawToken> line);
+  std::string find_include(const std::string &name, bool angled);
+  void enter(Header *header);
+  void leave();
+  void define(const std::vector<token::RawToken> &line,
+              const token::RawToken &at);
+  void define_text(const std::string &text);
+  void undefine(intern::Symbol sym);
+  void push_conditional(bool taken, const token::RawToken &at);
+  void pop_conditional();
+  void skip_group();
+  void skip_text(Source &src);
+  bool evaluate(const std::vector<token::RawToken> &line,
+                const token::RawToken &at);
+
+  // the name tok gives a macro: identifiers, and keywords since a macro may
+  // be named like one. kNoSymbol for any other token.
+  intern::Symbol name_of(const token::RawToken &tok);
+  Macro *macro(intern::Symbol sym) const {
+    return sym < macros_.size() ? macros_[sym].get() : nullptr;
+  }
+  bool expand(token::RawToken &tok);
+  Args collect_args(Macro *m, const token::RawToken &name);
+  std::vector<token::RawToken> substitute(Macro *m, const Args &args);
+  std::vector<token::RawToken>
+  expand_all(const std::vector<token::RawToken> &tokens);
+  token::RawToken builtin(Macro *m, const token::RawToken &tok);
+  token::RawToken stringize(const std::vector<token::RawToken> &tokens,
+                            const token::RawToken &at);
+  token::RawToken paste(const token::RawToken &lhs,
+                        const token::RawToken &rhs);
+  token::RawToken synthesize(const std::string &text,
+                             const token::RawToken &at);
+
+  const Options &options_;
+  source::File main_;
+  bool owned_;
+  std::vector<Source> sources_;
+  std::vector<Conditional> conditionals_;
+  std::vector<Pending> pending_;
+  // macros by symbol; undefined ones are kept in retired_ since a pending
+  // expansion may still point at them.
+  std::vector<std::unique_ptr<Macro>> macros_;
+  std::vector<std::unique_ptr<Macro>> retired_;
+  // symbols of the keywords, by kind from KwAuto on.
+  std::vector<intern::Symbol> keywords_;
+  // by real path.
+  std::unordered_map<std::string, std::unique_ptr<Header>> headers_;
+  // the last token read from a file, __FILE__ and __LINE__ refer to it.
+  char *last_loc_ = nullptr;
+};
+
+} // namespace preprocess
+
+#endif
@@ -0,0 +1,251 @@
+#include "scan.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define ASMLAI_X86 1
+#endif
+
+namespace scan {
+
+static bool is_space(char c) {
+  return c == ' ' || ('\t' <= c && c <= '\r');
+}
+
+static bool is_ident(char c) {
+  return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') ||
+         ('0' <= c && c <= '9') || c == '_';
+}
+
+static char *skip_whitespace_scalar(char *p) {
+  while (is_space(*p))
+    ++p;
+  return p;
+}
+
+static char *identifier_end_scalar(char *p) {
+  while (is_ident(*p))
+    ++p;
+  return p;
+}
+
+static char *line_end_scalar(char *p) {
+  while (*p != '\n' && *p != '\0')
+    ++p;
+  return p;
+}
+
+static char *star_scalar(char *p) {
+  while (*p != '*' && *p != '\0')
+    ++p;
+  return p;
+}
+
+static char *string_special_scalar(char *p) {
+  while (*p != '"' && *p != '\\' && *p != '\n' && *p != '\0')
+    ++p;
+  return p;
+}
+
+#ifdef ASMLAI_X86
+// All kernels below return a bitmask of the bytes in a block where scanning
+// has to stop. The block containing p is loaded aligned and the bits before p
+// are shifted out, so no load ever crosses into a page past the input.
+
+// byte is within [lo, lo + n] using unsigned saturation.
+#define IN_RANGE_128(v, lo, n)                                                 \
+  _mm_cmpeq_epi8(                                                              \
+      _mm_min_epu8(_mm_sub_epi8(v, _mm_set1_epi8(lo)), _mm_set1_epi8(n)),      \
+      _mm_sub_epi8(v, _mm_set1_epi8(lo)))
+#define IN_RANGE_256(v, lo, n)                                                 \
+  _mm256_cmpeq_epi8(_mm256_min_epu8(_mm256_sub_epi8(v, _mm256_set1_epi8(lo)),  \
+                                    _mm256_set1_epi8(n)),                      \
+                    _mm256_sub_epi8(v, _mm256_set1_epi8(lo)))
+
+static u32 space_stop_sse2(__m128i v) {
+  __m128i space = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                               IN_RANGE_128(v, '\t', '\r' - '\t'));
+  return ~static_cast<u32>(_mm_movemask_epi8(space)) & 0xffff;
+}
+
+static u32 ident_stop_sse2(__m128i v) {
+  __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+  __m128i ident = _mm_or_si128(
+      _mm_or_si128(IN_RANGE_128(lower, 'a', 'z' - 'a'),
+                   IN_RANGE_128(v, '0', '9' - '0')),
+      _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+  return ~static_cast<u32>(_mm_movemask_epi8(ident)) & 0xffff;
+}
+
+static u32 line_stop_sse2(__m128i v) {
+  __m128i stop = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                              _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+  return _mm_movemask_epi8(stop);
+}
+
+static u32 star_stop_sse2(__m128i v) {
+  __m128i stop = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('*')),
+                              _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+  return _mm_movemask_epi8(stop);
+}
+
+static u32 string_stop_sse2(__m128i v) {
+  __m128i stop = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+                   _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))),
+      _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                   _mm_cmpeq_epi8(v, _mm_setzero_si128())));
+  return _mm_movemask_epi8(stop);
+}
+
+template <u32 (*Stop)(__m128i)> static char *scan_sse2(char *p) {
+  u64 off = reinterpret_cast<std::uintptr_t>(p) & 15;
+  char *block = p - off;
+  u32 mask = Stop(_mm_load_si128(reinterpret_cast<const __m128i *>(block)));
+  mask >>= off;
+  if (mask)
+    return p + __builtin_ctz(mask);
+
+  for (;;) {
+    block += 16;
+    mask = Stop(_mm_load_si128(reinterpret_cast<const __m128i *>(block)));
+    if (mask)
+      return block + __builtin_ctz(mask);
+  }
+}
+
+#define TARGET_AVX2 __attribute__((target("avx2")))
+
+TARGET_AVX2 static u32 space_stop_avx2(__m256i v) {
+  __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                                  IN_RANGE_256(v, '\t', '\r' - '\t'));
+  return ~static_cast<u32>(_mm256_movemask_epi8(space));
+}
+
+TARGET_AVX2 static u32 ident_stop_avx2(__m256i v) {
+  __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+  __m256i ident = _mm256_or_si256(
+      _mm256_or_si256(IN_RANGE_256(lower, 'a', 'z' - 'a'),
+                      IN_RANGE_256(v, '0', '9' - '0')),
+      _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+  return ~static_cast<u32>(_mm256_movemask_epi8(ident));
+}
+
+TARGET_AVX2 static u32 line_stop_avx2(__m256i v) {
+  __m256i stop = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+                                 _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+  return _mm256_movemask_epi8(stop);
+}
+
+TARGET_AVX2 static u32 star_stop_avx2(__m256i v) {
+  __m256i stop = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('*')),
+                                 _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+  return _mm256_movemask_epi8(stop);
+}
+
+TARGET_AVX2 static u32 string_stop_avx2(__m256i v) {
+  __m256i stop = _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')),
+                      _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))),
+      _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+                      _mm256_cmpeq_epi8(v, _mm256_setzero_si256())));
+  return _mm256_movemask_epi8(stop);
+}
+
+template <u32 (*Stop)(__m256i)>
+TARGET_AVX2 static char *scan_avx2(char *p) {
+  u64 off = reinterpret_cast<std::uintptr_t>(p) & 31;
+  char *block = p - off;
+  u32 mask = Stop(_mm256_load_si256(reinterpret_cast<const __m256i *>(block)));
+  mask >>= off;
+  if (mask)
+    return p + __builtin_ctz(mask);
+
+  for (;;) {
+    block += 32;
+    mask = Stop(_mm256_load_si256(reinterpret_cast<const __m256i *>(block)));
+    if (mask)
+      return block + __builtin_ctz(mask);
+  }
+}
+#endif
+
+struct Kernels {
+  Level level_;
+  char *(*skip_whitespace_)(char *);
+  char *(*identifier_end_)(char *);
+  char *(*line_end_)(char *);
+  char *(*star_)(char *);
+  char *(*string_special_)(char *);
+};
+
+static Kernels pick_kernels() {
+  Kernels scalar{Level::Scalar,         skip_whitespace_scalar,
+                 identifier_end_scalar, line_end_scalar,
+                 star_scalar,           string_special_scalar};
+#ifdef ASMLAI_X86
+  Kernels sse2{Level::SSE2,
+               scan_sse2<space_stop_sse2>,
+               scan_sse2<ident_stop_sse2>,
+               scan_sse2<line_stop_sse2>,
+               scan_sse2<star_stop_sse2>,
+               scan_sse2<string_stop_sse2>};
+  Kernels avx2{Level::AVX2,
+               scan_avx2<space_stop_avx2>,
+               scan_avx2<ident_stop_avx2>,
+               scan_avx2<line_stop_avx2>,
+               scan_avx2<star_stop_avx2>,
+               scan_avx2<string_stop_avx2>};
+
+  const char *forced = std::getenv("ASMLAI_SIMD");
+  if (forced && !std::strcmp(forced, "scalar"))
+    return scalar;
+  if (forced && !std::strcmp(forced, "sse2"))
+    return sse2;
+
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return avx2;
+  return sse2;
+#else
+  return scalar;
+#endif
+}
+
+static const Kernels kernels = pick_kernels();
+
+char *skip_whitespace(char *p) { return kernels.skip_whitespace_(p); }
+
+char *identifier_end(char *p) { return kernels.identifier_end_(p); }
+
+char *line_end(char *p) { return kernels.line_end_(p); }
+
+char *block_comment_end(char *p) {
+  for (;;) {
+    p = kernels.star_(p);
+    if (*p == '\0')
+      return nullptr;
+    if (p[1] == '/')
+      return p;
+    ++p;
+  }
+}
+
+char *string_special(char *p) { return kernels.string_special_(p); }
+
+Level level() { return kernels.level_; }
+
+const char *level_name(Level level) {
+  switch (level) {
+  case Level::SSE2:
+    return "sse2";
+  case Level::AVX2:
+    return "avx2";
+  default:
+    return "scalar";
+  }
+}
+} // namespace scan
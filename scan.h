@@ -0,0 +1,37 @@
+#ifndef _ASMLAI_SCAN_H
+#define _ASMLAI_SCAN_H
+
+#include "types.h"
+
+// Vectorized scanning primitives for the lexer. Every function takes a pointer
+// into a NUL terminated buffer and never reports a position past the NUL.
+// Kernels use aligned loads only, so they never touch a page that doesn't also
+// hold a byte of the input.
+namespace scan {
+
+enum class Level {
+  Scalar,
+  SSE2,
+  AVX2,
+};
+
+// first character that isn't one of " \t\n\v\f\r".
+char *skip_whitespace(char *p);
+// first character that can't be part of an identifier.
+char *identifier_end(char *p);
+// the next '\n' or the terminating NUL.
+char *line_end(char *p);
+// the '*' of the next "*/", nullptr if the input ends before one.
+char *block_comment_end(char *p);
+// next character of a string literal body that needs attention: '"', '\\',
+// '\n' or the terminating NUL.
+char *string_special(char *p);
+
+// the kernels in use, picked from what the cpu supports. ASMLAI_SIMD can be set
+// to scalar, sse2 or avx2 to force a lower level.
+Level level();
+const char *level_name(Level level);
+
+} // namespace scan
+
+#endif
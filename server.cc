@@ -0,0 +1,147 @@
+#include "server.h"
+#include "diag.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <string_view>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace server {
+
+template <typename... Args>
+[[noreturn]] static void fatal(const char *format_string, Args... args) {
+  std::fprintf(stderr, format_string, args...);
+  std::fprintf(stderr, "\n");
+  std::exit(1);
+}
+
+static bool read_all(int fd, std::string &data) {
+  char buffer[64 * 1024];
+  for (;;) {
+    ssize_t n = read(fd, buffer, sizeof(buffer));
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      return false;
+    if (n == 0)
+      return true;
+    data.append(buffer, n);
+  }
+}
+
+static void write_all(int fd, std::string_view data) {
+  while (!data.empty()) {
+    ssize_t n = write(fd, data.data(), data.size());
+    if (n < 0 && errno == EINTR)
+      continue;
+    // the client went away, nobody is left to tell.
+    if (n < 0)
+      return;
+    data.remove_prefix(n);
+  }
+}
+
+static Request parse_request(std::string &data) {
+  Request request;
+  std::string_view rest = data;
+  for (;;) {
+    u64 end = rest.find('\n');
+    if (end == std::string_view::npos)
+      diag::fail("request header isn't terminated by an empty line");
+    std::string_view line = rest.substr(0, end);
+    rest.remove_prefix(end + 1);
+    if (line.empty())
+      break;
+
+    u64 space = line.find(' ');
+    std::string_view key = line.substr(0, space);
+    std::string_view value =
+        space == std::string_view::npos ? "" : line.substr(space + 1);
+    if (key == "path") {
+      request.path_ = value;
+    } else if (key == "name") {
+      request.name_ = value;
+    } else if (key == "mode" && (value == "asm" || value == "obj")) {
+      request.object_ = value == "obj";
+    } else if (key == "include" && !value.empty()) {
+      request.options_.include_paths_.emplace_back(value);
+    } else if (key == "define" && !value.empty()) {
+      request.options_.defines_.emplace_back(value);
+    } else if (key == "pch" && !value.empty()) {
+      request.pch_ = value;
+    } else {
+      diag::fail("bad request header: %.*s", (int)line.size(), line.data());
+    }
+  }
+
+  request.source_ = rest;
+  return request;
+}
+
+static void handle(int fd, Compiler compile) {
+  std::string data;
+  if (!read_all(fd, data))
+    return;
+
+  output::Writer out;
+  std::string_view status = "ok ";
+  std::string error;
+  try {
+    Request request = parse_request(data);
+    compile(request, out);
+  } catch (const diag::CompileError &e) {
+    status = "error ";
+    error = e.what();
+  } catch (const std::exception &e) {
+    // e.g. running out of memory, the request fails but the server goes on.
+    status = "error ";
+    error = std::string("internal error: ") + e.what();
+  }
+
+  std::string_view body = error.empty() ? out.text() : error;
+  std::string header(status);
+  header += std::to_string(body.size());
+  header += '\n';
+  write_all(fd, header);
+  write_all(fd, body);
+}
+
+void serve(const char *path, Compiler compile) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (std::strlen(path) >= sizeof(addr.sun_path))
+    fatal("socket path too long: %s", path);
+  std::strcpy(addr.sun_path, path);
+
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0)
+    fatal("cannot create socket: %s", strerror(errno));
+  // a socket left behind by an earlier server.
+  unlink(path);
+  if (bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0)
+    fatal("cannot bind %s: %s", path, strerror(errno));
+  if (listen(listener, SOMAXCONN) < 0)
+    fatal("cannot listen on %s: %s", path, strerror(errno));
+
+  // a client hanging up early must not kill the server.
+  std::signal(SIGPIPE, SIG_IGN);
+
+  for (;;) {
+    int fd = accept(listener, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR)
+        continue;
+      fatal("accept failed: %s", strerror(errno));
+    }
+    handle(fd, compile);
+    close(fd);
+  }
+}
+
+} // namespace server
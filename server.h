@@ -0,0 +1,41 @@
+#ifndef _ASMLAI_SERVER_H
+#define _ASMLAI_SERVER_H
+
+#include "output.h"
+#include "preprocess.h"
+#include <string>
+
+// A compile server on a Unix socket. Every connection carries one request,
+// the process and everything it has warmed up stays around between them.
+//
+// A request is a header of "key value" lines ended by an empty line:
+//   path <file>     compile this file
+//   name <name>     file name for diagnostics when the source is sent along
+//   mode asm|obj    assembly (the default) or an object file
+//   include <dir>   like -I, may be given more than once
+//   define <def>    like -D, may be given more than once
+//   pch <file>      like --include-pch
+// Without a path everything after the header is the source. The client shuts
+// down its side once the request is sent. The reply is "ok <size>\n" followed
+// by the output, or "error <size>\n" followed by the diagnostic. Options the
+// server was started with don't apply to requests, each brings its own.
+namespace server {
+
+struct Request {
+  std::string path_;
+  std::string name_ = "<input>";
+  std::string source_;
+  bool object_ = false;
+  preprocess::Options options_;
+  std::string pch_;
+};
+
+// compiles request into out, errors are thrown as diag::CompileError.
+using Compiler = void (*)(Request &request, output::Writer &out);
+
+// serves requests on a socket at path until killed.
+[[noreturn]] void serve(const char *path, Compiler compile);
+
+} // namespace server
+
+#endif
@@ -0,0 +1,148 @@
+#include "source.h"
+#include "diag.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace source {
+static char empty_contents[1] = {'\0'};
+
+template <typename... Args>
+[[noreturn]] static void error(const char *format_string, Args... args) {
+  diag::fail(format_string, args...);
+}
+
+static File read_stream(char *path, int fd) {
+  u64 capacity = 64 * 1024;
+  u64 size = 0;
+  char *buf = static_cast<char *>(std::malloc(capacity));
+  if (!buf)
+    error("cannot read %s: out of memory", path);
+
+  for (;;) {
+    // always keep room for the terminating NUL.
+    if (size + 1 == capacity) {
+      capacity *= 2;
+      char *grown = static_cast<char *>(std::realloc(buf, capacity));
+      if (!grown) {
+        std::free(buf);
+        error("cannot read %s: out of memory", path);
+      }
+      buf = grown;
+    }
+
+    ssize_t n = read(fd, buf + size, capacity - size - 1);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      int err = errno;
+      std::free(buf);
+      error("cannot read %s: %s", path, strerror(err));
+    }
+    if (n == 0)
+      break;
+    size += n;
+  }
+
+  buf[size] = '\0';
+
+  File file;
+  file.path_ = path;
+  file.contents_ = buf;
+  file.size_ = size;
+  return file;
+}
+
+static File map_file(char *path, int fd, u64 size) {
+  u64 page = sysconf(_SC_PAGESIZE);
+  // the mapping is at least one byte longer than the file. A partial last
+  // page reads as zeros past the end of the file; when the file ends on a page
+  // boundary an extra anonymous zero page provides the NUL instead.
+  u64 mapped_size = (size + page) / page * page;
+
+  void *region = mmap(nullptr, mapped_size, PROT_READ,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (region == MAP_FAILED)
+    error("cannot map %s: %s", path, strerror(errno));
+
+  void *contents =
+      mmap(region, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+  if (contents == MAP_FAILED) {
+    int err = errno;
+    munmap(region, mapped_size);
+    error("cannot map %s: %s", path, strerror(err));
+  }
+
+  File file;
+  file.path_ = path;
+  file.contents_ = static_cast<char *>(contents);
+  file.size_ = size;
+  file.mapped_size_ = mapped_size;
+  return file;
+}
+
+File load(char *path) {
+  if (strcmp(path, "-") == 0)
+    return read_stream(path, STDIN_FILENO);
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    error("cannot open %s: %s", path, strerror(errno));
+  // errors are thrown, and the compiler may go on with other files.
+  struct Close {
+    int fd_;
+    ~Close() { close(fd_); }
+  } close_fd{fd};
+
+  struct stat st;
+  if (fstat(fd, &st) < 0)
+    error("cannot stat %s: %s", path, strerror(errno));
+  if (S_ISDIR(st.st_mode))
+    error("cannot read %s: %s", path, strerror(EISDIR));
+
+  File file;
+  if (!S_ISREG(st.st_mode)) {
+    // pipes and character devices can't be mapped.
+    file = read_stream(path, fd);
+  } else if (st.st_size == 0) {
+    file.path_ = path;
+    file.contents_ = empty_contents;
+  } else {
+    file = map_file(path, fd, st.st_size);
+  }
+  return file;
+}
+
+Location locate(const File &file, const char *loc) {
+  u32 offset = loc - file.contents_;
+  // the last line starting at or before offset.
+  auto it = std::upper_bound(file.line_starts_.begin(),
+                             file.line_starts_.end(), offset);
+  u32 line = it - file.line_starts_.begin();
+  return Location{line, offset - *(it - 1) + 1};
+}
+
+char *line_start(const File &file, const char *loc) {
+  Location at = locate(file, loc);
+  return file.contents_ + file.line_starts_[at.line_ - 1];
+}
+
+void unload(File &file) {
+  if (file.mapped_size_) {
+    munmap(file.contents_, file.mapped_size_);
+  } else if (file.contents_ != empty_contents) {
+    std::free(file.contents_);
+  }
+
+  file.contents_ = nullptr;
+  file.size_ = file.mapped_size_ = 0;
+  file.line_starts_.assign(1, 0);
+}
+} // namespace source
@@ -0,0 +1,42 @@
+#ifndef _ASMLAI_SOURCE_H
+#define _ASMLAI_SOURCE_H
+
+#include "types.h"
+#include <vector>
+
+namespace source {
+
+// File is the contents of one input. contents_ is always followed by a NUL
+// that the lexer can stop on, but isn't necessarily writable: regular files
+// are mapped read-only and tokens point straight into the mapping.
+struct File {
+  char *path_ = nullptr;
+  char *contents_ = nullptr;
+  u64 size_ = 0;
+
+  // length of the mapping when contents_ is mmap'ed, zero for read buffers.
+  u64 mapped_size_ = 0;
+
+  // offset of the first character of every line, filled in by the lexer as it
+  // goes. Always sorted, line_starts_[0] is the first line.
+  std::vector<u32> line_starts_{0};
+};
+
+struct Location {
+  u32 line_;   // 1-based
+  u32 column_; // 1-based, in bytes
+};
+
+// line and column of a position inside the part of the file lexed so far.
+Location locate(const File &file, const char *loc);
+// first character of the line containing loc.
+char *line_start(const File &file, const char *loc);
+
+// load a file, "-" reads stdin. Throws diag::CompileError when it can't be
+// read, nothing it opened or allocated is left behind.
+File load(char *path);
+void unload(File &file);
+
+} // namespace source
+
+#endif
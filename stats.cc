@@ -0,0 +1,198 @@
+#include "stats.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <ctime>
+#include <malloc.h>
+#include <new>
+#include <sys/resource.h>
+
+namespace stats {
+bool tracking = false;
+
+// what the thread has used. Bytes given back may have been taken by another
+// thread, so bytes_in_use_ can go below zero.
+struct Counters {
+  u64 allocations_;
+  i64 bytes_in_use_;
+  i64 peak_bytes_;
+  // CPU time of helpers, on top of the thread's own.
+  double helper_cpu_ms_;
+};
+
+static thread_local Counters counters;
+
+void note_bytes(i64 bytes) {
+  counters.bytes_in_use_ += bytes;
+  counters.peak_bytes_ =
+      std::max(counters.peak_bytes_, counters.bytes_in_use_);
+}
+
+static void *allocate(std::size_t size) {
+  void *p = std::malloc(size ? size : 1);
+  if (p && tracking) {
+    ++counters.allocations_;
+    note_bytes(malloc_usable_size(p));
+  }
+  return p;
+}
+
+static void release(void *p) {
+  if (p && tracking)
+    note_bytes(-static_cast<i64>(malloc_usable_size(p)));
+  std::free(p);
+}
+
+static double thread_cpu_ms() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static double cpu_ms() { return thread_cpu_ms() + counters.helper_cpu_ms_; }
+
+// the process's resident set at its largest so far, in kilobytes.
+static u64 peak_rss_kb() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+void Helper::start() {
+  cpu_ms_ = thread_cpu_ms();
+  allocations_ = counters.allocations_;
+  bytes_ = counters.bytes_in_use_;
+  counters.peak_bytes_ = counters.bytes_in_use_;
+}
+
+void Helper::done() {
+  cpu_ms_ = thread_cpu_ms() - cpu_ms_;
+  allocations_ = counters.allocations_ - allocations_;
+  peak_bytes_ = counters.peak_bytes_ - bytes_;
+  bytes_ = counters.bytes_in_use_ - bytes_;
+}
+
+void add_helper(const Helper &helper) {
+  counters.helper_cpu_ms_ += helper.cpu_ms_;
+  counters.allocations_ += helper.allocations_;
+  counters.peak_bytes_ = std::max(
+      counters.peak_bytes_, counters.bytes_in_use_ + helper.peak_bytes_);
+  counters.bytes_in_use_ += helper.bytes_;
+}
+
+Timer::Timer(const arena::Arena &arena) : arena_(arena) { start(); }
+
+void Timer::start() {
+  wall_ = std::chrono::steady_clock::now();
+  cpu_ms_ = cpu_ms();
+  allocations_ = counters.allocations_ + arena_.allocation_count();
+  counters.peak_bytes_ = counters.bytes_in_use_;
+}
+
+void Timer::phase_done(const char *name) {
+  std::chrono::duration<double, std::milli> wall =
+      std::chrono::steady_clock::now() - wall_;
+  u64 count = counters.allocations_ + arena_.allocation_count();
+  i64 peak = counters.peak_bytes_;
+  phases_.push_back(Phase{name, wall.count(), cpu_ms() - cpu_ms_,
+                          count - allocations_,
+                          static_cast<u64>(std::max<i64>(peak, 0))});
+  start();
+}
+
+Phase Timer::total() const {
+  Phase total{"total", 0, 0, 0, 0};
+  for (const auto &phase : phases_) {
+    total.wall_ms_ += phase.wall_ms_;
+    total.cpu_ms_ += phase.cpu_ms_;
+    total.allocations_ += phase.allocations_;
+    total.peak_bytes_ = std::max(total.peak_bytes_, phase.peak_bytes_);
+  }
+  return total;
+}
+
+void Timer::print_table(std::FILE *out, const char *input) const {
+  std::fprintf(out, "time report for %s:\n", input);
+  std::fprintf(out, "  %-10s %10s %10s %12s %14s\n", "phase", "wall ms",
+               "cpu ms", "allocations", "peak bytes");
+  auto row = [&](const Phase &phase) {
+    std::fprintf(out, "  %-10s %10.3f %10.3f %12lu %14lu\n", phase.name_,
+                 phase.wall_ms_, phase.cpu_ms_, phase.allocations_,
+                 phase.peak_bytes_);
+  };
+  for (const auto &phase : phases_)
+    row(phase);
+  row(total());
+  std::fprintf(out, "  peak rss %lu KB\n", peak_rss_kb());
+}
+
+static void print_json_string(std::FILE *out, const char *str) {
+  std::fputc('"', out);
+  for (const char *p = str; *p; ++p) {
+    unsigned char c = *p;
+    if (c == '"' || c == '\\')
+      std::fprintf(out, "\\%c", c);
+    else if (c < 0x20)
+      std::fprintf(out, "\\u%04x", c);
+    else
+      std::fputc(c, out);
+  }
+  std::fputc('"', out);
+}
+
+static void print_json_phase(std::FILE *out, const Phase &phase) {
+  std::fprintf(out, "{\"name\":");
+  print_json_string(out, phase.name_);
+  std::fprintf(out,
+               ",\"wall_ms\":%.3f,\"cpu_ms\":%.3f,\"allocations\":%lu,"
+               "\"peak_bytes\":%lu}",
+               phase.wall_ms_, phase.cpu_ms_, phase.allocations_,
+               phase.peak_bytes_);
+}
+
+void Timer::print_json(std::FILE *out, const char *input) const {
+  std::fprintf(out, "{\"input\":");
+  print_json_string(out, input);
+  std::fprintf(out, ",\"phases\":[");
+  for (u64 i = 0; i < phases_.size(); ++i) {
+    if (i > 0)
+      std::fputc(',', out);
+    print_json_phase(out, phases_[i]);
+  }
+  std::fprintf(out, "],\"total\":");
+  print_json_phase(out, total());
+  std::fprintf(out, ",\"peak_rss_kb\":%lu}\n", peak_rss_kb());
+}
+} // namespace stats
+
+// every plain allocation goes through here so -ftime-report can count it,
+// the aligned forms are left to the library.
+void *operator new(std::size_t size) {
+  void *p = stats::allocate(size);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void *operator new[](std::size_t size) { return operator new(size); }
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  return stats::allocate(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+  return stats::allocate(size);
+}
+
+void operator delete(void *p) noexcept { stats::release(p); }
+void operator delete[](void *p) noexcept { stats::release(p); }
+void operator delete(void *p, std::size_t) noexcept { stats::release(p); }
+void operator delete[](void *p, std::size_t) noexcept { stats::release(p); }
+
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+  stats::release(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+  stats::release(p);
+}
@@ -0,0 +1,77 @@
+#ifndef _ASMLAI_STATS_H
+#define _ASMLAI_STATS_H
+
+#include "arena.h"
+#include "types.h"
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+// Time and memory spent in each phase of a compilation, for -ftime-report.
+// CPU time and memory are counted per thread, so compilations running at the
+// same time with -j don't count each other's: operator new and the blocks
+// arenas take from malloc both add to the bytes in use by the thread. Threads
+// helping a compilation, like codegen workers, add theirs to it when they're
+// done. The report ends with the process's peak resident set.
+namespace stats {
+
+// set once before compiling starts, nothing is counted until then.
+extern bool tracking;
+
+// bytes taken from the heap, or given back when negative.
+void note_bytes(i64 bytes);
+
+// counts the usage of a thread helping the one compiling, between start()
+// and done() on the helper. add_helper() hands it to the compiling thread.
+class Helper {
+public:
+  void start();
+  void done();
+
+private:
+  friend void add_helper(const Helper &helper);
+
+  double cpu_ms_ = 0;
+  u64 allocations_ = 0;
+  i64 bytes_ = 0;
+  i64 peak_bytes_ = 0;
+};
+
+void add_helper(const Helper &helper);
+
+struct Phase {
+  const char *name_;
+  double wall_ms_;
+  double cpu_ms_;
+  // operator new calls plus objects made in the arena.
+  u64 allocations_;
+  // the most bytes in use at any point of the phase.
+  u64 peak_bytes_;
+};
+
+// Timer splits one compilation into phases, a phase runs from the end of the
+// last one, or from when the timer was made, until phase_done.
+class Timer {
+public:
+  explicit Timer(const arena::Arena &arena);
+
+  void phase_done(const char *name);
+
+  void print_table(std::FILE *out, const char *input) const;
+  // one line holding a JSON object, so reports can be appended to a log.
+  void print_json(std::FILE *out, const char *input) const;
+
+private:
+  void start();
+  Phase total() const;
+
+  const arena::Arena &arena_;
+  std::chrono::steady_clock::time_point wall_;
+  double cpu_ms_ = 0;
+  u64 allocations_ = 0;
+  std::vector<Phase> phases_;
+};
+
+} // namespace stats
+
+#endif
@@ -18,6 +18,191 @@ rm -f $tmp/out
 [ -f $tmp/out ]
 check -o
 
+# -c
+echo 'int x; int main() { return x + 3; }' > $tmp/c.c
+./asmlai -c -o $tmp/c.o $tmp/c.c
+cc -o $tmp/c $tmp/c.o
+$tmp/c
+[ $? -eq 3 ]
+check -c
+
+# string literals are local, two objects that have them link together
+echo 'char *s() { return "s"; }' > $tmp/s1.c
+echo 'int printf(); char *s(); int main() { printf(s()); printf("t"); }' \
+    > $tmp/s2.c
+./asmlai -c -o $tmp/s1.o $tmp/s1.c && ./asmlai -c -o $tmp/s2.o $tmp/s2.c &&
+    cc -o $tmp/s $tmp/s1.o $tmp/s2.o && [ "$($tmp/s)" = st ]
+check "-c with string literals"
+
+# --run
+echo 'int printf(); int main() { printf("run"); return 5; }' > $tmp/run.c
+[ "$(./asmlai --run $tmp/run.c)" = run ]
+./asmlai --run $tmp/run.c > /dev/null
+[ $? -eq 5 ]
+check --run
+
+# -I and -D, through the built-in preprocessor
+mkdir -p $tmp/inc
+printf '#ifndef ONE_H\n#define ONE_H\n#define ONE 1\n#endif\n' > $tmp/inc/one.h
+cat > $tmp/pp.c <<'EOF'
+#include <one.h>
+#include "inc/one.h"
+#define ADD(a, b) ((a) + (b))
+int main() {
+#if defined(TWO) && ONE
+  return ADD(ONE, TWO);
+#else
+  return 0;
+#endif
+}
+EOF
+./asmlai --run -I $tmp/inc -DTWO=2 $tmp/pp.c
+[ $? -eq 3 ]
+check -I
+
+# keywords work as macro names
+cat > $tmp/kw.c <<'EOF'
+#define const
+#if defined _Noreturn || !defined(const)
+#error
+#endif
+#define _Noreturn
+#ifdef _Noreturn
+#define F(int) (int + 1)
+#endif
+const int x;
+#undef const
+#ifndef const
+_Noreturn int main() { return F(2); }
+#endif
+EOF
+./asmlai --run $tmp/kw.c
+[ $? -eq 3 ]
+check "keyword macros"
+
+# groups #if leaves out aren't lexed, an open #if is reported where it starts
+cat > $tmp/skip.c <<'EOF'
+#if 0
+it's disabled
+#endif
+int main() { return 2; }
+EOF
+printf '#if 1\nint x;\n' > $tmp/open.c
+./asmlai --run $tmp/skip.c
+[ $? -eq 2 ] && ./asmlai -o $tmp/open.s $tmp/open.c 2>&1 | grep -q 'open.c:1:'
+check "skipped groups"
+
+# a libc header, which needs the multiarch directory for its bits/ headers
+cat > $tmp/limits.c <<'EOF'
+#include <limits.h>
+int main() { return CHAR_BIT + (INT_MAX == 2147483647) + (PATH_MAX == 4096); }
+EOF
+./asmlai --run $tmp/limits.c
+[ $? -eq 10 ]
+check "system headers"
+
+# --emit-pch and --include-pch
+cat > $tmp/pch.h <<'EOF'
+#define TWICE(x) ((x) + (x))
+struct pair { int a; int b; };
+typedef struct pair pair_t;
+typedef long count;
+enum color { RED, GREEN = 5, BLUE };
+int twice(pair_t *p);
+EOF
+cat > $tmp/pch.c <<'EOF'
+#include "pch.h"
+int twice(pair_t *p) { return TWICE((*p).b); }
+int main() { pair_t p; count n; p.b = 3; n = BLUE; return twice(&p) + n; }
+EOF
+./asmlai --emit-pch -o $tmp/pch.pch $tmp/pch.h &&
+    ./asmlai -o $tmp/pch1.s $tmp/pch.c &&
+    ./asmlai --include-pch $tmp/pch.pch -o $tmp/pch2.s $tmp/pch.c &&
+    cmp -s $tmp/pch1.s $tmp/pch2.s &&
+    ./asmlai --include-pch $tmp/pch.pch --run $tmp/pch.c
+[ $? -eq 12 ]
+check --include-pch
+
+# -j, several inputs
+echo 'int main() { return 1; }' > $tmp/j1.c
+echo 'int main() { return 2; }' > $tmp/j2.c
+rm -f j1.o j2.o
+./asmlai -c -j 2 $tmp/j1.c $tmp/j2.c
+[ -f j1.o ] && [ -f j2.o ]
+check -j
+rm -f j1.o j2.o
+
+# --cache-dir
+echo 'int main() { return 0 || 1 && 2; }' > $tmp/cache.c
+./asmlai --cache-dir $tmp/cache -o $tmp/cache1.s $tmp/cache.c
+./asmlai --cache-dir $tmp/cache -o $tmp/cache2.s $tmp/cache.c
+./asmlai -o $tmp/cache3.s $tmp/cache.c
+cmp -s $tmp/cache1.s $tmp/cache2.s && cmp -s $tmp/cache1.s $tmp/cache3.s &&
+    [ "$(find $tmp/cache -type f | wc -l)" -eq 1 ]
+check --cache-dir
+
+# --server, only where there is a client to talk to it
+if command -v python3 > /dev/null; then
+    ./asmlai --server $tmp/sock &
+    server=$!
+    for i in 1 2 3 4 5 6 7 8 9 10; do [ -S $tmp/sock ] && break; sleep 0.1; done
+    request() {
+        python3 -c '
+import socket, sys
+s = socket.socket(socket.AF_UNIX)
+s.connect(sys.argv[1])
+s.sendall(sys.argv[2].encode().decode("unicode_escape").encode())
+s.shutdown(socket.SHUT_WR)
+print(s.makefile().readline().split()[0])' $tmp/sock "$1"
+    }
+    error=$(request 'name s.c\n\nint main() { return x; }\n')
+    # -I and -D come with the request
+    options=$(request "include $tmp/inc\ndefine TWO=2\nname s.c\n\n\
+#include <one.h>\nint main() { return ONE + TWO; }\n")
+    kill $server
+    [ "$error" = error ] && [ "$options" = ok ]
+    check --server
+fi
+
+# -ftime-report, as a table and as JSON
+./asmlai -ftime-report -o $tmp/time.s $tmp/c.c 2>&1 | grep -q '^  codegen ' &&
+    ./asmlai -ftime-report=json -c -o $tmp/time.o $tmp/c.c 2>&1 |
+    grep -q '"name":"assemble"'
+check -ftime-report
+
+# a missing ) is reported, not run into the end of the input
+echo 'int main() { return (1 + 2; }' > $tmp/paren.c
+timeout 10 ./asmlai -o $tmp/paren.s $tmp/paren.c 2> /dev/null
+[ $? -eq 1 ]
+check unterminated
+
+# every scanning kernel level lexes the same. Besides the generated inputs,
+# two files end right at a page boundary: in a comment and in whitespace.
+for kind in functions expressions structs constants strings scopes mixed; do
+    bench/gen $kind 1 > $tmp/simd-$kind.c
+done
+for end in comment space; do
+    f=$tmp/simd-page-$end.c
+    bench/gen mixed 1 > $f
+    size=$(stat -c %s $f)
+    pad=$(( (size + 4 + 4095) / 4096 * 4096 - size ))
+    if [ $end = comment ]; then
+        { printf '//'; head -c $((pad - 3)) /dev/zero | tr '\0' x; echo; } >> $f
+    else
+        head -c $pad /dev/zero | tr '\0' ' ' >> $f
+    fi
+done
+simd=0
+for f in $tmp/simd-*.c; do
+    ./asmlai -o $f.s $f || simd=1
+    for level in scalar sse2 avx2; do
+        ASMLAI_SIMD=$level ./asmlai -o $f.$level.s $f &&
+            cmp -s $f.s $f.$level.s || simd=1
+    done
+done
+[ $simd -eq 0 ] && [ $(( $(stat -c %s $tmp/simd-page-space.c) % 4096 )) -eq 0 ]
+check ASMLAI_SIMD
+
 # --help
 ./asmlai --help 2>&1 | grep -q asmlai
 check --help
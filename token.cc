@@ -1,17 +1,33 @@
 #include "token.h"
+#include "diag.h"
+#include "preprocess.h"
+#include "scan.h"
+#include "source.h"
 
 #include <cctype>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
 #include <string.h>
 #include <strings.h>
-#include <variant>
 #include <vector>
 
 namespace token {
-static char *curr_input;
-static char *curr_filename;
+// files of the compilation on this thread, for diagnostics.
+static thread_local std::vector<const source::File *> files_;
+
+void add_file(const source::File *file) { files_.push_back(file); }
+
+void clear_files() { files_.clear(); }
+
+const source::File *file_of(const char *loc) {
+  for (const source::File *file : files_) {
+    if (file->contents_ <= loc && loc <= file->contents_ + file->size_)
+      return file;
+  }
+  return nullptr;
+}
 
 template <typename... Args>
 void error(const char *format_string, Args... args) {
@@ -20,67 +36,47 @@ void error(const char *format_string, Args... args) {
   return;
 }
 
-template <typename... Args>
-void error_at_(int line_number, char *location, const char *format_string,
-               Args... args) {
-  char *line = location;
-  while (curr_input < line && line[-1] != '\n')
-    line--;
-
-  char *end = location;
-  while (*end != '\n')
-    end++;
-
-  int indent = fprintf(stderr, "%s:%d: ", curr_filename, line_number);
-  fprintf(stderr, "%.*s\n", (int)(end - line), line);
-
-  int pos = location - line + indent;
-
-  std::fprintf(stderr, "%*s", pos, ""); // print pos spaces.
-  std::fprintf(stderr, "^ ");
-  std::fprintf(stderr, format_string, args...);
-  std::fprintf(stderr, "\n");
-
-  std::exit(1);
+void fail_at(const char *loc, const std::string &what) {
+  const source::File *file = file_of(loc);
+  // text made up by the preprocessor has no line to show.
+  if (!file)
+    throw diag::CompileError(what);
+
+  char *location = const_cast<char *>(loc);
+  char *line = source::line_start(*file, location);
+  char *end = scan::line_end(location);
+
+  std::string message = diag::format("%s:%d: ", file->path_,
+                                     source::locate(*file, location).line_);
+  int pos = location - line + message.size();
+  message += diag::format("%.*s\n", (int)(end - line), line);
+  message += diag::format("%*s", pos, ""); // pos spaces.
+  message += "^ ";
+  message += what;
+  throw diag::CompileError(std::move(message));
 }
 
 template <typename... Args>
-void error_at(char *loc, const char *fmt, Args... args) {
-  int line_number = 1;
-  for (char *p = curr_input; p < loc; p++) {
-    if (*p == '\n')
-      ++line_number;
-  }
-  error_at_(line_number, loc, fmt, args...);
+void error_at(char *location, const char *format_string, Args... args) {
+  fail_at(location, diag::format(format_string, args...));
 }
 
 template <typename... Args>
 void error_token(const Token &tok, const char *format_string, Args... args) {
-  error_at_(tok.line_number_, tok.loc_, format_string, args...);
+  error_at(tok.loc_, format_string, args...);
 }
 
-static Token new_token(char *start, char *end, TokenType type_) {
-  return Token{
-      .type_ = type_,
-      .data_ = std::monostate{},
-      .len_ = end - start,
-      .loc_ = start,
-  };
-}
-
-static void add_line_numbers(std::vector<Token> &tokens) {
-  char *p = curr_input;
-  i32 num = 1, pos = 0;
-
-  do {
-    if (p == tokens[pos].loc_) {
-      tokens[pos].line_number_ = num;
-      ++pos;
-    }
-
-    if (*p == '\n')
-      ++num;
-  } while (*p++);
+// record the start of every line that begins inside [p, end) into file, if
+// there is one. returns whether there was any.
+static bool add_lines(source::File *file, char *p, char *end) {
+  bool found = false;
+  while ((p = static_cast<char *>(memchr(p, '\n', end - p)))) {
+    ++p;
+    found = true;
+    if (file)
+      file->line_starts_.push_back(p - file->contents_);
+  }
+  return found;
 }
 
 static bool is_ident_char(char c) {
@@ -95,25 +91,204 @@ static int from_hex(char c) {
   return c - 'A' + 10;
 }
 
-static bool is_ident_any(char c) {
-  return is_ident_char(c) || ('0' <= c && c <= '9');
+struct Keyword {
+  const char *name_;
+  u8 len_;
+  TokenKind kind_;
+};
+
+constexpr Keyword kKeywords[] = {
+    {"auto", 4, TokenKind::KwAuto},
+    {"break", 5, TokenKind::KwBreak},
+    {"case", 4, TokenKind::KwCase},
+    {"char", 4, TokenKind::KwChar},
+    {"const", 5, TokenKind::KwConst},
+    {"continue", 8, TokenKind::KwContinue},
+    {"default", 7, TokenKind::KwDefault},
+    {"do", 2, TokenKind::KwDo},
+    {"double", 6, TokenKind::KwDouble},
+    {"else", 4, TokenKind::KwElse},
+    {"enum", 4, TokenKind::KwEnum},
+    {"extern", 6, TokenKind::KwExtern},
+    {"float", 5, TokenKind::KwFloat},
+    {"for", 3, TokenKind::KwFor},
+    {"goto", 4, TokenKind::KwGoto},
+    {"if", 2, TokenKind::KwIf},
+    {"inline", 6, TokenKind::KwInline},
+    {"int", 3, TokenKind::KwInt},
+    {"long", 4, TokenKind::KwLong},
+    {"register", 8, TokenKind::KwRegister},
+    {"restrict", 8, TokenKind::KwRestrict},
+    {"return", 6, TokenKind::KwReturn},
+    {"short", 5, TokenKind::KwShort},
+    {"signed", 6, TokenKind::KwSigned},
+    {"sizeof", 6, TokenKind::KwSizeof},
+    {"static", 6, TokenKind::KwStatic},
+    {"struct", 6, TokenKind::KwStruct},
+    {"switch", 6, TokenKind::KwSwitch},
+    {"typedef", 7, TokenKind::KwTypedef},
+    {"union", 5, TokenKind::KwUnion},
+    {"unsigned", 8, TokenKind::KwUnsigned},
+    {"void", 4, TokenKind::KwVoid},
+    {"volatile", 8, TokenKind::KwVolatile},
+    {"while", 5, TokenKind::KwWhile},
+    {"_Bool", 5, TokenKind::KwBool},
+    {"_Alignof", 8, TokenKind::KwAlignof},
+    {"_Alignas", 8, TokenKind::KwAlignas},
+    {"_Noreturn", 9, TokenKind::KwNoreturn},
+    {"_Static_assert", 14, TokenKind::KwStaticAssert},
+    {"_Thread_local", 13, TokenKind::KwThreadLocal},
+};
+
+// The keyword table is a perfect hash on the first and last character and the
+// length of the word; kKeywordSlots is checked collision free at compile time.
+constexpr u32 kKeywordSlots = 128;
+
+constexpr u32 keyword_hash(const char *p, u64 len) {
+  return ((u8)p[0] * 10u + (u8)p[len - 1] * 3u + (u32)len) &
+         (kKeywordSlots - 1);
 }
 
-static bool starts_with(char *p, const char *start) {
-  return strncmp(p, start, strlen(start)) == 0;
+struct KeywordTable {
+  // slot i holds kKeywords index + 1, zero when empty.
+  u8 slots_[kKeywordSlots] = {};
+  bool perfect_ = true;
+};
+
+constexpr KeywordTable build_keyword_table() {
+  KeywordTable table{};
+  for (u32 i = 0; i < sizeof kKeywords / sizeof kKeywords[0]; ++i) {
+    u32 h = keyword_hash(kKeywords[i].name_, kKeywords[i].len_);
+    if (table.slots_[h] != 0)
+      table.perfect_ = false;
+    table.slots_[h] = i + 1;
+  }
+  return table;
 }
 
-static int read_punctuator(char *p) {
-  constexpr const char *kw[] = {
-      "==", "!=", "<=", ">=", "->", "/=", "+=", "-=", "*=",  "++", "--",
-      "&&", "||", "&=", "^=", "|=", "%=", "<<", ">>", "<<=", ">>="};
-  for (int i = 0; i < sizeof kw / sizeof kw[0]; ++i) {
-    if (starts_with(p, kw[i])) {
-      return strlen(kw[i]);
-    }
-  }
+constexpr KeywordTable kKeywordTable = build_keyword_table();
+static_assert(kKeywordTable.perfect_, "keyword hash has collisions");
 
-  return std::ispunct(*p) ? 1 : 0;
+static TokenKind identifier_kind(const char *p, u64 len) {
+  if (len < 2 || len > 14)
+    return TokenKind::Identifier;
+
+  u8 slot = kKeywordTable.slots_[keyword_hash(p, len)];
+  if (slot == 0)
+    return TokenKind::Identifier;
+
+  const Keyword &kw = kKeywords[slot - 1];
+  if (kw.len_ == len && !memcmp(kw.name_, p, len))
+    return kw.kind_;
+  return TokenKind::Identifier;
+}
+
+// classify the punctuator at p by its first character, always taking the
+// longest operator that matches. returns the length, zero if p isn't one.
+static int read_punctuator(const char *p, TokenKind *kind) {
+  auto pick = [&](TokenKind k, int len) {
+    *kind = k;
+    return len;
+  };
+
+  switch (*p) {
+  case '(':
+    return pick(TokenKind::LParen, 1);
+  case ')':
+    return pick(TokenKind::RParen, 1);
+  case '{':
+    return pick(TokenKind::LBrace, 1);
+  case '}':
+    return pick(TokenKind::RBrace, 1);
+  case '[':
+    return pick(TokenKind::LBracket, 1);
+  case ']':
+    return pick(TokenKind::RBracket, 1);
+  case ';':
+    return pick(TokenKind::Semicolon, 1);
+  case ',':
+    return pick(TokenKind::Comma, 1);
+  case '?':
+    return pick(TokenKind::Question, 1);
+  case ':':
+    return pick(TokenKind::Colon, 1);
+  case '~':
+    return pick(TokenKind::Tilde, 1);
+  case '.':
+    if (p[1] == '.' && p[2] == '.')
+      return pick(TokenKind::Ellipsis, 3);
+    return pick(TokenKind::Dot, 1);
+  case '#':
+    if (p[1] == '#')
+      return pick(TokenKind::HashHash, 2);
+    return pick(TokenKind::Hash, 1);
+  case '!':
+    if (p[1] == '=')
+      return pick(TokenKind::Ne, 2);
+    return pick(TokenKind::Not, 1);
+  case '=':
+    if (p[1] == '=')
+      return pick(TokenKind::Eq, 2);
+    return pick(TokenKind::Assign, 1);
+  case '+':
+    if (p[1] == '+')
+      return pick(TokenKind::Inc, 2);
+    if (p[1] == '=')
+      return pick(TokenKind::PlusAssign, 2);
+    return pick(TokenKind::Plus, 1);
+  case '-':
+    if (p[1] == '-')
+      return pick(TokenKind::Dec, 2);
+    if (p[1] == '=')
+      return pick(TokenKind::MinusAssign, 2);
+    if (p[1] == '>')
+      return pick(TokenKind::Arrow, 2);
+    return pick(TokenKind::Minus, 1);
+  case '*':
+    if (p[1] == '=')
+      return pick(TokenKind::StarAssign, 2);
+    return pick(TokenKind::Star, 1);
+  case '/':
+    if (p[1] == '=')
+      return pick(TokenKind::SlashAssign, 2);
+    return pick(TokenKind::Slash, 1);
+  case '%':
+    if (p[1] == '=')
+      return pick(TokenKind::PercentAssign, 2);
+    return pick(TokenKind::Percent, 1);
+  case '^':
+    if (p[1] == '=')
+      return pick(TokenKind::CaretAssign, 2);
+    return pick(TokenKind::Caret, 1);
+  case '&':
+    if (p[1] == '&')
+      return pick(TokenKind::LogAnd, 2);
+    if (p[1] == '=')
+      return pick(TokenKind::AmpAssign, 2);
+    return pick(TokenKind::Amp, 1);
+  case '|':
+    if (p[1] == '|')
+      return pick(TokenKind::LogOr, 2);
+    if (p[1] == '=')
+      return pick(TokenKind::PipeAssign, 2);
+    return pick(TokenKind::Pipe, 1);
+  case '<':
+    if (p[1] == '<')
+      return p[2] == '=' ? pick(TokenKind::ShlAssign, 3)
+                         : pick(TokenKind::Shl, 2);
+    if (p[1] == '=')
+      return pick(TokenKind::Le, 2);
+    return pick(TokenKind::Lt, 1);
+  case '>':
+    if (p[1] == '>')
+      return p[2] == '=' ? pick(TokenKind::ShrAssign, 3)
+                         : pick(TokenKind::Shr, 2);
+    if (p[1] == '=')
+      return pick(TokenKind::Ge, 2);
+    return pick(TokenKind::Gt, 1);
+  default:
+    return std::ispunct(*p) ? pick(TokenKind::Punct, 1) : 0;
+  }
 }
 
 static int read_escaped_char(char **new_pos, char *p) {
@@ -166,7 +341,8 @@ static int read_escaped_char(char **new_pos, char *p) {
   }
 }
 
-static Token read_int_literal(char *start) {
+// reads a number into *val and returns the end of its spelling.
+static char *read_int_literal(char *start, i64 *val) {
   char *p = start;
 
   i32 nbase = 10;
@@ -180,17 +356,16 @@ static Token read_int_literal(char *start) {
     nbase = 8;
   }
 
-  i64 val = strtoul(p, &p, nbase);
+  *val = strtoul(p, &p, nbase);
+  while (*p == 'u' || *p == 'U' || *p == 'l' || *p == 'L')
+    ++p;
   if (std::isalnum(*p))
     error("invalid digit");
 
-  auto tok = new_token(start, p, TokenType::Num);
-  tok.data_ = val;
-
-  return tok;
+  return p;
 }
 
-static Token read_char_literal(char *start) {
+static char *read_char_literal(char *start, i64 *val) {
   char *p = start + 1;
   if (*p == '\0')
     error_at(start, "unclosed char literal");
@@ -205,165 +380,349 @@ static Token read_char_literal(char *start) {
     error_at(p, "unclosed char literal");
   }
 
-  auto tok = new_token(start, end + 1, TokenType::Num);
-  tok.data_ = c;
-
-  return tok;
+  *val = c;
+  return end + 1;
 }
 
-static char *string_literal_end(char *p) {
+// the closing quote of the string literal whose body starts at p. Escaped
+// newlines are recorded into file when it isn't null.
+static char *string_literal_end(char *p, source::File *file) {
   char *start = p;
-  for (; *p != '"'; p++) {
-    if (*p == '\n' || *p == '\0') {
+  for (;;) {
+    p = scan::string_special(p);
+    if (*p == '"')
+      return p;
+
+    if (*p == '\n' || *p == '\0' || p[1] == '\0') {
       error_at(start, "unclosed string litreal");
     }
 
-    if (*p == '\\') {
-      p++;
-    }
+    // skip the backslash and the character it escapes.
+    if (p[1] == '\n')
+      add_lines(file, p, p + 2);
+    p += 2;
   }
-  return p;
 }
 
-static Token read_string(char *start) {
-  char *end = string_literal_end(start + 1);
+// decodes the literal starting at start into *lit, returns the end of its
+// spelling.
+static char *read_string(char *start, StringLiteral *lit) {
+  char *end = string_literal_end(start + 1, nullptr);
   char *buffer = (char *)malloc((end - start) * sizeof(char));
   i64 len = 0;
 
   for (char *p = start + 1; p < end;) {
     if (*p == '\\') {
       buffer[len++] = read_escaped_char(&p, p + 1);
-    } else {
-      buffer[len++] = *p++;
+      continue;
     }
+
+    // copy everything up to the next escape in one go.
+    char *q = static_cast<char *>(memchr(p, '\\', end - p));
+    if (!q)
+      q = end;
+    memcpy(buffer + len, p, q - p);
+    len += q - p;
+    p = q;
   }
+  buffer[len] = '\0';
 
-  auto tok = new_token(start, end + 1, TokenType::String);
-  StringLiteral lit{};
-  lit.length = len + 1;
-  lit.data = buffer;
-  tok.data_ = std::move(lit);
+  lit->length = len + 1;
+  lit->data = buffer;
+  return end + 1;
+}
 
-  return tok;
+i64 read_number(char *loc) {
+  i64 val;
+  if (*loc == '\'')
+    read_char_literal(loc, &val);
+  else
+    read_int_literal(loc, &val);
+  return val;
 }
 
-std::vector<Token> tokenize_input(char *filename, char *p) {
-  curr_filename = filename;
-  curr_input = p;
+// end of the preprocessing number at p: digits, letters, underscores and dots,
+// with a sign allowed after an exponent.
+static char *number_end(char *p) {
+  for (;;) {
+    if ((*p == 'e' || *p == 'E' || *p == 'p' || *p == 'P') &&
+        (p[1] == '+' || p[1] == '-')) {
+      p += 2;
+      continue;
+    }
+    if (!std::isalnum(*p) && *p != '_' && *p != '.')
+      return p;
+    ++p;
+  }
+}
+
+bool Lexer::at_line_end() const {
+  char *p = cursor_;
+  for (;;) {
+    if (*p == '\n' || *p == '\0' || (p[0] == '/' && p[1] == '/'))
+      return true;
+    if (p[0] == '/' && p[1] == '*') {
+      // an unclosed comment is left for next() to report.
+      char *q = scan::block_comment_end(p + 2);
+      if (!q)
+        return false;
+      p = q + 2;
+    } else if (p[0] == '\\' && p[1] == '\n') {
+      p += 2;
+    } else if (std::isspace(*p)) {
+      ++p;
+    } else {
+      return false;
+    }
+  }
+}
 
-  std::vector<Token> res;
+bool Lexer::skip_lines() {
+  char *p = cursor_;
+  bool bol = bol_;
+  bool text = false;
+  for (;;) {
+    if (*p == '\0' || (bol && *p == '#'))
+      break;
 
-  while (*p) {
-    if (starts_with(p, "//")) {
+    if (p[0] == '/' && p[1] == '/') {
+      p = scan::line_end(p + 2);
+    } else if (p[0] == '/' && p[1] == '*') {
+      char *q = scan::block_comment_end(p + 2);
+      if (!q)
+        error_at(p, "unclosed block comment");
+      add_lines(file_, p, q);
+      p = q + 2;
+    } else if (p[0] == '\\' && p[1] == '\n') {
+      add_lines(file_, p, p + 2);
       p += 2;
-      while (*p != '\n')
+    } else if (*p == '\n') {
+      add_lines(file_, p, p + 1);
+      bol = true;
+      ++p;
+    } else if (std::isspace(*p)) {
+      ++p;
+    } else if (*p == '"' || *p == '\'') {
+      // up to the closing quote or the end of the line, whichever is first.
+      char quote = *p++;
+      while (*p != quote && *p != '\n' && *p != '\0') {
+        if (p[0] == '\\' && p[1] != '\0') {
+          add_lines(file_, p, p + 2);
+          ++p;
+        }
         ++p;
+      }
+      if (*p == quote)
+        ++p;
+      bol = false;
+      text = true;
+    } else {
+      ++p;
+      bol = false;
+      text = true;
+    }
+  }
+  cursor_ = p;
+  bol_ = bol;
+  return text;
+}
+
+void Lexer::next(RawToken &tok) {
+  char *p = cursor_;
+  bool space = false;
+
+  for (;;) {
+    if (p[0] == '/' && p[1] == '/') {
+      p = scan::line_end(p + 2);
+      space = true;
       continue;
     }
 
-    if (starts_with(p, "/*")) {
-      char *q = strstr(p + 2, "*/"); // kinda scuffed hack
+    if (p[0] == '/' && p[1] == '*') {
+      char *q = scan::block_comment_end(p + 2);
       if (!q) {
         error_at(p, "unclosed block comment");
       }
+      add_lines(file_, p, q);
       p = q + 2;
+      space = true;
       continue;
     }
 
     if (std::isspace(*p)) {
-      p++;
+      char *q = scan::skip_whitespace(p + 1);
+      if (add_lines(file_, p, q))
+        bol_ = true;
+      p = q;
+      space = true;
       continue;
     }
 
-    if (std::isdigit(*p)) {
-      auto tok = read_int_literal(p);
-      p += tok.len_;
-      res.push_back(std::move(tok));
+    // a backslash-newline joins the lines, it doesn't start a new one.
+    if (p[0] == '\\' && p[1] == '\n') {
+      add_lines(file_, p, p + 2);
+      p += 2;
+      space = true;
       continue;
     }
 
-    if (*p == '"') {
-      auto tok = read_string(p);
-      p += tok.len_;
-      res.push_back(std::move(tok));
-      continue;
-    }
+    break;
+  }
+
+  tok.kind_ = TokenKind::Eof;
+  tok.bol_ = bol_;
+  tok.space_ = space;
+  tok.noexpand_ = false;
+  tok.loc_ = p;
+  tok.sym_ = intern::kNoSymbol;
+  bol_ = false;
+
+  if (*p == '\0') {
+    tok.len_ = 0;
+    cursor_ = p;
+    return;
+  }
 
-    if (*p == '\'') {
-      auto tok = read_char_literal(p);
-      p += tok.len_;
-      res.push_back(tok);
+  char *start = p;
+  if (std::isdigit(*p)) {
+    tok.kind_ = TokenKind::Num;
+    p = number_end(p + 1);
+  } else if (*p == '"') {
+    tok.kind_ = TokenKind::String;
+    p = string_literal_end(p + 1, file_) + 1;
+  } else if (*p == '\'') {
+    i64 val;
+    tok.kind_ = TokenKind::Num;
+    p = read_char_literal(p, &val);
+  } else if (is_ident_char(*p)) {
+    p = scan::identifier_end(p + 1);
+    tok.kind_ = identifier_kind(start, p - start);
+    if (tok.kind_ == TokenKind::Identifier)
+      tok.sym_ = intern::intern(start, p - start);
+  } else {
+    int p_len = read_punctuator(p, &tok.kind_);
+    if (!p_len)
+      error_at(p, "invalid token");
+    p += p_len;
+  }
 
-      continue;
-    }
+  tok.len_ = p - start;
+  cursor_ = p;
+}
 
-    if (is_ident_char(*p)) {
-      char *start = p;
-      do {
-        p++;
-      } while (is_ident_any(*p));
-      auto tok = new_token(start, p, TokenType::Identifier);
-      res.push_back(std::move(tok));
-      continue;
-    }
+static constexpr u64 kInitialLookahead = 64;
 
-    int p_len = read_punctuator(p);
-    if (p_len) {
-      auto tok = new_token(p, p + p_len, TokenType::Common);
-      p += tok.len_;
-      res.push_back(std::move(tok));
-      continue;
-    }
+TokenStream::TokenStream(std::unique_ptr<preprocess::Preprocessor> pp)
+    : pp_(std::move(pp)) {
+  resize(kInitialLookahead);
+}
 
-    std::cerr << "invalid token\n";
+TokenStream::~TokenStream() {
+  // string literals still in the ring own their decoded bytes.
+  u64 first = end_ > capacity() ? end_ - capacity() : 0;
+  for (u64 i = first; i < end_; ++i) {
+    if (kinds_[i & mask_] == TokenKind::String)
+      free(strings_[i & mask_].data);
   }
+  // the preprocessor closes the files tokens point into.
+  pp_.reset();
+  clear_files();
+}
 
-  for (auto &tok : res) {
-    if (tok == "return" || tok == "else" || tok == "if" || tok == "for") {
-      tok.type_ = TokenType::Keyword;
-    }
+void TokenStream::discarded(u64 i) const {
+  diag::fail("token %lu read after it was discarded", i);
+}
+
+// only called when every slot holds a live token, nothing is dropped.
+void TokenStream::resize(u64 capacity) {
+  std::vector<TokenKind> kinds(capacity);
+  std::vector<char *> locs(capacity);
+  std::vector<u32> lengths(capacity);
+  std::vector<intern::Symbol> symbols(capacity);
+  std::vector<i64> numbers(capacity);
+  std::vector<StringLiteral> strings(capacity);
+
+  u64 mask = capacity - 1;
+  for (u64 i = begin_; i < end_; ++i) {
+    kinds[i & mask] = kinds_[i & mask_];
+    locs[i & mask] = locs_[i & mask_];
+    lengths[i & mask] = lengths_[i & mask_];
+    symbols[i & mask] = symbols_[i & mask_];
+    numbers[i & mask] = numbers_[i & mask_];
+    strings[i & mask] = strings_[i & mask_];
   }
+  kinds_ = std::move(kinds);
+  locs_ = std::move(locs);
+  lengths_ = std::move(lengths);
+  symbols_ = std::move(symbols);
+  numbers_ = std::move(numbers);
+  strings_ = std::move(strings);
+  mask_ = mask;
+}
 
-  res.push_back(new_token(p, p, TokenType::Eof));
+void TokenStream::push(const RawToken &tok) {
+  if (end_ - begin_ == capacity())
+    resize(capacity() * 2);
 
-  add_line_numbers(res);
-  return res;
-}
+  u64 s = end_ & mask_;
+  // the slot's previous token was discarded.
+  if (end_ >= capacity() && kinds_[s] == TokenKind::String)
+    free(strings_[s].data);
 
-static char *file_to_string(char *fpath) {
-  FILE *fp;
-  if (strcmp(fpath, "-") == 0) {
-    fp = stdin;
-  } else {
-    fp = std::fopen(fpath, "r");
-    if (!fp)
-      error("cannot open %s: %s", fpath, strerror(errno));
-  }
+  kinds_[s] = tok.kind_;
+  locs_[s] = tok.loc_;
+  lengths_[s] = tok.len_;
+  symbols_[s] = tok.sym_;
+  ++end_;
+}
 
-  char *buf;
-  size_t buflen;
-  FILE *out = open_memstream(&buf, &buflen);
+u64 TokenStream::bytes_reserved() const {
+  return capacity() * (sizeof(TokenKind) + sizeof(char *) + sizeof(u32) +
+                       sizeof(intern::Symbol) + sizeof(i64) +
+                       sizeof(StringLiteral));
+}
 
-  for (;;) {
-    char buf2[4096];
-    int n = std::fread(buf2, 1, sizeof(buf2), fp);
-    if (n == 0)
-      break;
-    std::fwrite(buf2, 1, n, out);
+u64 TokenStream::headers() const { return pp_->headers(); }
+
+preprocess::Preprocessor &TokenStream::preprocessor() const { return *pp_; }
+
+// pulls the next token out of the preprocessor into the ring, decoding the
+// value of literals.
+void TokenStream::lex() {
+  RawToken tok;
+  pp_->next(tok);
+
+  if (tok.kind_ == TokenKind::Num) {
+    i64 val = read_number(tok.loc_);
+    push(tok);
+    numbers_[(end_ - 1) & mask_] = val;
+  } else if (tok.kind_ == TokenKind::String) {
+    StringLiteral lit;
+    read_string(tok.loc_, &lit);
+    push(tok);
+    strings_[(end_ - 1) & mask_] = lit;
+  } else {
+    push(tok);
+    eof_ = tok.kind_ == TokenKind::Eof;
   }
+}
 
-  if (fp != stdin)
-    std::fclose(fp);
-
-  std::fflush(out);
-  if (buflen == 0 || buf[buflen - 1] != '\n')
-    std::fputc('\n', out);
-  std::fputc('\0', out);
-  std::fclose(out);
-  return buf;
+TokenStream tokenize_input(char *filename, char *p,
+                           const preprocess::Options &options) {
+  clear_files();
+  source::File file;
+  file.path_ = filename;
+  file.contents_ = p;
+  file.size_ = strlen(p);
+  return TokenStream(std::make_unique<preprocess::Preprocessor>(
+      std::move(file), false, options));
 }
 
-std::vector<Token> tokenize_path(char *path) {
-  return tokenize_input(path, file_to_string(path));
+TokenStream tokenize_path(char *path, const preprocess::Options &options) {
+  // tokens point into the file, so it stays loaded for the whole compilation
+  // and is unloaded with the stream.
+  clear_files();
+  return TokenStream(std::make_unique<preprocess::Preprocessor>(
+      source::load(path), true, options));
 }
 } // namespace token
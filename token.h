@@ -1,48 +1,278 @@
 #ifndef _ASMLAI_TOKEN_H
 #define _ASMLAI_TOKEN_H
 
+#include "intern.h"
+#include "source.h"
 #include "types.h"
 #include <memory.h>
+#include <memory>
 #include <string>
-#include <variant>
 #include <vector>
 
+namespace preprocess {
+class Preprocessor;
+struct Options;
+} // namespace preprocess
+
 namespace token {
 
-enum class TokenType {
-  Num,
-  Eof,
-  Common,
+enum class TokenKind : u8 {
   Identifier,
-  Keyword,
+  Num,
   String,
+  Eof,
+
+  // keywords
+  KwAuto,
+  KwBreak,
+  KwCase,
+  KwChar,
+  KwConst,
+  KwContinue,
+  KwDefault,
+  KwDo,
+  KwDouble,
+  KwElse,
+  KwEnum,
+  KwExtern,
+  KwFloat,
+  KwFor,
+  KwGoto,
+  KwIf,
+  KwInline,
+  KwInt,
+  KwLong,
+  KwRegister,
+  KwRestrict,
+  KwReturn,
+  KwShort,
+  KwSigned,
+  KwSizeof,
+  KwStatic,
+  KwStruct,
+  KwSwitch,
+  KwTypedef,
+  KwUnion,
+  KwUnsigned,
+  KwVoid,
+  KwVolatile,
+  KwWhile,
+  KwBool,
+  KwAlignof,
+  KwAlignas,
+  KwNoreturn,
+  KwStaticAssert,
+  KwThreadLocal,
+
+  // punctuators
+  LParen,
+  RParen,
+  LBrace,
+  RBrace,
+  LBracket,
+  RBracket,
+  Semicolon,
+  Comma,
+  Dot,
+  Ellipsis,
+  Arrow,
+  Question,
+  Colon,
+  Tilde,
+  Not,
+  Assign,
+  Plus,
+  Minus,
+  Star,
+  Slash,
+  Percent,
+  Amp,
+  Pipe,
+  Caret,
+  Shl,
+  Shr,
+  Lt,
+  Gt,
+  Eq,
+  Ne,
+  Le,
+  Ge,
+  LogAnd,
+  LogOr,
+  Inc,
+  Dec,
+  PlusAssign,
+  MinusAssign,
+  StarAssign,
+  SlashAssign,
+  PercentAssign,
+  AmpAssign,
+  PipeAssign,
+  CaretAssign,
+  ShlAssign,
+  ShrAssign,
+  Hash,
+  HashHash,
+  // any other punctuation character.
+  Punct,
 };
 
+constexpr bool is_keyword(TokenKind kind) {
+  return TokenKind::KwAuto <= kind && kind <= TokenKind::KwThreadLocal;
+}
+
 struct StringLiteral {
   u64 length;
   char *data;
 };
 
+// A token as seen by the parser. Tokens aren't stored like this, indexing a
+// TokenStream builds one on the fly from its arrays.
 struct Token {
-  bool operator==(const char *val) const {
-    return memcmp(this->loc_, val, this->len_) == 0 && val[this->len_] == '\0';
-  }
-  bool operator!=(const char *val) const { return !(*this == val); }
+  bool operator==(TokenKind kind) const { return kind_ == kind; }
+  bool operator!=(TokenKind kind) const { return kind_ != kind; }
+
+  TokenKind kind_;
+  u32 len_{0};
+  char *loc_ = nullptr;
+  // interned spelling of identifiers, kNoSymbol for everything else.
+  intern::Symbol sym_{intern::kNoSymbol};
+};
 
-  TokenType type_;
-  // variat because in the future there will be more stuff here.
-  std::variant<std::monostate, i64, StringLiteral> data_;
-  i64 len_{0};
+// A token straight out of the lexer, before preprocessing. It only knows where
+// its spelling is, literal values are decoded once it reaches the TokenStream.
+struct RawToken {
+  TokenKind kind_ = TokenKind::Eof;
+  // first token on its line, directives start with one.
+  bool bol_ = false;
+  // preceded by whitespace, stringizing keeps that as one space.
+  bool space_ = false;
+  // a macro name met inside its own expansion, it never expands.
+  bool noexpand_ = false;
+  u32 len_ = 0;
   char *loc_ = nullptr;
-  i32 line_number_{0};
+  intern::Symbol sym_ = intern::kNoSymbol;
+};
+
+// Splits text into raw tokens on demand. Line starts are recorded into file as
+// the lexer passes them; text the preprocessor makes up has no file.
+class Lexer {
+public:
+  Lexer(char *p, source::File *file) : cursor_(p), file_(file) {}
+
+  void next(RawToken &tok);
+  // whether the next token starts a new line or the input ends, found
+  // without lexing it.
+  bool at_line_end() const;
+  // skips to the next line that starts with #, or to the end of the input,
+  // without lexing the text on the way: a group #if leaves out needn't be
+  // made of valid tokens. Comments still count, quotes may be left open.
+  // Returns whether there was any text besides whitespace and comments.
+  bool skip_lines();
+
+private:
+  char *cursor_;
+  source::File *file_;
+  bool bol_ = true;
+};
+
+// Pull-based token stream. Tokens are lexed the first time the parser looks at
+// them and live in a ring buffer until the parser discards them, so memory
+// stays flat however large the input is. The ring is struct-of-arrays; a
+// literal's value sits in a side array at the same slot.
+//
+// The ring grows when the parser holds on to more tokens than fit, reading a
+// token that was already discarded is a fatal error. Past the end of the
+// input every index reads as the one Eof token, nothing more is lexed or
+// stored, so a scan that misses Eof can't grow the ring. Tokens come out of
+// the preprocessor, so they may point into any file it read.
+class TokenStream {
+public:
+  explicit TokenStream(std::unique_ptr<preprocess::Preprocessor> pp);
+  ~TokenStream();
+  TokenStream(const TokenStream &) = delete;
+  TokenStream &operator=(const TokenStream &) = delete;
+
+  Token operator[](u64 i) {
+    u64 s = slot(i);
+    Token tok;
+    tok.kind_ = kinds_[s];
+    tok.len_ = lengths_[s];
+    tok.loc_ = locs_[s];
+    if (tok.kind_ == TokenKind::Identifier)
+      tok.sym_ = symbols_[s];
+    return tok;
+  }
+
+  TokenKind kind(u64 i) { return kinds_[slot(i)]; }
+  i64 number(u64 i) { return numbers_[slot(i)]; }
+  const StringLiteral &string(u64 i) { return strings_[slot(i)]; }
+
+  // the parser won't go back to any token before pos.
+  void discard_before(u64 pos) {
+    if (pos > begin_)
+      begin_ = pos < end_ ? pos : end_;
+  }
+
+  // tokens lexed so far and the number of ring slots.
+  u64 lexed() const { return end_; }
+  u64 capacity() const { return mask_ + 1; }
+  u64 bytes_reserved() const;
+  // headers the preprocessor read.
+  u64 headers() const;
+  preprocess::Preprocessor &preprocessor() const;
+
+private:
+  u64 slot(u64 i) {
+    if (i < begin_)
+      discarded(i);
+    while (i >= end_) {
+      if (eof_)
+        return (end_ - 1) & mask_;
+      lex();
+    }
+    return i & mask_;
+  }
+
+  [[noreturn]] void discarded(u64 i) const;
+  void lex();
+  void push(const RawToken &tok);
+  void resize(u64 capacity);
+
+  std::unique_ptr<preprocess::Preprocessor> pp_;
+  // tokens [begin_, end_) are in the ring.
+  u64 begin_ = 0;
+  u64 end_ = 0;
+  u64 mask_ = 0;
+  // the last token in the ring is the Eof.
+  bool eof_ = false;
+
+  std::vector<TokenKind> kinds_;
+  std::vector<char *> locs_;
+  std::vector<u32> lengths_;
+  std::vector<intern::Symbol> symbols_;
+  std::vector<i64> numbers_;
+  std::vector<StringLiteral> strings_;
 };
 
 template <typename... Args> void error(const char *format_string, Args... args);
 template <typename... Args>
 void error_at(char *location, const char *format_string, Args... args);
 
-std::vector<Token> tokenize_input(char *filename, char *p);
-std::vector<Token> tokenize_path(char *path);
+// throws a diagnostic pointing at loc, which may be in any file that is open.
+[[noreturn]] void fail_at(const char *loc, const std::string &message);
+
+// the files diagnostics can point into, kept per thread for one compilation.
+void add_file(const source::File *file);
+void clear_files();
+const source::File *file_of(const char *loc);
+
+// value of a number or character literal spelled at loc.
+i64 read_number(char *loc);
+
+TokenStream tokenize_input(char *filename, char *p,
+                           const preprocess::Options &options);
+TokenStream tokenize_path(char *path, const preprocess::Options &options);
 
 } // namespace token
 
@@ -1,16 +1,17 @@
 #include "typesystem.h"
+#include "arena.h"
+#include "diag.h"
 #include "parser.h"
-#include <iostream>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <memory>
+#include <unordered_map>
 #include <variant>
+#include <vector>
 
 namespace typesystem {
 
-#define ADD_NOT_NULL(node)                                                     \
-  if (node != nullptr) {                                                       \
-    add_type(*node);                                                           \
-  }
-
 bool is_number(parser::Type *ty) {
   return ty->type_ == parser::Types::Int || ty->type_ == parser::Types::Char ||
          ty->type_ == parser::Types::Short ||
@@ -18,71 +19,174 @@ bool is_number(parser::Type *ty) {
          ty->type_ == parser::Types::Enum;
 }
 
+namespace {
+// structure of a derived type: pointers only have a base, arrays a base and a
+// length, the enum type neither.
+struct TypeKey {
+  bool operator==(const TypeKey &other) const {
+    return kind_ == other.kind_ && base_ == other.base_ &&
+           length_ == other.length_;
+  }
+
+  parser::Types kind_;
+  parser::Type *base_;
+  i64 length_;
+};
+
+struct TypeKeyHash {
+  u64 operator()(const TypeKey &key) const {
+    u64 h = reinterpret_cast<std::uintptr_t>(key.base_);
+    h = (h ^ static_cast<u64>(key.kind_)) * 0x100000001b3;
+    h = (h ^ static_cast<u64>(key.length_)) * 0x100000001b3;
+    return h ^ (h >> 29);
+  }
+};
+} // namespace
+
+// canonical derived types, they live in the compilation arena with the types
+// they're built from. Each thread compiles with its own arena, so each has its
+// own table.
+static thread_local std::unordered_map<TypeKey, parser::Type *, TypeKeyHash>
+    types_;
+
+// builtin types are never freed, the first call creates them.
+static parser::Type *builtin(parser::Types kind, i32 size) {
+  return new parser::Type(kind, size, size);
+}
+
+parser::Type *empty_type() {
+  static parser::Type *ty = new parser::Type(parser::Types::Empty, 0, 1);
+  return ty;
+}
+
+parser::Type *void_type() {
+  static parser::Type *ty = builtin(parser::Types::Void, 1);
+  return ty;
+}
+
+parser::Type *char_type() {
+  static parser::Type *ty = builtin(parser::Types::Char, parser::kCharSize);
+  return ty;
+}
+
+parser::Type *short_type() {
+  static parser::Type *ty = builtin(parser::Types::Short, parser::kShortSize);
+  return ty;
+}
+
+parser::Type *int_type() {
+  static parser::Type *ty = builtin(parser::Types::Int, parser::kNumberSize);
+  return ty;
+}
+
+parser::Type *long_type() {
+  static parser::Type *ty = builtin(parser::Types::Long, parser::kLongSize);
+  return ty;
+}
+
 parser::Type *enum_type() {
-  return new parser::Type(parser::Types::Enum, parser::kNumberSize,
-                          parser::kNumberSize);
+  parser::Type *&ty = types_[TypeKey{parser::Types::Enum, nullptr, 0}];
+  if (!ty) {
+    ty = arena::make<parser::Type>(parser::Types::Enum, parser::kNumberSize,
+                                   parser::kNumberSize);
+  }
+  return ty;
 }
 
 parser::Type *ptr_to(parser::Type *base) {
-  parser::Type *tt =
-      new parser::Type(parser::Types::Ptr, parser::kPtrSize, parser::kPtrSize);
-  tt->base_type_ = base;
-  return tt;
+  parser::Type *&ty = types_[TypeKey{parser::Types::Ptr, base, 0}];
+  if (!ty) {
+    ty = arena::make<parser::Type>(parser::Types::Ptr, parser::kPtrSize,
+                                   parser::kPtrSize);
+    ty->base_type_ = base;
+  }
+  return ty;
 }
 
 parser::Type *func_ty(parser::Type *return_ty) {
-  parser::Type *ty = new parser::Type(parser::Types::Function, 0);
+  parser::Type *ty = arena::make<parser::Type>(parser::Types::Function, 0);
   ty->optional_data_ = return_ty;
 
   return return_ty;
 }
 
 parser::Type *array_of_type(parser::Type *array_type, i32 length) {
-  parser::Type *ty = new parser::Type(
-      parser::Types::Array, array_type->size_ * length, array_type->align_);
-  parser::ArrayType array_data_;
-
-  array_data_.array_length = length;
-  ty->base_type_ = array_type;
-  ty->name_ = array_type->name_;
-  ty->optional_data_ = std::move(array_data_);
-
+  parser::Type *&ty = types_[TypeKey{parser::Types::Array, array_type, length}];
+  if (!ty) {
+    ty = arena::make<parser::Type>(parser::Types::Array,
+                                   array_type->size_ * length,
+                                   array_type->align_);
+    ty->base_type_ = array_type;
+    ty->optional_data_ = parser::ArrayType{length};
+  }
   return ty;
 }
 
-void add_type(parser::Node &node) {
-  if (node.tt_->type_ != parser::Types::Empty)
-    return;
+namespace {
+struct Frame {
+  parser::Node *node_;
+  bool expanded_;
+};
+} // namespace
 
-  ADD_NOT_NULL(node.lhs_);
-  ADD_NOT_NULL(node.rhs_);
+// work list of add_type, kept around so annotating doesn't allocate.
+static thread_local std::vector<Frame> stack_;
 
-  if (node.type_ == parser::NodeType::For) {
-    parser::ForNode &for_node = std::get<parser::ForNode>(node.data_);
-    ADD_NOT_NULL(for_node.body_);
-    ADD_NOT_NULL(for_node.increment_);
-    ADD_NOT_NULL(for_node.initialization_);
-    ADD_NOT_NULL(for_node.condition_);
-    return;
-  } else if (node.type_ == parser::NodeType::If) {
-    parser::IfNode &if_node = std::get<parser::IfNode>(node.data_);
-    ADD_NOT_NULL(if_node.condition_);
-    ADD_NOT_NULL(if_node.then_);
-    ADD_NOT_NULL(if_node.else_);
-    return;
-  } else if (node.type_ == parser::NodeType::Block) {
-    try {
-      auto &vec = std::get<std::vector<parser::NodePtr>>(node.data_);
-      for (auto &d : vec) {
-        add_type(*d);
-      }
-      return;
-    } catch (std::bad_variant_access &e) {
-      return; // we just return as we have just encountered a null-expression
-              // i.e ';'.
+void reset_types() {
+  types_.clear();
+  // an error may have left add_type halfway through.
+  stack_.clear();
+}
+
+static void push(parser::NodePtr node) {
+  if (node && !node->typed_)
+    stack_.push_back(Frame{node, false});
+}
+
+// pushes the children of node, the last one pushed is visited first.
+static void push_children(parser::Node &node) {
+  using NT = parser::NodeType;
+  switch (node.type_) {
+  case NT::For: {
+    const auto &for_node = std::get<parser::ForNode>(node.data_);
+    push(for_node.condition_);
+    push(for_node.initialization_);
+    push(for_node.increment_);
+    push(for_node.body_);
+    break;
+  }
+  case NT::If:
+  case NT::Cond: {
+    const auto &if_node = std::get<parser::IfNode>(node.data_);
+    push(if_node.else_);
+    push(if_node.then_);
+    push(if_node.condition_);
+    break;
+  }
+  case NT::Block:
+  case NT::FunctionCall: {
+    // a lone ';' is a block without a node list.
+    if (const auto *nodes = std::get_if<parser::NodeList>(&node.data_)) {
+      for (auto it = nodes->rbegin(); it != nodes->rend(); ++it)
+        push(*it);
     }
+    break;
+  }
+  case NT::StmtExpr: {
+    if (const auto *body = std::get_if<parser::NodePtr>(&node.data_))
+      push(*body);
+    break;
   }
+  default:
+    break;
+  }
+
+  push(node.rhs_);
+  push(node.lhs_);
+}
 
+// the type of node, all of its children are already annotated.
+static void annotate(parser::Node &node) {
   using NT = parser::NodeType;
   switch (node.type_) {
   case NT::Add:
@@ -94,10 +198,8 @@ void add_type(parser::Node &node) {
     node.tt_ = node.lhs_->tt_;
     return;
   case NT::Assign:
-    if (node.lhs_->tt_->type_ == parser::Types::Array) {
-      std::fprintf(stderr, "assigning to a non-lvalue");
-      std::exit(1);
-    }
+    if (node.lhs_->tt_->type_ == parser::Types::Array)
+      diag::fail("assigning to a non-lvalue");
 
     node.tt_ = node.lhs_->tt_;
     return;
@@ -113,8 +215,7 @@ void add_type(parser::Node &node) {
   case NT::LogAnd:
   case NT::LogOr:
   case NT::Not: {
-    node.tt_ = new parser::Type(parser::Types::Int, parser::kNumberSize,
-                                parser::kNumberSize);
+    node.tt_ = int_type();
     return;
   }
   case NT::Variable: {
@@ -130,51 +231,64 @@ void add_type(parser::Node &node) {
     return;
   }
   case NT::Derefence: {
-    if (!node.lhs_->tt_->base_type_) {
-      std::fprintf(stderr, "invalid pointer dereference.");
-      std::exit(1);
-    }
+    if (!node.lhs_->tt_->base_type_)
+      diag::fail("invalid pointer dereference.");
 
-    if (node.lhs_->tt_->base_type_->type_ == parser::Types::Void) {
-      std::fprintf(stderr, "dereferencing a void pointer");
-      std::exit(1);
-    }
+    if (node.lhs_->tt_->base_type_->type_ == parser::Types::Void)
+      diag::fail("dereferencing a void pointer");
 
     node.tt_ = node.lhs_->tt_->base_type_;
     return;
   }
   case NT::StmtExpr: {
-    try {
-      const auto &body_node = *std::get<parser::NodePtr>(node.data_);
-      const auto &node_list = std::get<parser::NodeList>(body_node.data_);
-
-      if (node_list[node_list.size() - 1]->type_ == NT::ExprStmt) {
-        node.tt_ = node_list[node_list.size() - 1]->tt_;
-        return;
-      }
-    } catch (const std::bad_variant_access &e) {
-      std::fprintf(stderr, "statement expression needs to return a type.");
-      return;
-    }
+    // the value of the last expression statement, a statement expression
+    // ending in anything else has no type.
+    const auto *body = std::get_if<parser::NodePtr>(&node.data_);
+    const auto *nodes =
+        body ? std::get_if<parser::NodeList>(&(*body)->data_) : nullptr;
+    if (nodes && !nodes->empty() && nodes->back()->type_ == NT::ExprStmt)
+      node.tt_ = nodes->back()->lhs_->tt_;
+    return;
   }
   case NT::Comma: {
     node.tt_ = node.rhs_->tt_;
     return;
   }
   case NT::Member: {
-    try {
-      node.tt_ = std::get<parser::Member *>(node.data_)->type;
-      return;
-    } catch (const std::bad_variant_access &e) {
+    if (auto *member = std::get_if<parser::Member *>(&node.data_)) {
+      node.tt_ = (*member)->type;
+    } else {
       std::fprintf(stderr, "cannot access member in node pointer.");
-      return;
     }
     return;
   }
-  default: {
-  }
+  default:
+    return;
   }
+}
 
-  return;
+// Annotates every node under root in one post-order walk on an explicit
+// stack. Nodes are marked as they're done, so the parser can call this on a
+// subtree as it builds it and the enclosing call skips over it later. Nodes
+// the parser gave a type up front, like casts, are taken as they are.
+void add_type(parser::Node &root) {
+  push(&root);
+  while (!stack_.empty()) {
+    Frame &frame = stack_.back();
+    parser::Node &node = *frame.node_;
+    if (node.typed_) {
+      stack_.pop_back();
+    } else if (node.tt_->type_ != parser::Types::Empty) {
+      node.typed_ = true;
+      stack_.pop_back();
+    } else if (!frame.expanded_) {
+      frame.expanded_ = true;
+      push_children(node);
+    } else {
+      stack_.pop_back();
+      annotate(node);
+      node.typed_ = true;
+    }
+  }
 }
 } // namespace typesystem
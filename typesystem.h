@@ -5,10 +5,23 @@
 #include <memory>
 namespace typesystem {
 void add_type(parser::Node &node);
+
+// Types are canonical: there is one instance of every builtin, pointer, array
+// and enum type, so two of them are the same type exactly when the pointers
+// are equal. Struct, union and function types are still created per
+// declaration.
+parser::Type *empty_type();
+parser::Type *void_type();
+parser::Type *char_type();
+parser::Type *short_type();
+parser::Type *int_type();
+parser::Type *long_type();
 parser::Type *ptr_to(parser::Type *base);
 parser::Type *func_ty(parser::Type *ty);
 parser::Type *array_of_type(parser::Type *array_type, i32 length);
 parser::Type *enum_type();
+// forgets the derived types, call before the arena holding them is released.
+void reset_types();
 
 bool is_number(parser::Type *ty);
 } // namespace typesystem